@@ -80,6 +80,14 @@ class Roaring {
         roaring_bitmap_add_many(roaring, n_args, vals);
     }
 
+    /**
+     * Add value n_args from pointer vals, strictly increasing and larger than
+     * the maximum. Returns false, changing nothing, if they are not.
+     */
+    bool appendMany(size_t n_args, const uint32_t *vals) {
+        return roaring_bitmap_append_many(roaring, n_args, vals);
+    }
+
     /**
      * Remove value x
      *
@@ -311,6 +319,34 @@ class Roaring {
         return ans;
     }
 
+    /**
+     * Creates a read-only bitmap over a buffer written by writeFrozen, without
+     * copying its containers. The buffer must be aligned on 32 bytes, hold
+     * exactly getFrozenSizeInBytes() bytes and outlive the bitmap.
+     */
+    static const Roaring frozenView(const char *buf, size_t length) {
+        const roaring_bitmap_t *s = roaring_bitmap_frozen_view(buf, length);
+        if (s == NULL) {
+            throw std::runtime_error("failed to read frozen bitmap");
+        }
+        return Roaring(const_cast<roaring_bitmap_t *>(s));
+    }
+
+    /**
+     * Writes the bitmap in the frozen format, see frozenView. The buffer must
+     * hold getFrozenSizeInBytes() bytes.
+     */
+    void writeFrozen(char *buf) const {
+        roaring_bitmap_frozen_serialize(roaring, buf);
+    }
+
+    /**
+     * How many bytes writeFrozen needs.
+     */
+    size_t getFrozenSizeInBytes() const {
+        return roaring_bitmap_frozen_size_in_bytes(roaring);
+    }
+
     /**
      * How many bytes are required to serialize this bitmap (meant to be
      * compatible
@@ -393,9 +429,11 @@ class Roaring {
 
     /**
      * computes the logical or (union) between "n" bitmaps (referenced by a
-     * pointer).
+     * pointer). With threads > 1, large inputs are split by key range and
+     * merged on that many threads.
      */
-    static Roaring fastunion(size_t n, const Roaring **inputs) {
+    static Roaring fastunion(size_t n, const Roaring **inputs,
+                             int threads = 1) {
         const roaring_bitmap_t **x =
             (const roaring_bitmap_t **)malloc(n * sizeof(roaring_bitmap_t *));
         if (x == NULL) {
@@ -404,7 +442,7 @@ class Roaring {
         for (size_t k = 0; k < n; ++k) x[k] = inputs[k]->roaring;
 
         Roaring ans(NULL);
-        ans.roaring = roaring_bitmap_or_many(n, x);
+        ans.roaring = roaring_bitmap_or_many_parallel(n, x, threads);
         if (ans.roaring == NULL) {
             throw std::runtime_error("failed memory alloc in fastunion");
         }
@@ -488,6 +526,22 @@ public:
     return orig;
   }
 
+  /**
+  * Move the iterator to the first value >= val.
+  */
+  void equalorlarger(uint32_t val) {
+    roaring_move_uint32_iterator_equalorlarger(i, val);
+  }
+
+  /**
+  * Copies up to count values to buf, from the current one on, and moves the
+  * iterator past them. Returns the number of values copied, smaller than
+  * count only when the iterator reached the end.
+  */
+  uint32_t read(uint32_t *buf, uint32_t count) {
+    return roaring_read_uint32_iterator(i, buf, count);
+  }
+
   bool operator==(const RoaringSetBitForwardIterator &o) {
     return i->current_value == *o;
   }
@@ -95,6 +95,19 @@ int32_t intersect_skewed_uint16(const uint16_t *small, size_t size_s,
 int32_t intersect_uint16(const uint16_t *A, const size_t lenA,
                          const uint16_t *B, const size_t lenB, uint16_t *out);
 
+/* Computes the size of the intersection between one small and one large set of
+ * uint16_t. */
+int32_t intersect_skewed_uint16_cardinality(const uint16_t *small,
+                                            size_t size_s,
+                                            const uint16_t *large,
+                                            size_t size_l);
+
+/**
+ * Generic intersection function, returns just the cardinality.
+ */
+int32_t intersect_uint16_cardinality(const uint16_t *A, const size_t lenA,
+                                     const uint16_t *B, const size_t lenB);
+
 /**
  * Generic union function.
  */
@@ -157,4 +170,12 @@ int32_t difference_vector16(const uint16_t * A, size_t s_a, const uint16_t * B,
 size_t union_uint32_card(const uint32_t *set_1, size_t size_1,
                          const uint32_t *set_2, size_t size_2);
 
+/**
+ * Sorts the n values of vals with a least significant digit radix sort, one
+ * byte at a time, using buffer (of n values) as scratch space, then removes
+ * the duplicates. Bytes that are the same in all values are skipped. Returns
+ * the number of distinct values left at the start of vals.
+ */
+size_t radix_sort_unique_uint32(uint32_t *vals, uint32_t *buffer, size_t n);
+
 #endif
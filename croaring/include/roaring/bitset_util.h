@@ -75,6 +75,28 @@ static inline void bitset_reset_range(uint64_t *bitmap, uint32_t start,
     bitmap[endword] &= ~((~UINT64_C(0)) >> ((-end) % 64));
 }
 
+/*
+ * Returns the number of set bits in indexes [begin,begin+lenminusone].
+ */
+static inline int bitset_lenrange_cardinality(const uint64_t *bitmap,
+                                              uint32_t start,
+                                              uint32_t lenminusone) {
+    uint32_t firstword = start / 64;
+    uint32_t endword = (start + lenminusone) / 64;
+    if (firstword == endword) {
+        return hamming(bitmap[firstword] &
+                       ((~UINT64_C(0)) >> ((63 - lenminusone)))
+                           << (start % 64));
+    }
+    int answer = hamming(bitmap[firstword] & ((~UINT64_C(0)) << (start % 64)));
+    for (uint32_t i = firstword + 1; i < endword; i++) {
+        answer += hamming(bitmap[i]);
+    }
+    answer += hamming(bitmap[endword] &
+                      (~UINT64_C(0)) >> ((-start - lenminusone - 1) % 64));
+    return answer;
+}
+
 /*
  * Given a bitset containing "length" 64-bit words, write out the position
  * of all the set bits to "out", values start at "base".
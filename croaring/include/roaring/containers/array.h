@@ -111,6 +111,11 @@ void array_container_intersection(const array_container_t *src_1,
 void array_container_intersection_inplace(array_container_t *src_1,
                                           const array_container_t *src_2);
 
+/* computes the size of the intersection of array1 and array2
+ * */
+int array_container_intersection_cardinality(const array_container_t *src_1,
+                                             const array_container_t *src_2);
+
 /* computes the negation of an array container src, writing to dst,
  *  assumed distinct from src
  *  moved to mixed_negation  TODO: clean me up here
@@ -326,4 +331,17 @@ inline int array_container_rank(const array_container_t *arr, uint16_t x) {
   }
 }
 
+/* Returns the index of the first value equal or larger than x, or -1 */
+inline int array_container_index_equalorlarger(const array_container_t *arr, uint16_t x) {
+  const int32_t idx = binarySearch(arr->array, arr->cardinality, x);
+  const bool is_present = idx >= 0;
+  if (is_present) {
+    return idx;
+  } else {
+    int32_t candidate = -idx - 1;
+    if (candidate < arr->cardinality) return candidate;
+    return -1;
+  }
+}
+
 #endif /* INCLUDE_CONTAINERS_ARRAY_H_ */
@@ -56,6 +56,18 @@ bool run_bitset_container_intersection(const run_container_t *src_1,
  * to free the container.
  * In all cases, the result is in *dst.
  */
+/* Compute the size of the intersection of src_1 and src_2 . */
+int array_bitset_container_intersection_cardinality(
+    const array_container_t *src_1, const bitset_container_t *src_2);
+
+/* Compute the size of the intersection of src_1 and src_2 . */
+int array_run_container_intersection_cardinality(
+    const array_container_t *src_1, const run_container_t *src_2);
+
+/* Compute the size of the intersection of src_1 and src_2 . */
+int run_bitset_container_intersection_cardinality(
+    const run_container_t *src_1, const bitset_container_t *src_2);
+
 bool bitset_bitset_container_intersection_inplace(
     bitset_container_t *src_1, const bitset_container_t *src_2, void **dst);
 
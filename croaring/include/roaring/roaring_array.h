@@ -3,8 +3,10 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <roaring/array_util.h>
+#include <roaring/roaring_types.h>
 #include <roaring/containers/containers.h>
 
 #define MAX_CONTAINERS 65536
@@ -15,9 +17,13 @@
 enum {
     SERIAL_COOKIE_NO_RUNCONTAINER = 12346,
     SERIAL_COOKIE = 12347,
+    FROZEN_COOKIE = 13766,
     NO_OFFSET_THRESHOLD = 4
 };
 
+/* the containers and keys live in a frozen buffer, see roaring_bitmap_frozen_view */
+#define ROARING_FLAG_FROZEN UINT8_C(0x1)
+
 /**
  * Roaring arrays are array-based key-value pairs having containers as values
  * and 16-bit integer keys. A roaring bitmap  might be implemented as such.
@@ -34,6 +40,7 @@ typedef struct roaring_array_s {
     void **containers;
     uint16_t *keys;
     uint8_t *typecodes;
+    uint8_t flags;
 } roaring_array_t;
 
 /**
@@ -220,6 +227,37 @@ size_t ra_portable_serialize(const roaring_array_t *ra, char *buf);
  */
 bool ra_portable_deserialize(roaring_array_t * ra, const char *buf);
 
+/**
+ * read a bitmap in the format of ra_portable_serialize from a stream, one
+ * container at a time, without a buffer holding the whole input. Every
+ * container gets exactly the capacity it needs. The input is validated
+ * (sorted keys, sorted values, cardinalities matching the header): returns
+ * false if it is not a valid bitmap, in which case the containers read so
+ * far are left in ra, that must still be cleared.
+ */
+bool ra_portable_deserialize_stream(roaring_array_t *ra,
+                                    roaring_read_callback read, void *param);
+
+/**
+ * Checks that buf, of at most maxbytes bytes, holds a valid bitmap in the
+ * format of ra_portable_serialize, without allocating anything. Returns its
+ * size in bytes, or 0 if it is not valid.
+ */
+size_t ra_portable_deserialize_size(const char *buf, const size_t maxbytes);
+
+/**
+ * Checks whether the serialized bitmap in buf contains x, looking only at the
+ * header and at the one container that could hold x. The buffer must have
+ * been checked with ra_portable_deserialize_size.
+ */
+bool ra_portable_contains(const char *buf, uint32_t x);
+
+/**
+ * Cardinality of the serialized bitmap in buf, read from its header. The
+ * buffer must have been checked with ra_portable_deserialize_size.
+ */
+uint64_t ra_portable_cardinality(const char *buf);
+
 /**
  * How many bytes are required to serialize this bitmap (meant to be
  * compatible
@@ -238,6 +276,13 @@ bool ra_has_run_container(const roaring_array_t *ra);
  */
 uint32_t ra_portable_header_size(const roaring_array_t *ra);
 
+/**
+ * write the header of ra_portable_serialize, that is everything before the
+ * first container, to a buffer of ra_portable_header_size(ra) bytes.
+ * Returns the number of bytes written.
+ */
+size_t ra_portable_serialize_header(const roaring_array_t *ra, char *buf);
+
 /**
  * If the container at the index i is share, unshare it (creating a local
  * copy if needed).
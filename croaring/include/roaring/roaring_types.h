@@ -8,6 +8,11 @@
 typedef bool (*roaring_iterator)(uint32_t value, void *param);
 typedef bool (*roaring_iterator64)(uint64_t value, void *param);
 
+/**
+ * Reads exactly len bytes into buf, returns false if they are not available.
+ */
+typedef bool (*roaring_read_callback)(void *buf, size_t len, void *param);
+
 /**
 *  (For advanced users.)
 * The roaring_statistics_t can be used to collect detailed statistics about
@@ -604,6 +604,72 @@ int32_t intersect_skewed_uint16(const uint16_t *small, size_t size_s,
     return pos;
 }
 
+/**
+ * Cardinality-only version of intersect_skewed_uint16.
+ */
+int32_t intersect_skewed_uint16_cardinality(const uint16_t *small,
+                                            size_t size_s,
+                                            const uint16_t *large,
+                                            size_t size_l) {
+    size_t pos = 0, idx_l = 0, idx_s = 0;
+
+    if (0 == size_s) {
+        return 0;
+    }
+
+    uint16_t val_l = large[idx_l], val_s = small[idx_s];
+
+    while (true) {
+        if (val_l < val_s) {
+            idx_l = advanceUntil(large, idx_l, size_l, val_s);
+            if (idx_l == size_l) break;
+            val_l = large[idx_l];
+        } else if (val_s < val_l) {
+            idx_s++;
+            if (idx_s == size_s) break;
+            val_s = small[idx_s];
+        } else {
+            pos++;
+            idx_s++;
+            if (idx_s == size_s) break;
+            val_s = small[idx_s];
+            idx_l = advanceUntil(large, idx_l, size_l, val_s);
+            if (idx_l == size_l) break;
+            val_l = large[idx_l];
+        }
+    }
+
+    return pos;
+}
+
+/**
+ * Cardinality-only version of intersect_uint16.
+ */
+int32_t intersect_uint16_cardinality(const uint16_t *A, const size_t lenA,
+                                     const uint16_t *B, const size_t lenB) {
+    int32_t answer = 0;
+    if (lenA == 0 || lenB == 0) return 0;
+    const uint16_t *endA = A + lenA;
+    const uint16_t *endB = B + lenB;
+
+    while (1) {
+        while (*A < *B) {
+        SKIP_FIRST_COMPARE:
+            if (++A == endA) return answer;
+        }
+        while (*A > *B) {
+            if (++B == endB) return answer;
+        }
+        if (*A == *B) {
+            ++answer;
+            if (++A == endA || ++B == endB) return answer;
+        } else {
+            goto SKIP_FIRST_COMPARE;
+        }
+    }
+    return answer;  // NOTREACHED
+}
+
 /**
  * Generic intersection function. Passes unit tests.
  */
@@ -1558,6 +1624,43 @@ size_t union_uint32_card(const uint32_t *set_1, size_t size_1,
     }
     return pos;
 }
+
+size_t radix_sort_unique_uint32(uint32_t *vals, uint32_t *buffer, size_t n) {
+    if (n == 0) return 0;
+    size_t counts[4][256];
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < n; i++) {
+        const uint32_t val = vals[i];
+        counts[0][val & 0xFF]++;
+        counts[1][(val >> 8) & 0xFF]++;
+        counts[2][(val >> 16) & 0xFF]++;
+        counts[3][val >> 24]++;
+    }
+    uint32_t *src = vals, *dst = buffer;
+    for (int pass = 0; pass < 4; pass++) {
+        const int shift = pass * 8;
+        if (counts[pass][(src[0] >> shift) & 0xFF] == n) continue;
+        size_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            const size_t count = counts[pass][b];
+            counts[pass][b] = offset;
+            offset += count;
+        }
+        for (size_t i = 0; i < n; i++) {
+            const uint32_t val = src[i];
+            dst[counts[pass][(val >> shift) & 0xFF]++] = val;
+        }
+        uint32_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    size_t unique = 1;
+    vals[0] = src[0];
+    for (size_t i = 1; i < n; i++) {
+        if (src[i] != vals[unique - 1]) vals[unique++] = src[i];
+    }
+    return unique;
+}
 /* end file src/array_util.c */
 /* begin file src/bitset_util.c */
 #include <assert.h>
@@ -2499,6 +2602,7 @@ void bitset_flip_list(void *bitset, const uint16_t *list, uint64_t length) {
 extern inline uint16_t array_container_minimum(const array_container_t *arr) ;
 extern inline uint16_t array_container_maximum(const array_container_t *arr);
 extern inline int array_container_rank(const array_container_t *arr, uint16_t x) ;
+extern inline int array_container_index_equalorlarger(const array_container_t *arr, uint16_t x);
 extern inline bool array_container_contains(const array_container_t *arr,
                                              uint16_t pos);
 extern int array_container_cardinality(const array_container_t *array);
@@ -2753,6 +2857,24 @@ void array_container_intersection_inplace(array_container_t *src_1,
     }
 }
 
+/* computes the size of the intersection of array1 and array2
+ * */
+int array_container_intersection_cardinality(const array_container_t *src_1,
+                                             const array_container_t *src_2) {
+    int32_t card_1 = src_1->cardinality, card_2 = src_2->cardinality;
+    const int threshold = 64;  // subject to tuning
+    if (card_1 * threshold < card_2) {
+        return intersect_skewed_uint16_cardinality(src_1->array, card_1,
+                                                   src_2->array, card_2);
+    } else if (card_2 * threshold < card_1) {
+        return intersect_skewed_uint16_cardinality(src_2->array, card_2,
+                                                   src_1->array, card_1);
+    } else {
+        return intersect_uint16_cardinality(src_1->array, card_1,
+                                            src_2->array, card_2);
+    }
+}
+
 int array_container_to_uint32_array(void *vout,
                                     const array_container_t *cont,
                                     uint32_t base) {
@@ -3496,11 +3618,28 @@ int bitset_container_rank(const bitset_container_t *container, uint16_t x) {
   // we have that k < x, but not so large that k+63<=x
   // k is a power of 64
   int bitsleft = x32 - k + 1;// will be in [0,64)
-  uint64_t leftoverword = container->array[k / 64];// k / 64 should be within scope
+  // nothing is left when x ends a word, and for x = 0xFFFF, k / 64 is past the end
+  if (bitsleft == 0) return sum;
+  uint64_t leftoverword = container->array[k / 64];
   leftoverword = leftoverword & ((UINT64_C(1) << bitsleft) - 1);
   sum += hamming(leftoverword);
   return sum;
 }
+
+/* Returns the first value equal or larger than x, or -1 */
+int bitset_container_index_equalorlarger(const bitset_container_t *container, uint16_t x) {
+  uint32_t x32 = x;
+  uint32_t k = x32 / 64;
+  uint64_t word = container->array[k];
+  const int diff = x32 - k * 64; // in [0,64)
+  word = (word >> diff) << diff; // clears the bits below x
+  while (word == 0) {
+    k++;
+    if (k == BITSET_CONTAINER_SIZE_IN_WORDS) return -1;
+    word = container->array[k];
+  }
+  return k * 64 + __builtin_ctzll(word);
+}
 /* end file src/containers/bitset.c */
 /* begin file src/containers/containers.c */
 
@@ -4849,6 +4988,61 @@ bool bitset_bitset_container_intersection_inplace(
     }
     return false;  // not a bitset
 }
+
+/* Compute the size of the intersection of src_1 and src_2 . */
+int array_bitset_container_intersection_cardinality(
+    const array_container_t *src_1, const bitset_container_t *src_2) {
+    int32_t newcard = 0;
+    const int32_t origcard = src_1->cardinality;
+    for (int i = 0; i < origcard; ++i) {
+        uint16_t key = src_1->array[i];
+        newcard += bitset_container_contains(src_2, key);
+    }
+    return newcard;
+}
+
+/* Compute the size of the intersection of src_1 and src_2 . */
+int array_run_container_intersection_cardinality(
+    const array_container_t *src_1, const run_container_t *src_2) {
+    if (src_2->n_runs == 0) {
+        return 0;
+    }
+    int32_t rlepos = 0;
+    int32_t arraypos = 0;
+    rle16_t rle = src_2->runs[rlepos];
+    int32_t newcard = 0;
+    while (arraypos < src_1->cardinality) {
+        const uint16_t arrayval = src_1->array[arraypos];
+        while (rle.value + rle.length <
+               arrayval) {  // this will frequently be false
+            ++rlepos;
+            if (rlepos == src_2->n_runs) {
+                return newcard;  // we are done
+            }
+            rle = src_2->runs[rlepos];
+        }
+        if (rle.value > arrayval) {
+            arraypos = advanceUntil(src_1->array, arraypos, src_1->cardinality,
+                                    rle.value);
+        } else {
+            newcard++;
+            arraypos++;
+        }
+    }
+    return newcard;
+}
+
+/* Compute the size of the intersection of src_1 and src_2 . */
+int run_bitset_container_intersection_cardinality(
+    const run_container_t *src_1, const bitset_container_t *src_2) {
+    int answer = 0;
+    for (int32_t rlepos = 0; rlepos < src_1->n_runs; ++rlepos) {
+        rle16_t rle = src_1->runs[rlepos];
+        answer += bitset_lenrange_cardinality(src_2->array, rle.value,
+                                              rle.length);
+    }
+    return answer;
+}
 /* end file src/containers/mixed_intersection.c */
 /* begin file src/containers/mixed_negation.c */
 /*
@@ -6350,6 +6544,76 @@ void run_container_andnot(const run_container_t *src_1,
     }
 }
 
+/* Compute the size of the intersection of src_1 and src_2 . */
+int run_container_intersection_cardinality(const run_container_t *src_1,
+                                           const run_container_t *src_2) {
+    const bool if1 = run_container_is_full(src_1);
+    const bool if2 = run_container_is_full(src_2);
+    if (if1 || if2) {
+        if (if1) {
+            return run_container_cardinality(src_2);
+        }
+        if (if2) {
+            return run_container_cardinality(src_1);
+        }
+    }
+    int answer = 0;
+    int32_t rlepos = 0;
+    int32_t xrlepos = 0;
+    int32_t start = src_1->runs[rlepos].value;
+    int32_t end = start + src_1->runs[rlepos].length + 1;
+    int32_t xstart = src_2->runs[xrlepos].value;
+    int32_t xend = xstart + src_2->runs[xrlepos].length + 1;
+    while ((rlepos < src_1->n_runs) && (xrlepos < src_2->n_runs)) {
+        if (end <= xstart) {
+            ++rlepos;
+            if (rlepos < src_1->n_runs) {
+                start = src_1->runs[rlepos].value;
+                end = start + src_1->runs[rlepos].length + 1;
+            }
+        } else if (xend <= start) {
+            ++xrlepos;
+            if (xrlepos < src_2->n_runs) {
+                xstart = src_2->runs[xrlepos].value;
+                xend = xstart + src_2->runs[xrlepos].length + 1;
+            }
+        } else {  // they overlap
+            const int32_t lateststart = start > xstart ? start : xstart;
+            int32_t earliestend;
+            if (end == xend) {  // improbable
+                earliestend = end;
+                rlepos++;
+                xrlepos++;
+                if (rlepos < src_1->n_runs) {
+                    start = src_1->runs[rlepos].value;
+                    end = start + src_1->runs[rlepos].length + 1;
+                }
+                if (xrlepos < src_2->n_runs) {
+                    xstart = src_2->runs[xrlepos].value;
+                    xend = xstart + src_2->runs[xrlepos].length + 1;
+                }
+            } else if (end < xend) {
+                earliestend = end;
+                rlepos++;
+                if (rlepos < src_1->n_runs) {
+                    start = src_1->runs[rlepos].value;
+                    end = start + src_1->runs[rlepos].length + 1;
+                }
+
+            } else {  // end > xend
+                earliestend = xend;
+                xrlepos++;
+                if (xrlepos < src_2->n_runs) {
+                    xstart = src_2->runs[xrlepos].value;
+                    xend = xstart + src_2->runs[xrlepos].length + 1;
+                }
+            }
+            answer += earliestend - lateststart;
+        }
+    }
+    return answer;
+}
+
 int run_container_to_uint32_array(void *vout, const run_container_t *cont,
                                   uint32_t base) {
     int outpos = 0;
@@ -6631,6 +6895,22 @@ int run_container_rank(const run_container_t *container, uint16_t x) {
   }
   return sum;
 }
+
+int run_container_index_equalorlarger(const run_container_t *arr, uint16_t x) {
+  int32_t index = interleavedBinarySearch(arr->runs, arr->n_runs, x);
+  if (index >= 0) return index;
+  index = -index - 2;  // points to preceding run, possibly -1
+  if (index != -1) {  // possible match
+    int32_t offset = x - arr->runs[index].value;
+    int32_t le = arr->runs[index].length;
+    if (offset <= le) return index;
+  }
+  index += 1;
+  if (index < arr->n_runs) {
+    return index;
+  }
+  return -1;
+}
 /* end file src/containers/run.c */
 /* begin file src/roaring.c */
 #include <assert.h>
@@ -6679,6 +6959,10 @@ static inline void * containerptr_roaring_bitmap_add(roaring_bitmap_t *r, uint32
 }
 
 
+static inline bool is_frozen(const roaring_bitmap_t *r) {
+    return (r->high_low_container.flags & ROARING_FLAG_FROZEN) != 0;
+}
+
 roaring_bitmap_t *roaring_bitmap_create() {
     roaring_bitmap_t *ans =
         (roaring_bitmap_t *)malloc(sizeof(roaring_bitmap_t));
@@ -6743,6 +7027,204 @@ void roaring_bitmap_add_many(roaring_bitmap_t * r, size_t n_args, const uint32_t
     }
 }
 
+uint64_t roaring_bitmap_add_many_checked(roaring_bitmap_t *r, size_t n_args,
+                                         const uint32_t *vals) {
+    roaring_array_t *ra = &r->high_low_container;
+    uint64_t added = 0;
+    size_t i = 0;
+    while (i < n_args) {
+        uint32_t val;
+        memcpy(&val, vals + i, sizeof(val));
+        const uint16_t hb = val >> 16;
+        int index = ra_get_index(ra, hb);
+        void *container;
+        uint8_t typecode;
+        int before = 0;
+        if (index >= 0) {
+            ra_unshare_container_at_index(ra, index);
+            container = ra_get_container_at_index(ra, index, &typecode);
+            before = container_get_cardinality(container, typecode);
+        } else {
+            index = -index - 1;
+            container = array_container_create();
+            typecode = ARRAY_CONTAINER_TYPE_CODE;
+            ra_insert_new_key_value_at(ra, index, hb, container, typecode);
+        }
+        // every value up to the next change of key goes to this container
+        for (; i < n_args; i++) {
+            memcpy(&val, vals + i, sizeof(val));
+            if ((val >> 16) != hb) break;
+            uint8_t newtypecode = typecode;
+            void *container2 =
+                container_add(container, val & 0xFFFF, typecode, &newtypecode);
+            if (container2 != container) {
+                container_free(container, typecode);
+                ra_set_container_at_index(ra, index, container2, newtypecode);
+                typecode = newtypecode;
+                container = container2;
+            }
+        }
+        added += container_get_cardinality(container, typecode) - before;
+    }
+    return added;
+}
+
+// builds the container holding the n strictly increasing values of vals, which
+// all share their upper 16 bits, in whichever of the three forms is smallest
+static void *container_from_sorted(const uint32_t *vals, int32_t n,
+                                   uint8_t *typecode) {
+    uint32_t val, prev;
+    memcpy(&prev, vals, sizeof(prev));
+    int32_t n_runs = 1;
+    for (int32_t k = 1; k < n; k++) {
+        memcpy(&val, vals + k, sizeof(val));
+        if (val != prev + 1) n_runs++;
+        prev = val;
+    }
+    const int32_t run_size = run_container_serialized_size_in_bytes(n_runs);
+    if (n > DEFAULT_MAX_SIZE || run_size < array_container_serialized_size_in_bytes(n)) {
+        if (run_size < bitset_container_serialized_size_in_bytes()) {
+            run_container_t *run = run_container_create_given_capacity(n_runs);
+            memcpy(&prev, vals, sizeof(prev));
+            uint16_t start = (uint16_t)prev;
+            for (int32_t k = 1; k <= n; k++) {
+                if (k < n) memcpy(&val, vals + k, sizeof(val));
+                if (k == n || val != prev + 1) {
+                    run->runs[run->n_runs].value = start;
+                    run->runs[run->n_runs].length = (uint16_t)((uint16_t)prev - start);
+                    run->n_runs++;
+                    start = (uint16_t)val;
+                }
+                prev = val;
+            }
+            *typecode = RUN_CONTAINER_TYPE_CODE;
+            return run;
+        }
+        bitset_container_t *bitset = bitset_container_create();
+        for (int32_t k = 0; k < n; k++) {
+            memcpy(&val, vals + k, sizeof(val));
+            bitset->array[(val & 0xFFFF) >> 6] |= UINT64_C(1) << (val & 63);
+        }
+        bitset->cardinality = n;
+        *typecode = BITSET_CONTAINER_TYPE_CODE;
+        return bitset;
+    }
+    array_container_t *array = array_container_create_given_capacity(n);
+    for (int32_t k = 0; k < n; k++) {
+        memcpy(&val, vals + k, sizeof(val));
+        array->array[k] = (uint16_t)val;
+    }
+    array->cardinality = n;
+    *typecode = ARRAY_CONTAINER_TYPE_CODE;
+    return array;
+}
+
+bool roaring_bitmap_append_many(roaring_bitmap_t *r, size_t n_args,
+                                const uint32_t *vals) {
+    roaring_array_t *ra = &r->high_low_container;
+    if (n_args == 0) return true;
+    uint32_t val, prev;
+    memcpy(&prev, vals, sizeof(prev));
+    if (ra->size > 0 && prev <= roaring_bitmap_maximum(r)) return false;
+    // check the order first, so that nothing is touched if it is wrong
+    int32_t n_keys = 1;
+    for (size_t i = 1; i < n_args; i++) {
+        memcpy(&val, vals + i, sizeof(val));
+        if (val <= prev) return false;
+        if ((val >> 16) != (prev >> 16)) n_keys++;
+        prev = val;
+    }
+    extend_array(ra, n_keys);
+    size_t i = 0;
+    while (i < n_args) {
+        memcpy(&val, vals + i, sizeof(val));
+        const uint16_t hb = val >> 16;
+        size_t end = i + 1;
+        for (; end < n_args; end++) {
+            memcpy(&val, vals + end, sizeof(val));
+            if ((val >> 16) != hb) break;
+        }
+        uint8_t typecode;
+        void *container =
+            container_from_sorted(vals + i, (int32_t)(end - i), &typecode);
+        if (ra->size > 0 && ra->keys[ra->size - 1] == hb) {
+            // only the first values can share the last container of the bitmap
+            uint8_t last_typecode;
+            void *last = ra_get_container_at_index(ra, (uint16_t)(ra->size - 1),
+                                                   &last_typecode);
+            uint8_t result_typecode;
+            void *result = container_or(last, last_typecode, container,
+                                        typecode, &result_typecode);
+            container_free(last, last_typecode);
+            container_free(container, typecode);
+            ra_set_container_at_index(ra, ra->size - 1, result,
+                                      result_typecode);
+        } else {
+            ra_append(ra, hb, container, typecode);
+        }
+        i = end;
+    }
+    return true;
+}
+
+uint64_t roaring_bitmap_add_many_unsorted(roaring_bitmap_t *r, size_t n_args,
+                                          const uint32_t *vals) {
+    roaring_array_t *ra = &r->high_low_container;
+    if (n_args == 0) return 0;
+    uint32_t *sorted = (uint32_t *)malloc(2 * n_args * sizeof(uint32_t));
+    memcpy(sorted, vals, n_args * sizeof(uint32_t));
+    const size_t n = radix_sort_unique_uint32(sorted, sorted + n_args, n_args);
+    uint64_t added = 0;
+    int32_t index = -1;
+    size_t i = 0;
+    while (i < n) {
+        const uint16_t hb = sorted[i] >> 16;
+        size_t end = i + 1;
+        while (end < n && (sorted[end] >> 16) == hb) end++;
+        // the keys come in order, so the search goes on from the last one
+        index = ra_advance_until(ra, hb, index);
+        if (index < ra->size && ra->keys[index] == hb) {
+            ra_unshare_container_at_index(ra, (uint16_t)index);
+            uint8_t typecode;
+            void *container =
+                ra_get_container_at_index(ra, (uint16_t)index, &typecode);
+            const int before = container_get_cardinality(container, typecode);
+            if (typecode == BITSET_CONTAINER_TYPE_CODE) {
+                // the scratch half of the buffer is free once sorted
+                uint16_t *lows = (uint16_t *)(sorted + n_args);
+                for (size_t k = i; k < end; k++) lows[k - i] = (uint16_t)sorted[k];
+                bitset_container_t *bitset = (bitset_container_t *)container;
+                bitset->cardinality = (int32_t)bitset_set_list_withcard(
+                    bitset->array, bitset->cardinality, lows, end - i);
+            } else {
+                // merged with the values in a single union
+                uint8_t group_typecode, result_typecode;
+                void *group = container_from_sorted(sorted + i,
+                                                    (int32_t)(end - i),
+                                                    &group_typecode);
+                void *result = container_or(container, typecode, group,
+                                            group_typecode, &result_typecode);
+                container_free(group, group_typecode);
+                container_free(container, typecode);
+                ra_set_container_at_index(ra, index, result, result_typecode);
+                container = result;
+                typecode = result_typecode;
+            }
+            added += container_get_cardinality(container, typecode) - before;
+        } else {
+            uint8_t typecode;
+            void *container = container_from_sorted(sorted + i,
+                                                    (int32_t)(end - i),
+                                                    &typecode);
+            ra_insert_new_key_value_at(ra, index, hb, container, typecode);
+            added += end - i;
+        }
+        i = end;
+    }
+    free(sorted);
+    return added;
+}
+
 roaring_bitmap_t *roaring_bitmap_of_ptr(size_t n_args, const uint32_t *vals) {
     roaring_bitmap_t *answer = roaring_bitmap_create();
     roaring_bitmap_add_many(answer, n_args, vals);
@@ -6890,7 +7372,9 @@ roaring_bitmap_t *roaring_bitmap_copy(const roaring_bitmap_t *r) {
     if (!ans) {
         return NULL;
     }
-    bool is_ok = ra_copy(& r->high_low_container,& ans->high_low_container, r->copy_on_write);
+    // the containers of a frozen bitmap cannot become shared, they are copied
+    bool is_ok = ra_copy(& r->high_low_container,& ans->high_low_container,
+                         r->copy_on_write && !is_frozen(r));
     if (!is_ok) {
         free(ans);
         return NULL;
@@ -6901,11 +7385,13 @@ roaring_bitmap_t *roaring_bitmap_copy(const roaring_bitmap_t *r) {
 
 static bool roaring_bitmap_overwrite(roaring_bitmap_t *dest,
                                      const roaring_bitmap_t *src) {
-    return ra_overwrite(& src->high_low_container, & dest->high_low_container, src->copy_on_write);
+    return ra_overwrite(& src->high_low_container, & dest->high_low_container,
+                        src->copy_on_write && !is_frozen(src));
 }
 
 void roaring_bitmap_free(roaring_bitmap_t *r) {
-    ra_clear(& r->high_low_container);
+    // a frozen view is a single allocation, its containers included
+    if (!is_frozen(r)) ra_clear(& r->high_low_container);
     free(r);
 }
 
@@ -6935,6 +7421,35 @@ void roaring_bitmap_add(roaring_bitmap_t *r, uint32_t val) {
     }
 }
 
+bool roaring_bitmap_add_checked(roaring_bitmap_t *r, uint32_t val) {
+    const uint16_t hb = val >> 16;
+    const int i = ra_get_index(& r->high_low_container, hb);
+    uint8_t typecode;
+    if (i < 0) {
+        array_container_t *newac = array_container_create();
+        void *container = container_add(newac, val & 0xFFFF,
+                                        ARRAY_CONTAINER_TYPE_CODE, &typecode);
+        ra_insert_new_key_value_at(& r->high_low_container, -i - 1, hb, container,
+                                   typecode);
+        return true;
+    }
+    ra_unshare_container_at_index(& r->high_low_container, i);
+    void *container =
+        ra_get_container_at_index(& r->high_low_container, i, &typecode);
+    const int before = container_get_cardinality(container, typecode);
+    uint8_t newtypecode = typecode;
+    void *container2 =
+        container_add(container, val & 0xFFFF, typecode, &newtypecode);
+    if (container2 != container) {
+        // only a container that grows changes its type
+        container_free(container, typecode);
+        ra_set_container_at_index(& r->high_low_container, i, container2,
+                                  newtypecode);
+        return true;
+    }
+    return container_get_cardinality(container2, newtypecode) != before;
+}
+
 void roaring_bitmap_remove(roaring_bitmap_t *r, uint32_t val) {
     const uint16_t hb = val >> 16;
     const int i = ra_get_index(& r->high_low_container, hb);
@@ -6960,35 +7475,355 @@ void roaring_bitmap_remove(roaring_bitmap_t *r, uint32_t val) {
     }
 }
 
-extern bool roaring_bitmap_contains(const roaring_bitmap_t *r, uint32_t val);
-
-// there should be some SIMD optimizations possible here
-roaring_bitmap_t *roaring_bitmap_and(const roaring_bitmap_t *x1,
-                                     const roaring_bitmap_t *x2) {
-    uint8_t container_result_type = 0;
-    const int length1 = x1->high_low_container.size,
-              length2 = x2->high_low_container.size;
-    uint32_t neededcap = length1 > length2 ? length2 : length1;
-    roaring_bitmap_t *answer = roaring_bitmap_create_with_capacity(neededcap);
-    answer->copy_on_write = x1->copy_on_write && x2->copy_on_write;
+bool roaring_bitmap_remove_checked(roaring_bitmap_t *r, uint32_t val) {
+    const uint16_t hb = val >> 16;
+    const int i = ra_get_index(& r->high_low_container, hb);
+    uint8_t typecode;
+    if (i < 0) return false;
+    ra_unshare_container_at_index(& r->high_low_container, i);
+    void *container =
+        ra_get_container_at_index(& r->high_low_container, i, &typecode);
+    const int before = container_get_cardinality(container, typecode);
+    uint8_t newtypecode = typecode;
+    void *container2 =
+        container_remove(container, val & 0xFFFF, typecode, &newtypecode);
+    if (container2 != container) {
+        container_free(container, typecode);
+    }
+    ra_set_container_at_index(& r->high_low_container, i, container2,
+                              newtypecode);
+    const int after = container_get_cardinality(container2, newtypecode);
+    if (after == 0) {
+        ra_remove_at_index_and_free(& r->high_low_container, i);
+    }
+    return after != before;
+}
 
-    int pos1 = 0, pos2 = 0;
+static int compare_uint16(const void *a, const void *b) {
+    return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
 
-    while (pos1 < length1 && pos2 < length2) {
-        const uint16_t s1 = ra_get_key_at_index(& x1->high_low_container, pos1);
-        const uint16_t s2 = ra_get_key_at_index(& x2->high_low_container, pos2);
+void roaring_bitmap_remove_many(roaring_bitmap_t *r, size_t n_args,
+                                const uint32_t *vals) {
+    roaring_bitmap_remove_many_checked(r, n_args, vals);
+}
 
-        if (s1 == s2) {
-            uint8_t container_type_1, container_type_2;
-            void *c1 = ra_get_container_at_index(& x1->high_low_container, pos1,
-                                                 &container_type_1);
-            void *c2 = ra_get_container_at_index(& x2->high_low_container, pos2,
-                                                 &container_type_2);
-            void *c = container_and(c1, container_type_1, c2, container_type_2,
-                                    &container_result_type);
-            if (container_nonzero_cardinality(c, container_result_type)) {
-                ra_append(& answer->high_low_container, s1, c,
-                          container_result_type);
+uint64_t roaring_bitmap_remove_many_checked(roaring_bitmap_t *r, size_t n_args,
+                                            const uint32_t *vals) {
+    roaring_array_t *ra = &r->high_low_container;
+    uint64_t removed = 0;
+    uint16_t *lows = NULL;  // sorted values to remove from an array container
+    size_t lows_capacity = 0;
+    size_t i = 0;
+    while (i < n_args) {
+        uint32_t val;
+        memcpy(&val, vals + i, sizeof(val));
+        const uint16_t hb = val >> 16;
+        // every value up to the next change of key goes to the same container
+        size_t end = i + 1;
+        while (end < n_args) {
+            memcpy(&val, vals + end, sizeof(val));
+            if ((val >> 16) != hb) break;
+            end++;
+        }
+        const int index = ra_get_index(ra, hb);
+        if (index < 0) {
+            i = end;
+            continue;
+        }
+        ra_unshare_container_at_index(ra, index);
+        uint8_t typecode;
+        void *container = ra_get_container_at_index(ra, index, &typecode);
+        const int before = container_get_cardinality(container, typecode);
+        if (typecode == BITSET_CONTAINER_TYPE_CODE) {
+            bitset_container_t *bc = (bitset_container_t *)container;
+            for (; i < end; i++) {
+                memcpy(&val, vals + i, sizeof(val));
+                bitset_container_remove(bc, val & 0xFFFF);
+            }
+            // converted once, whatever the number of values removed
+            if (bc->cardinality <= DEFAULT_MAX_SIZE) {
+                container = array_container_from_bitset(bc);
+                typecode = ARRAY_CONTAINER_TYPE_CODE;
+                bitset_container_free(bc);
+                ra_set_container_at_index(ra, index, container, typecode);
+            }
+        } else if (typecode == ARRAY_CONTAINER_TYPE_CODE) {
+            const size_t n = end - i;
+            if (n > lows_capacity) {
+                free(lows);
+                lows_capacity = n;
+                lows = (uint16_t *)malloc(lows_capacity * sizeof(uint16_t));
+            }
+            bool sorted = true;
+            for (size_t k = 0; k < n; k++, i++) {
+                memcpy(&val, vals + i, sizeof(val));
+                lows[k] = val & 0xFFFF;
+                sorted = sorted && (k == 0 || lows[k - 1] <= lows[k]);
+            }
+            if (!sorted) qsort(lows, n, sizeof(uint16_t), compare_uint16);
+            // a single merge keeps the values that are not removed
+            array_container_t *ac = (array_container_t *)container;
+            int32_t kept = 0;
+            size_t k = 0;
+            for (int32_t j = 0; j < ac->cardinality; j++) {
+                const uint16_t v = ac->array[j];
+                while (k < n && lows[k] < v) k++;
+                if (k < n && lows[k] == v) continue;
+                ac->array[kept++] = v;
+            }
+            ac->cardinality = kept;
+        } else {
+            // like container_remove, runs keep their type
+            for (; i < end; i++) {
+                memcpy(&val, vals + i, sizeof(val));
+                run_container_remove((run_container_t *)container, val & 0xFFFF);
+            }
+        }
+        const int after = container_get_cardinality(container, typecode);
+        removed += (uint64_t)(before - after);
+        if (after == 0) {
+            ra_remove_at_index_and_free(ra, index);
+        }
+    }
+    free(lows);
+    return removed;
+}
+
+// values of a range are at most 2^32, so keys of a range fit in 17 bits
+#define ROARING_RANGE_MAX UINT64_C(0x100000000)
+
+/* index of the first container whose key is at least x */
+static int32_t ra_lower_bound(const roaring_array_t *ra, uint32_t x) {
+    const int32_t i = binarySearch(ra->keys, ra->size, (uint16_t)x);
+    return i >= 0 ? i : -i - 1;
+}
+
+/* index of the first container whose key is greater than x */
+static int32_t ra_upper_bound(const roaring_array_t *ra, uint32_t x) {
+    const int32_t i = binarySearch(ra->keys, ra->size, (uint16_t)x);
+    return i >= 0 ? i + 1 : -i - 1;
+}
+
+void roaring_bitmap_add_range(roaring_bitmap_t *r, uint64_t min, uint64_t max) {
+    if (max > ROARING_RANGE_MAX) max = ROARING_RANGE_MAX;
+    if (min >= max) return;
+    roaring_array_t *ra = &r->high_low_container;
+    const uint32_t min_key = (uint32_t)(min >> 16);
+    const uint32_t max_key = (uint32_t)((max - 1) >> 16);
+    const int32_t start = ra_lower_bound(ra, min_key);
+    const int32_t end = ra_upper_bound(ra, max_key);
+
+    // every key of the range gets a container: make room for the missing
+    // ones with a single move of the containers after the range
+    const int32_t missing = (int32_t)(max_key - min_key + 1) - (end - start);
+    if (missing > 0) {
+        if (!extend_array(ra, missing)) return;
+        const int32_t tail = ra->size - end;
+        memmove(ra->keys + end + missing, ra->keys + end,
+                tail * sizeof(uint16_t));
+        memmove(ra->containers + end + missing, ra->containers + end,
+                tail * sizeof(void *));
+        memmove(ra->typecodes + end + missing, ra->typecodes + end,
+                tail * sizeof(uint8_t));
+        ra->size += missing;
+    }
+
+    // filled from the back, so that no container is overwritten before it
+    // has been read
+    int32_t src = end - 1;
+    int32_t dst = end + missing - 1;
+    for (int64_t key = max_key; key >= (int64_t)min_key; key--, dst--) {
+        const uint32_t lo = key == min_key ? (uint32_t)(min & 0xFFFF) : 0;
+        const uint32_t hi = key == max_key ? (uint32_t)((max - 1) & 0xFFFF) : 0xFFFF;
+        void *c;
+        uint8_t type = RUN_CONTAINER_TYPE_CODE;
+        if (src >= start && ra->keys[src] == key) {
+            if (lo == 0 && hi == 0xFFFF) {
+                c = run_container_create_range(0, 1 << 16);
+            } else {
+                run_container_t *range = run_container_create_range(lo, hi + 1);
+                c = container_or(ra->containers[src], ra->typecodes[src], range,
+                                 RUN_CONTAINER_TYPE_CODE, &type);
+                run_container_free(range);
+            }
+            container_free(ra->containers[src], ra->typecodes[src]);
+            src--;
+        } else {
+            c = run_container_create_range(lo, hi + 1);
+        }
+        ra->keys[dst] = (uint16_t)key;
+        ra->containers[dst] = c;
+        ra->typecodes[dst] = type;
+    }
+}
+
+void roaring_bitmap_remove_range(roaring_bitmap_t *r, uint64_t min, uint64_t max) {
+    if (max > ROARING_RANGE_MAX) max = ROARING_RANGE_MAX;
+    if (min >= max) return;
+    roaring_array_t *ra = &r->high_low_container;
+    const uint32_t min_key = (uint32_t)(min >> 16);
+    const uint32_t max_key = (uint32_t)((max - 1) >> 16);
+    const int32_t start = ra_lower_bound(ra, min_key);
+    const int32_t end = ra_upper_bound(ra, max_key);
+
+    int32_t dst = start;
+    for (int32_t src = start; src < end; src++) {
+        const uint16_t key = ra->keys[src];
+        const uint32_t lo = key == min_key ? (uint32_t)(min & 0xFFFF) : 0;
+        const uint32_t hi = key == max_key ? (uint32_t)((max - 1) & 0xFFFF) : 0xFFFF;
+        void *c = ra->containers[src];
+        const uint8_t type = ra->typecodes[src];
+        if (lo == 0 && hi == 0xFFFF) {
+            container_free(c, type);
+            continue;
+        }
+        run_container_t *range = run_container_create_range(lo, hi + 1);
+        uint8_t result_type;
+        void *result = container_andnot(c, type, range, RUN_CONTAINER_TYPE_CODE,
+                                        &result_type);
+        run_container_free(range);
+        container_free(c, type);
+        if (container_nonzero_cardinality(result, result_type)) {
+            ra->keys[dst] = key;
+            ra->containers[dst] = result;
+            ra->typecodes[dst] = result_type;
+            dst++;
+        } else {
+            container_free(result, result_type);
+        }
+    }
+
+    if (dst != end) {
+        const int32_t tail = ra->size - end;
+        memmove(ra->keys + dst, ra->keys + end, tail * sizeof(uint16_t));
+        memmove(ra->containers + dst, ra->containers + end,
+                tail * sizeof(void *));
+        memmove(ra->typecodes + dst, ra->typecodes + end,
+                tail * sizeof(uint8_t));
+        ra->size -= end - dst;
+    }
+}
+
+uint64_t roaring_bitmap_range_cardinality(const roaring_bitmap_t *r,
+                                          uint64_t range_start,
+                                          uint64_t range_end) {
+    if (range_end > ROARING_RANGE_MAX) range_end = ROARING_RANGE_MAX;
+    if (range_start >= range_end) return 0;
+    const roaring_array_t *ra = &r->high_low_container;
+    const uint32_t min_key = (uint32_t)(range_start >> 16);
+    const uint32_t max_key = (uint32_t)((range_end - 1) >> 16);
+    const int32_t end = ra_upper_bound(ra, max_key);
+
+    uint64_t card = 0;
+    for (int32_t i = ra_lower_bound(ra, min_key); i < end; i++) {
+        const uint16_t key = ra->keys[i];
+        const uint32_t lo = key == min_key ? (uint32_t)(range_start & 0xFFFF) : 0;
+        const uint32_t hi = key == max_key ? (uint32_t)((range_end - 1) & 0xFFFF) : 0xFFFF;
+        const void *c = ra->containers[i];
+        const uint8_t type = ra->typecodes[i];
+        if (lo == 0 && hi == 0xFFFF) {
+            card += container_get_cardinality(c, type);
+        } else {
+            card += container_rank(c, type, (uint16_t)hi);
+            if (lo > 0) card -= container_rank(c, type, (uint16_t)(lo - 1));
+        }
+    }
+    return card;
+}
+
+bool roaring_bitmap_contains_range(const roaring_bitmap_t *r,
+                                   uint64_t range_start, uint64_t range_end) {
+    if (range_end > ROARING_RANGE_MAX) range_end = ROARING_RANGE_MAX;
+    if (range_start >= range_end) return true;
+    const roaring_array_t *ra = &r->high_low_container;
+    const uint32_t min_key = (uint32_t)(range_start >> 16);
+    const uint32_t max_key = (uint32_t)((range_end - 1) >> 16);
+    // a missing container is a gap, no need to count anything
+    if (ra_upper_bound(ra, max_key) - ra_lower_bound(ra, min_key) !=
+        (int32_t)(max_key - min_key + 1)) {
+        return false;
+    }
+    return roaring_bitmap_range_cardinality(r, range_start, range_end) ==
+           range_end - range_start;
+}
+
+extern bool roaring_bitmap_contains(const roaring_bitmap_t *r, uint32_t val);
+
+void roaring_bitmap_contains_many(const roaring_bitmap_t *r, size_t n_args,
+                                  const uint32_t *vals, bool *answer) {
+    const roaring_array_t *ra = &r->high_low_container;
+    int32_t i = 0;
+    size_t j = 0;
+    while (j < n_args) {
+        const uint16_t hb = vals[j] >> 16;
+        size_t end = j + 1;
+        while (end < n_args && (vals[end] >> 16) == hb) end++;
+        // keys only grow, so the container search gallops on from the last one
+        i = ra_advance_until(ra, hb, i - 1);
+        if (i == ra->size || ra->keys[i] != hb) {
+            for (; j < end; j++) answer[j] = false;
+            continue;
+        }
+        uint8_t typecode = ra->typecodes[i];
+        const void *container =
+            container_unwrap_shared(ra->containers[i], &typecode);
+        if (typecode == BITSET_CONTAINER_TYPE_CODE) {
+            const bitset_container_t *bc = (const bitset_container_t *)container;
+            for (; j < end; j++) {
+                answer[j] = bitset_container_get(bc, vals[j] & 0xFFFF);
+            }
+        } else if (typecode == ARRAY_CONTAINER_TYPE_CODE) {
+            const array_container_t *ac = (const array_container_t *)container;
+            int32_t pos = 0;
+            for (; j < end; j++) {
+                const uint16_t low = vals[j] & 0xFFFF;
+                // starts again at pos, in case the value is repeated
+                pos = advanceUntil(ac->array, pos - 1, ac->cardinality, low);
+                answer[j] = pos < ac->cardinality && ac->array[pos] == low;
+            }
+        } else {
+            const run_container_t *rc = (const run_container_t *)container;
+            int32_t run = 0;
+            for (; j < end; j++) {
+                const uint32_t low = vals[j] & 0xFFFF;
+                while (run < rc->n_runs &&
+                       (uint32_t)rc->runs[run].value + rc->runs[run].length < low) {
+                    run++;
+                }
+                answer[j] = run < rc->n_runs && rc->runs[run].value <= low;
+            }
+        }
+    }
+}
+
+// there should be some SIMD optimizations possible here
+roaring_bitmap_t *roaring_bitmap_and(const roaring_bitmap_t *x1,
+                                     const roaring_bitmap_t *x2) {
+    uint8_t container_result_type = 0;
+    const int length1 = x1->high_low_container.size,
+              length2 = x2->high_low_container.size;
+    uint32_t neededcap = length1 > length2 ? length2 : length1;
+    roaring_bitmap_t *answer = roaring_bitmap_create_with_capacity(neededcap);
+    answer->copy_on_write = x1->copy_on_write && x2->copy_on_write;
+
+    int pos1 = 0, pos2 = 0;
+
+    while (pos1 < length1 && pos2 < length2) {
+        const uint16_t s1 = ra_get_key_at_index(& x1->high_low_container, pos1);
+        const uint16_t s2 = ra_get_key_at_index(& x2->high_low_container, pos2);
+
+        if (s1 == s2) {
+            uint8_t container_type_1, container_type_2;
+            void *c1 = ra_get_container_at_index(& x1->high_low_container, pos1,
+                                                 &container_type_1);
+            void *c2 = ra_get_container_at_index(& x2->high_low_container, pos2,
+                                                 &container_type_2);
+            void *c = container_and(c1, container_type_1, c2, container_type_2,
+                                    &container_result_type);
+            if (container_nonzero_cardinality(c, container_result_type)) {
+                ra_append(& answer->high_low_container, s1, c,
+                          container_result_type);
             } else {
                 container_free(
                     c, container_result_type);  // otherwise:memory leak!
@@ -7004,6 +7839,234 @@ roaring_bitmap_t *roaring_bitmap_and(const roaring_bitmap_t *x1,
     return answer;
 }
 
+uint64_t roaring_bitmap_and_cardinality(const roaring_bitmap_t *x1,
+                                        const roaring_bitmap_t *x2) {
+    const int length1 = x1->high_low_container.size,
+              length2 = x2->high_low_container.size;
+    uint64_t answer = 0;
+    int pos1 = 0, pos2 = 0;
+
+    while (pos1 < length1 && pos2 < length2) {
+        const uint16_t s1 = ra_get_key_at_index(& x1->high_low_container, pos1);
+        const uint16_t s2 = ra_get_key_at_index(& x2->high_low_container, pos2);
+
+        if (s1 == s2) {
+            uint8_t container_type_1, container_type_2;
+            void *c1 = ra_get_container_at_index(& x1->high_low_container, pos1,
+                                                 &container_type_1);
+            void *c2 = ra_get_container_at_index(& x2->high_low_container, pos2,
+                                                 &container_type_2);
+            answer += container_and_cardinality(c1, container_type_1, c2,
+                                                container_type_2);
+            ++pos1;
+            ++pos2;
+        } else if (s1 < s2) {  // s1 < s2
+            pos1 = ra_advance_until(& x1->high_low_container, s2, pos1);
+        } else {  // s1 > s2
+            pos2 = ra_advance_until(& x2->high_low_container, s1, pos2);
+        }
+    }
+    return answer;
+}
+
+uint64_t roaring_bitmap_or_cardinality(const roaring_bitmap_t *x1,
+                                       const roaring_bitmap_t *x2) {
+    const uint64_t c1 = roaring_bitmap_get_cardinality(x1);
+    const uint64_t c2 = roaring_bitmap_get_cardinality(x2);
+    const uint64_t inter = roaring_bitmap_and_cardinality(x1, x2);
+    return c1 + c2 - inter;
+}
+
+uint64_t roaring_bitmap_andnot_cardinality(const roaring_bitmap_t *x1,
+                                           const roaring_bitmap_t *x2) {
+    const uint64_t c1 = roaring_bitmap_get_cardinality(x1);
+    const uint64_t inter = roaring_bitmap_and_cardinality(x1, x2);
+    return c1 - inter;
+}
+
+uint64_t roaring_bitmap_xor_cardinality(const roaring_bitmap_t *x1,
+                                        const roaring_bitmap_t *x2) {
+    const uint64_t c1 = roaring_bitmap_get_cardinality(x1);
+    const uint64_t c2 = roaring_bitmap_get_cardinality(x2);
+    const uint64_t inter = roaring_bitmap_and_cardinality(x1, x2);
+    return c1 + c2 - 2 * inter;
+}
+
+// sets the bits of the container in the scratch bitset, the cardinality of
+// the scratch bitset is not maintained
+static void scratch_bitset_add_container(bitset_container_t *scratch,
+                                         const void *c, uint8_t type) {
+    c = container_unwrap_shared(c, &type);
+    switch (type) {
+        case BITSET_CONTAINER_TYPE_CODE:
+            bitset_container_or_nocard(scratch, (const bitset_container_t *)c,
+                                       scratch);
+            break;
+        case ARRAY_CONTAINER_TYPE_CODE: {
+            const array_container_t *ac = (const array_container_t *)c;
+            bitset_set_list(scratch->array, ac->array, ac->cardinality);
+            break;
+        }
+        case RUN_CONTAINER_TYPE_CODE: {
+            const run_container_t *rc = (const run_container_t *)c;
+            for (int32_t i = 0; i < rc->n_runs; ++i) {
+                bitset_set_lenrange(scratch->array, rc->runs[i].value,
+                                    rc->runs[i].length);
+            }
+            break;
+        }
+        default:
+            assert(false);
+            __builtin_unreachable();
+    }
+}
+
+// clears the bits of the container from the scratch bitset, the cardinality
+// of the scratch bitset is not maintained
+static void scratch_bitset_remove_container(bitset_container_t *scratch,
+                                            const void *c, uint8_t type) {
+    c = container_unwrap_shared(c, &type);
+    switch (type) {
+        case BITSET_CONTAINER_TYPE_CODE:
+            bitset_container_andnot_nocard(
+                scratch, (const bitset_container_t *)c, scratch);
+            break;
+        case ARRAY_CONTAINER_TYPE_CODE: {
+            const array_container_t *ac = (const array_container_t *)c;
+            bitset_clear_list(scratch->array, 0, ac->array, ac->cardinality);
+            break;
+        }
+        case RUN_CONTAINER_TYPE_CODE: {
+            const run_container_t *rc = (const run_container_t *)c;
+            for (int32_t i = 0; i < rc->n_runs; ++i) {
+                bitset_reset_range(
+                    scratch->array, rc->runs[i].value,
+                    (uint32_t)rc->runs[i].value + rc->runs[i].length + 1);
+            }
+            break;
+        }
+        default:
+            assert(false);
+            __builtin_unreachable();
+    }
+}
+
+uint64_t roaring_bitmap_or_many_andnot_cardinality(
+    size_t number_include, const roaring_bitmap_t **include,
+    size_t number_exclude, const roaring_bitmap_t **exclude) {
+    if (number_include == 0) {
+        return 0;
+    }
+    if (number_include == 1 && number_exclude == 0) {
+        return roaring_bitmap_get_cardinality(include[0]);
+    }
+    if (number_include == 1 && number_exclude == 1) {
+        return roaring_bitmap_andnot_cardinality(include[0], exclude[0]);
+    }
+    int32_t *positions = (int32_t *)calloc(number_include + number_exclude,
+                                           sizeof(int32_t));
+    int32_t *exclude_positions = positions + number_include;
+    bitset_container_t *scratch = NULL;  // only created if needed
+    uint64_t answer = 0;
+
+    while (true) {
+        // the next key is the smallest one not yet consumed by the inclusions
+        bool found = false;
+        uint16_t key = 0;
+        for (size_t i = 0; i < number_include; ++i) {
+            const roaring_array_t *ra = &include[i]->high_low_container;
+            if (positions[i] < ra->size &&
+                (!found || ra->keys[positions[i]] < key)) {
+                key = ra->keys[positions[i]];
+                found = true;
+            }
+        }
+        if (!found) break;
+
+        // remember the first two containers of each side, this covers
+        // the common cases without touching the scratch bitset
+        const void *inc[2] = {NULL, NULL}, *exc = NULL;
+        uint8_t inc_type[2] = {0, 0}, exc_type = 0;
+        size_t inc_count = 0, exc_count = 0;
+        for (size_t i = 0; i < number_include; ++i) {
+            const roaring_array_t *ra = &include[i]->high_low_container;
+            if (positions[i] < ra->size && ra->keys[positions[i]] == key) {
+                if (inc_count < 2) {
+                    inc[inc_count] = ra->containers[positions[i]];
+                    inc_type[inc_count] = ra->typecodes[positions[i]];
+                }
+                inc_count++;
+            }
+        }
+        for (size_t i = 0; i < number_exclude; ++i) {
+            const roaring_array_t *ra = &exclude[i]->high_low_container;
+            if (exclude_positions[i] < ra->size &&
+                ra->keys[exclude_positions[i]] < key) {
+                exclude_positions[i] =
+                    ra_advance_until(ra, key, exclude_positions[i]);
+            }
+            if (exclude_positions[i] < ra->size &&
+                ra->keys[exclude_positions[i]] == key) {
+                if (exc_count == 0) {
+                    exc = ra->containers[exclude_positions[i]];
+                    exc_type = ra->typecodes[exclude_positions[i]];
+                }
+                exc_count++;
+            }
+        }
+
+        if (inc_count == 1 && exc_count == 0) {
+            answer += container_get_cardinality(inc[0], inc_type[0]);
+        } else if (inc_count == 1 && exc_count == 1) {
+            answer += container_get_cardinality(inc[0], inc_type[0]) -
+                      container_and_cardinality(inc[0], inc_type[0], exc,
+                                                exc_type);
+        } else if (inc_count == 2 && exc_count == 0) {
+            answer += container_get_cardinality(inc[0], inc_type[0]) +
+                      container_get_cardinality(inc[1], inc_type[1]) -
+                      container_and_cardinality(inc[0], inc_type[0], inc[1],
+                                                inc_type[1]);
+        } else {
+            if (scratch == NULL) {
+                scratch = bitset_container_create();
+            } else {
+                bitset_container_clear(scratch);
+            }
+            for (size_t i = 0; i < number_include; ++i) {
+                const roaring_array_t *ra = &include[i]->high_low_container;
+                if (positions[i] < ra->size && ra->keys[positions[i]] == key) {
+                    scratch_bitset_add_container(scratch,
+                                                 ra->containers[positions[i]],
+                                                 ra->typecodes[positions[i]]);
+                }
+            }
+            for (size_t i = 0; i < number_exclude; ++i) {
+                const roaring_array_t *ra = &exclude[i]->high_low_container;
+                if (exclude_positions[i] < ra->size &&
+                    ra->keys[exclude_positions[i]] == key) {
+                    scratch_bitset_remove_container(
+                        scratch, ra->containers[exclude_positions[i]],
+                        ra->typecodes[exclude_positions[i]]);
+                }
+            }
+            answer += bitset_container_compute_cardinality(scratch);
+        }
+
+        for (size_t i = 0; i < number_include; ++i) {
+            const roaring_array_t *ra = &include[i]->high_low_container;
+            if (positions[i] < ra->size && ra->keys[positions[i]] == key) {
+                positions[i]++;
+            }
+        }
+    }
+
+    if (scratch != NULL) {
+        bitset_container_free(scratch);
+    }
+    free(positions);
+    return answer;
+}
+
 /**
  * Compute the union of 'number' bitmaps.
  */
@@ -7687,11 +8750,348 @@ roaring_bitmap_t *roaring_bitmap_portable_deserialize(const char *buf) {
     return ans;
 }
 
+roaring_bitmap_t *roaring_bitmap_portable_deserialize_stream(
+    roaring_read_callback read, void *param) {
+    roaring_bitmap_t *ans =
+        (roaring_bitmap_t *)malloc(sizeof(roaring_bitmap_t));
+    if (ans == NULL) {
+        return NULL;
+    }
+    bool is_ok = ra_portable_deserialize_stream(& ans->high_low_container,
+                                                read, param);
+    ans->copy_on_write = false;
+    if(! is_ok) {
+      roaring_bitmap_free(ans);
+      return NULL;
+    }
+    return ans;
+}
+
+size_t roaring_bitmap_portable_deserialize_size(const char *buf, size_t maxbytes) {
+    return ra_portable_deserialize_size(buf, maxbytes);
+}
+
+bool roaring_bitmap_portable_contains(const char *buf, uint32_t x) {
+    return ra_portable_contains(buf, x);
+}
+
+uint64_t roaring_bitmap_portable_cardinality(const char *buf) {
+    return ra_portable_cardinality(buf);
+}
+
+/* returns the current position of the arena and moves it num_bytes further */
+static char *arena_alloc(char **arena, size_t num_bytes) {
+    char *res = *arena;
+    *arena += num_bytes;
+    return res;
+}
+
+size_t roaring_bitmap_frozen_size_in_bytes(const roaring_bitmap_t *rb) {
+    const roaring_array_t *ra = &rb->high_low_container;
+    size_t num_bytes = 0;
+    for (int32_t i = 0; i < ra->size; i++) {
+        uint8_t typecode = ra->typecodes[i];
+        const void *c = container_unwrap_shared(ra->containers[i], &typecode);
+        switch (typecode) {
+            case BITSET_CONTAINER_TYPE_CODE:
+                num_bytes += BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+                break;
+            case RUN_CONTAINER_TYPE_CODE:
+                num_bytes += ((const run_container_t *)c)->n_runs * sizeof(rle16_t);
+                break;
+            case ARRAY_CONTAINER_TYPE_CODE:
+                num_bytes += ((const array_container_t *)c)->cardinality *
+                             sizeof(uint16_t);
+                break;
+            default:
+                __builtin_unreachable();
+        }
+    }
+    num_bytes += (2 + 2 + 1) * ra->size;  // keys, counts, typecodes
+    num_bytes += 4;                       // header
+    return num_bytes;
+}
+
+/*
+ * The frozen format lays out the bitset words, then the runs, then the array
+ * values, then the keys, the counts and the typecodes of the containers, and
+ * ends with a header. Every zone is a multiple of the alignment of the next,
+ * so with a 32-byte aligned buffer the containers can point straight into it.
+ */
+void roaring_bitmap_frozen_serialize(const roaring_bitmap_t *rb, char *buf) {
+    /*
+     * The caller does not have to supply an aligned buffer, so everything is
+     * written with memcpy.
+     */
+    const roaring_array_t *ra = &rb->high_low_container;
+
+    size_t bitset_zone_size = 0;
+    size_t run_zone_size = 0;
+    size_t array_zone_size = 0;
+    for (int32_t i = 0; i < ra->size; i++) {
+        uint8_t typecode = ra->typecodes[i];
+        const void *c = container_unwrap_shared(ra->containers[i], &typecode);
+        switch (typecode) {
+            case BITSET_CONTAINER_TYPE_CODE:
+                bitset_zone_size +=
+                    BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+                break;
+            case RUN_CONTAINER_TYPE_CODE:
+                run_zone_size += ((const run_container_t *)c)->n_runs * sizeof(rle16_t);
+                break;
+            case ARRAY_CONTAINER_TYPE_CODE:
+                array_zone_size += ((const array_container_t *)c)->cardinality *
+                                   sizeof(uint16_t);
+                break;
+            default:
+                __builtin_unreachable();
+        }
+    }
+
+    char *bitset_zone = arena_alloc(&buf, bitset_zone_size);
+    char *run_zone = arena_alloc(&buf, run_zone_size);
+    char *array_zone = arena_alloc(&buf, array_zone_size);
+    char *key_zone = arena_alloc(&buf, 2 * ra->size);
+    char *count_zone = arena_alloc(&buf, 2 * ra->size);
+    char *typecode_zone = arena_alloc(&buf, ra->size);
+    char *header_zone = arena_alloc(&buf, 4);
+
+    for (int32_t i = 0; i < ra->size; i++) {
+        uint8_t typecode = ra->typecodes[i];
+        const void *c = container_unwrap_shared(ra->containers[i], &typecode);
+        uint16_t count;
+        switch (typecode) {
+            case BITSET_CONTAINER_TYPE_CODE: {
+                const bitset_container_t *bitset = (const bitset_container_t *)c;
+                const size_t size =
+                    BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+                memcpy(bitset_zone, bitset->array, size);
+                bitset_zone += size;
+                count = bitset->cardinality - 1;
+                break;
+            }
+            case RUN_CONTAINER_TYPE_CODE: {
+                const run_container_t *run = (const run_container_t *)c;
+                const size_t size = run->n_runs * sizeof(rle16_t);
+                memcpy(run_zone, run->runs, size);
+                run_zone += size;
+                count = run->n_runs;
+                break;
+            }
+            case ARRAY_CONTAINER_TYPE_CODE: {
+                const array_container_t *array = (const array_container_t *)c;
+                const size_t size = array->cardinality * sizeof(uint16_t);
+                memcpy(array_zone, array->array, size);
+                array_zone += size;
+                count = array->cardinality - 1;
+                break;
+            }
+            default:
+                __builtin_unreachable();
+        }
+        memcpy(count_zone + 2 * i, &count, 2);
+        memcpy(typecode_zone + i, &typecode, 1);
+    }
+    memcpy(key_zone, ra->keys, 2 * ra->size);
+
+    const uint32_t header = ((uint32_t)ra->size << 15) | FROZEN_COOKIE;
+    memcpy(header_zone, &header, 4);
+}
+
+const roaring_bitmap_t *roaring_bitmap_frozen_view(const char *buf,
+                                                   size_t length) {
+    if ((uintptr_t)buf % 32 != 0) {
+        return NULL;
+    }
+
+    // cookie and number of containers
+    if (length < 4) {
+        return NULL;
+    }
+    uint32_t header;
+    memcpy(&header, buf + length - 4, 4);
+    if ((header & 0x7FFF) != FROZEN_COOKIE) {
+        return NULL;
+    }
+    const int32_t num_containers = (int32_t)(header >> 15);
+    if (num_containers > MAX_CONTAINERS) {
+        return NULL;
+    }
+
+    // typecodes, counts and keys, the keys following zones of even size
+    if (length < 4 + (size_t)num_containers * (1 + 2 + 2) ||
+        (length - 4 - num_containers * 5) % 2 != 0) {
+        return NULL;
+    }
+    const uint16_t *keys =
+        (const uint16_t *)(buf + length - 4 - num_containers * 5);
+    const uint16_t *counts =
+        (const uint16_t *)(buf + length - 4 - num_containers * 3);
+    const uint8_t *typecodes =
+        (const uint8_t *)(buf + length - 4 - num_containers * 1);
+
+    // bitset, run and array zones
+    int32_t num_bitset_containers = 0;
+    int32_t num_run_containers = 0;
+    int32_t num_array_containers = 0;
+    size_t bitset_zone_size = 0;
+    size_t run_zone_size = 0;
+    size_t array_zone_size = 0;
+    for (int32_t i = 0; i < num_containers; i++) {
+        if (i > 0 && keys[i] <= keys[i - 1]) {
+            return NULL;
+        }
+        switch (typecodes[i]) {
+            case BITSET_CONTAINER_TYPE_CODE:
+                num_bitset_containers++;
+                bitset_zone_size +=
+                    BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+                break;
+            case RUN_CONTAINER_TYPE_CODE:
+                num_run_containers++;
+                run_zone_size += counts[i] * sizeof(rle16_t);
+                break;
+            case ARRAY_CONTAINER_TYPE_CODE:
+                num_array_containers++;
+                array_zone_size += (counts[i] + UINT32_C(1)) * sizeof(uint16_t);
+                break;
+            default:
+                return NULL;
+        }
+    }
+    if (length != bitset_zone_size + run_zone_size + array_zone_size +
+                      5 * num_containers + 4) {
+        return NULL;
+    }
+    const uint64_t *bitset_zone = (const uint64_t *)(buf);
+    const rle16_t *run_zone = (const rle16_t *)(buf + bitset_zone_size);
+    const uint16_t *array_zone =
+        (const uint16_t *)(buf + bitset_zone_size + run_zone_size);
+
+    // the bitmap, the container pointers and the containers in one block
+    size_t alloc_size = 0;
+    alloc_size += sizeof(roaring_bitmap_t);
+    alloc_size += num_containers * sizeof(void *);
+    alloc_size += num_bitset_containers * sizeof(bitset_container_t);
+    alloc_size += num_run_containers * sizeof(run_container_t);
+    alloc_size += num_array_containers * sizeof(array_container_t);
+
+    char *arena = (char *)malloc(alloc_size);
+    if (arena == NULL) {
+        return NULL;
+    }
+
+    roaring_bitmap_t *rb =
+        (roaring_bitmap_t *)arena_alloc(&arena, sizeof(roaring_bitmap_t));
+    rb->copy_on_write = false;
+    rb->high_low_container.flags = ROARING_FLAG_FROZEN;
+    rb->high_low_container.allocation_size = num_containers;
+    rb->high_low_container.size = num_containers;
+    rb->high_low_container.keys = (uint16_t *)keys;
+    rb->high_low_container.typecodes = (uint8_t *)typecodes;
+    rb->high_low_container.containers =
+        (void **)arena_alloc(&arena, sizeof(void *) * num_containers);
+    for (int32_t i = 0; i < num_containers; i++) {
+        switch (typecodes[i]) {
+            case BITSET_CONTAINER_TYPE_CODE: {
+                bitset_container_t *bitset = (bitset_container_t *)arena_alloc(
+                    &arena, sizeof(bitset_container_t));
+                bitset->array = (uint64_t *)bitset_zone;
+                bitset->cardinality = counts[i] + UINT32_C(1);
+                rb->high_low_container.containers[i] = bitset;
+                bitset_zone += BITSET_CONTAINER_SIZE_IN_WORDS;
+                break;
+            }
+            case RUN_CONTAINER_TYPE_CODE: {
+                run_container_t *run = (run_container_t *)arena_alloc(
+                    &arena, sizeof(run_container_t));
+                run->capacity = counts[i];
+                run->n_runs = counts[i];
+                run->runs = (rle16_t *)run_zone;
+                rb->high_low_container.containers[i] = run;
+                run_zone += run->n_runs;
+                break;
+            }
+            case ARRAY_CONTAINER_TYPE_CODE: {
+                array_container_t *array = (array_container_t *)arena_alloc(
+                    &arena, sizeof(array_container_t));
+                array->capacity = counts[i] + UINT32_C(1);
+                array->cardinality = counts[i] + UINT32_C(1);
+                array->array = (uint16_t *)array_zone;
+                rb->high_low_container.containers[i] = array;
+                array_zone += counts[i] + UINT32_C(1);
+                break;
+            }
+        }
+    }
+
+    return rb;
+}
+
+/* Whether a container of a frozen view holds what its header says */
+static bool frozen_container_is_valid(const void *container, uint8_t typecode) {
+    switch (typecode) {
+        case BITSET_CONTAINER_TYPE_CODE: {
+            const bitset_container_t *bitset =
+                (const bitset_container_t *)container;
+            return bitset_container_compute_cardinality(bitset) ==
+                   bitset->cardinality;
+        }
+        case RUN_CONTAINER_TYPE_CODE: {
+            const run_container_t *run = (const run_container_t *)container;
+            if (run->n_runs == 0) return false;
+            uint32_t next = 0;  // smallest value the next run may start at
+            for (int32_t i = 0; i < run->n_runs; ++i) {
+                if (run->runs[i].value < next ||
+                    (uint32_t)run->runs[i].value + run->runs[i].length >
+                        UINT16_MAX) {
+                    return false;
+                }
+                next = (uint32_t)run->runs[i].value + run->runs[i].length + 1;
+            }
+            return true;
+        }
+        default: {
+            const array_container_t *array =
+                (const array_container_t *)container;
+            for (int32_t i = 1; i < array->cardinality; ++i) {
+                if (array->array[i] <= array->array[i - 1]) return false;
+            }
+            return true;
+        }
+    }
+}
+
+const roaring_bitmap_t *roaring_bitmap_frozen_view_checked(const char *buf,
+                                                           size_t length) {
+    const roaring_bitmap_t *rb = roaring_bitmap_frozen_view(buf, length);
+    if (rb == NULL) {
+        return NULL;
+    }
+    const roaring_array_t *ra = &rb->high_low_container;
+    for (int32_t i = 0; i < ra->size; i++) {
+        if (!frozen_container_is_valid(ra->containers[i], ra->typecodes[i])) {
+            roaring_bitmap_free((roaring_bitmap_t *)rb);
+            return NULL;
+        }
+    }
+    return rb;
+}
+
 size_t roaring_bitmap_portable_serialize(const roaring_bitmap_t *ra,
                                          char *buf) {
     return ra_portable_serialize(& ra->high_low_container, buf);
 }
 
+size_t roaring_bitmap_portable_header_size_in_bytes(const roaring_bitmap_t *ra) {
+    return ra_portable_header_size(& ra->high_low_container);
+}
+
+size_t roaring_bitmap_portable_serialize_header(const roaring_bitmap_t *ra,
+                                                char *buf) {
+    return ra_portable_serialize_header(& ra->high_low_container, buf);
+}
+
 roaring_bitmap_t *roaring_bitmap_deserialize(const void *buf) {
 	const char * bufaschar = (const char *) buf;
     if (*(const unsigned char *)buf == SERIALIZATION_ARRAY_UINT32) {
@@ -7774,6 +9174,87 @@ static bool loadfirstvalue(roaring_uint32_iterator_t * newit) {
   return true;
 }
 
+static bool loadlastvalue(roaring_uint32_iterator_t * newit) {
+  newit->in_container_index = 0;
+  newit->run_index = 0;
+  newit->in_run_index = 0;
+  newit->current_value = 0;
+  if(newit->container_index < 0) {// otherwise nothing
+    newit->current_value = UINT32_MAX;
+    return (newit->has_value = false);
+  }
+  // assume not empty
+  newit->has_value = true;
+  const void * container = newit->parent->high_low_container.containers[newit->container_index];
+  uint8_t typecode = newit->parent->high_low_container.typecodes[newit->container_index];
+  uint32_t highbits = ((uint32_t)newit->parent->high_low_container.keys[newit->container_index]) << 16;
+  container = container_unwrap_shared(container, &typecode);
+  int32_t wordindex;
+  uint64_t word; // used for bitsets
+  switch (typecode) {
+            case BITSET_CONTAINER_TYPE_CODE:
+                wordindex = BITSET_CONTAINER_SIZE_IN_WORDS - 1;
+                while( (  word = ((const bitset_container_t *)container)->array[wordindex]) == 0)
+                  wordindex--; // go back
+                // here "word" is non-zero
+                newit->in_container_index = wordindex * 64 + 63 - __builtin_clzll(word);
+                newit->current_value = highbits | newit->in_container_index;
+                break;
+            case ARRAY_CONTAINER_TYPE_CODE:
+                newit->in_container_index = ((const array_container_t *)container)->cardinality - 1;
+                newit->current_value = highbits | ((const array_container_t *)container)->array[newit->in_container_index];
+                break;
+            case RUN_CONTAINER_TYPE_CODE:
+                newit->run_index = ((const run_container_t *)container)->n_runs - 1;
+                newit->in_run_index = ((const run_container_t *)container)->runs[newit->run_index].length;
+                newit->current_value = highbits | (((const run_container_t *)container)->runs[newit->run_index].value + newit->in_run_index);
+                break;
+            default:
+                // if this ever happens, bug!
+                assert(false);
+  }//switch (typecode)
+  return true;
+}
+
+// loads the first value of the current container that is larger or equal to val,
+// which the caller checked is at most the maximum of that container
+static bool loadfirstvalue_largeorequal(roaring_uint32_iterator_t * newit, uint32_t val) {
+  newit->in_container_index = 0;
+  newit->run_index = 0;
+  newit->in_run_index = 0;
+  newit->current_value = 0;
+  // assume it is found
+  newit->has_value = true;
+  const void * container = newit->parent->high_low_container.containers[newit->container_index];
+  uint8_t typecode = newit->parent->high_low_container.typecodes[newit->container_index];
+  uint32_t highbits = ((uint32_t)newit->parent->high_low_container.keys[newit->container_index]) << 16;
+  uint16_t lb = val & 0xFFFF;
+  container = container_unwrap_shared(container, &typecode);
+  switch (typecode) {
+            case BITSET_CONTAINER_TYPE_CODE:
+                newit->in_container_index = bitset_container_index_equalorlarger((const bitset_container_t *)container, lb);
+                newit->current_value = highbits | newit->in_container_index;
+                break;
+            case ARRAY_CONTAINER_TYPE_CODE:
+                newit->in_container_index = array_container_index_equalorlarger((const array_container_t *)container, lb);
+                newit->current_value = highbits | ((const array_container_t *)container)->array[newit->in_container_index];
+                break;
+            case RUN_CONTAINER_TYPE_CODE:
+                newit->run_index = run_container_index_equalorlarger((const run_container_t *)container, lb);
+                if(((const run_container_t *)container)->runs[newit->run_index].value <= lb) {
+                  newit->in_run_index = lb - ((const run_container_t *)container)->runs[newit->run_index].value;
+                  newit->current_value = val;
+                } else {
+                  newit->current_value = highbits | (((const run_container_t *)container)->runs[newit->run_index].value);
+                }
+                break;
+            default:
+                // if this ever happens, bug!
+                assert(false);
+  }//switch (typecode)
+  return true;
+}
+
 roaring_uint32_iterator_t * roaring_create_iterator(const roaring_bitmap_t *ra) {
   roaring_uint32_iterator_t * newit = (roaring_uint32_iterator_t *) malloc(sizeof(roaring_uint32_iterator_t));
   if(newit == NULL) return NULL;
@@ -7783,6 +9264,15 @@ roaring_uint32_iterator_t * roaring_create_iterator(const roaring_bitmap_t *ra)
   return newit;
 }
 
+roaring_uint32_iterator_t * roaring_create_iterator_last(const roaring_bitmap_t *ra) {
+  roaring_uint32_iterator_t * newit = (roaring_uint32_iterator_t *) malloc(sizeof(roaring_uint32_iterator_t));
+  if(newit == NULL) return NULL;
+  newit->parent = ra;
+  newit->container_index = ra->high_low_container.size - 1;
+  newit->has_value = loadlastvalue(newit);
+  return newit;
+}
+
 roaring_uint32_iterator_t * roaring_copy_uint32_iterator(const roaring_uint32_iterator_t * it) {
   roaring_uint32_iterator_t * newit = (roaring_uint32_iterator_t *) malloc(sizeof(roaring_uint32_iterator_t));
   newit->parent = it->parent;
@@ -7800,6 +9290,10 @@ bool roaring_advance_uint32_iterator(roaring_uint32_iterator_t *it) {
     if(it->container_index >= it->parent->high_low_container.size) {
       return false;
     }
+    if(it->container_index < 0) {// went past the first value backward, come back to it
+      it->container_index = 0;
+      return (it->has_value = loadfirstvalue(it));
+    }
     // we assume that we are *not* pointing at the first value of a container
     const void * container = it->parent->high_low_container.containers[it->container_index];
     uint8_t typecode = it->parent->high_low_container.typecodes[it->container_index];
@@ -7809,48 +9303,227 @@ bool roaring_advance_uint32_iterator(roaring_uint32_iterator_t *it) {
     uint64_t word; // used for bitsets
     switch (typecode) {
             case BITSET_CONTAINER_TYPE_CODE:
-                it->in_container_index++;
+                it->in_container_index++;
+                wordindex = it->in_container_index / 64;
+                if(wordindex >= BITSET_CONTAINER_SIZE_IN_WORDS) break;
+                word =  ((const bitset_container_t *)container)->array[wordindex] & (UINT64_MAX << (it->in_container_index % 64));
+                // next part could be optimized/simplified
+                while ((word == 0) && (wordindex + 1 < BITSET_CONTAINER_SIZE_IN_WORDS)) {
+                  wordindex++;
+                  word =  ((const bitset_container_t *)container)->array[wordindex];
+                }
+                if(word != 0) {
+                  it->in_container_index = wordindex * 64 + __builtin_ctzll(word);
+                  it->current_value = highbits | it->in_container_index;
+                  return true;
+                }
+                break;
+            case ARRAY_CONTAINER_TYPE_CODE:
+                it->in_container_index++;
+                if(it->in_container_index < ((const array_container_t *)container)->cardinality) {
+                  it->current_value = highbits | ((const array_container_t *)container)->array[it->in_container_index];
+                  return true;
+                }
+                break;
+            case RUN_CONTAINER_TYPE_CODE:
+                it->in_run_index++;
+                if(it->in_run_index <= ((const run_container_t *)container)->runs[it->run_index].length) {
+                  it->current_value = highbits | (((const run_container_t *)container)->runs[it->run_index].value  + it->in_run_index);
+                  return true;
+                }
+                it->in_run_index = 0;
+                it->run_index++;
+                if(it->run_index < ((const run_container_t *)container)->n_runs) {
+                  it->current_value = highbits | (((const run_container_t *)container)->runs[it->run_index].value);
+                  return true;
+                }
+                break;
+            default:
+                // if this ever happens, bug!
+                assert(false);
+    }//switch (typecode)
+    // moving to next container
+    it->container_index++;
+    it->has_value = loadfirstvalue(it);
+    return it->has_value;
+}
+
+bool roaring_previous_uint32_iterator(roaring_uint32_iterator_t *it) {
+    if(it->container_index < 0) {
+      return false;
+    }
+    if(it->container_index >= it->parent->high_low_container.size) {// went past the last value, come back to it
+      it->container_index = it->parent->high_low_container.size - 1;
+      return (it->has_value = loadlastvalue(it));
+    }
+    // we assume that we are *not* pointing at the last value of a container
+    const void * container = it->parent->high_low_container.containers[it->container_index];
+    uint8_t typecode = it->parent->high_low_container.typecodes[it->container_index];
+    uint32_t highbits = ((uint32_t)it->parent->high_low_container.keys[it->container_index]) << 16;
+    container = container_unwrap_shared(container, &typecode);
+    int32_t wordindex;  // used for bitsets
+    uint64_t word; // used for bitsets
+    switch (typecode) {
+            case BITSET_CONTAINER_TYPE_CODE:
+                if(it->in_container_index == 0) break;
+                it->in_container_index--;
+                wordindex = it->in_container_index / 64;
+                word =  ((const bitset_container_t *)container)->array[wordindex] & (UINT64_MAX >> (63 - (it->in_container_index % 64)));
+                while ((word == 0) && (wordindex > 0)) {
+                  wordindex--;
+                  word =  ((const bitset_container_t *)container)->array[wordindex];
+                }
+                if(word != 0) {
+                  it->in_container_index = wordindex * 64 + 63 - __builtin_clzll(word);
+                  it->current_value = highbits | it->in_container_index;
+                  return true;
+                }
+                break;
+            case ARRAY_CONTAINER_TYPE_CODE:
+                if(it->in_container_index > 0) {
+                  it->in_container_index--;
+                  it->current_value = highbits | ((const array_container_t *)container)->array[it->in_container_index];
+                  return true;
+                }
+                break;
+            case RUN_CONTAINER_TYPE_CODE:
+                if(it->in_run_index > 0) {
+                  it->in_run_index--;
+                  it->current_value = highbits | (((const run_container_t *)container)->runs[it->run_index].value  + it->in_run_index);
+                  return true;
+                }
+                if(it->run_index > 0) {
+                  it->run_index--;
+                  it->in_run_index = ((const run_container_t *)container)->runs[it->run_index].length;
+                  it->current_value = highbits | (((const run_container_t *)container)->runs[it->run_index].value + it->in_run_index);
+                  return true;
+                }
+                break;
+            default:
+                // if this ever happens, bug!
+                assert(false);
+    }//switch (typecode)
+    // moving to previous container
+    it->container_index--;
+    it->has_value = loadlastvalue(it);
+    return it->has_value;
+}
+
+uint32_t roaring_read_uint32_iterator(roaring_uint32_iterator_t *it, uint32_t* buf, uint32_t count) {
+  uint32_t ret = 0;
+  while (it->has_value && ret < count) {
+    const void * container = it->parent->high_low_container.containers[it->container_index];
+    uint8_t typecode = it->parent->high_low_container.typecodes[it->container_index];
+    uint32_t highbits = ((uint32_t)it->parent->high_low_container.keys[it->container_index]) << 16;
+    container = container_unwrap_shared(container, &typecode);
+    const bitset_container_t *bcont = (const bitset_container_t *)container;
+    const array_container_t *acont = (const array_container_t *)container;
+    const run_container_t *rcont = (const run_container_t *)container;
+    bool at_start;
+    switch (typecode) {
+            case BITSET_CONTAINER_TYPE_CODE:
+                at_start = it->in_container_index == bitset_container_minimum(bcont);
+                break;
+            case ARRAY_CONTAINER_TYPE_CODE:
+                at_start = it->in_container_index == 0;
+                break;
+            default:
+                at_start = it->run_index == 0 && it->in_run_index == 0;
+    }
+    if (at_start && (uint32_t)container_get_cardinality(container, typecode) <= count - ret) {
+      // the whole container fits: bitsets are decoded with SIMD when available,
+      // arrays are copied and runs expanded
+      ret += container_to_uint32_array(buf + ret, container, typecode, highbits);
+    } else {
+      uint32_t wordindex;  // used for bitsets
+      uint64_t word; // used for bitsets
+      uint32_t num_values;
+      switch (typecode) {
+            case BITSET_CONTAINER_TYPE_CODE:
                 wordindex = it->in_container_index / 64;
-                if(wordindex >= BITSET_CONTAINER_SIZE_IN_WORDS) break;
-                word =  ((const bitset_container_t *)container)->array[wordindex] & (UINT64_MAX << (it->in_container_index % 64));
-                // next part could be optimized/simplified
+                word = bcont->array[wordindex] & (UINT64_MAX << (it->in_container_index % 64));
+                while (ret < count) {
+                  if (word == 0) {
+                    if (wordindex + 1 == BITSET_CONTAINER_SIZE_IN_WORDS) break;
+                    word = bcont->array[++wordindex];
+                    continue;
+                  }
+                  buf[ret++] = highbits | (wordindex * 64 + __builtin_ctzll(word));
+                  word &= word - 1;
+                }
                 while ((word == 0) && (wordindex + 1 < BITSET_CONTAINER_SIZE_IN_WORDS)) {
-                  wordindex++;
-                  word =  ((const bitset_container_t *)container)->array[wordindex];
+                  word = bcont->array[++wordindex];
                 }
-                if(word != 0) {
+                if (word != 0) {
                   it->in_container_index = wordindex * 64 + __builtin_ctzll(word);
                   it->current_value = highbits | it->in_container_index;
-                  return true;
+                  return ret;
                 }
                 break;
             case ARRAY_CONTAINER_TYPE_CODE:
-                it->in_container_index++;
-                if(it->in_container_index < ((const array_container_t *)container)->cardinality) {
-                  it->current_value = highbits | ((const array_container_t *)container)->array[it->in_container_index];
-                  return true;
+                num_values = (uint32_t)(acont->cardinality - it->in_container_index);
+                if (num_values > count - ret) num_values = count - ret;
+                for (uint32_t i = 0; i < num_values; i++) {
+                  buf[ret + i] = highbits | acont->array[it->in_container_index + i];
+                }
+                ret += num_values;
+                it->in_container_index += num_values;
+                if (it->in_container_index < acont->cardinality) {
+                  it->current_value = highbits | acont->array[it->in_container_index];
+                  return ret;
                 }
                 break;
             case RUN_CONTAINER_TYPE_CODE:
-                it->in_run_index++;
-                if(it->in_run_index <= ((const run_container_t *)container)->runs[it->run_index].length) {
-                  it->current_value = highbits | (((const run_container_t *)container)->runs[it->run_index].value  + it->in_run_index);
-                  return true;
+                while (ret < count && it->run_index < rcont->n_runs) {
+                  // values left in the run, the current one included
+                  uint32_t left = (uint32_t)rcont->runs[it->run_index].length - it->in_run_index + 1;
+                  uint32_t first = highbits | (rcont->runs[it->run_index].value + it->in_run_index);
+                  num_values = left < count - ret ? left : count - ret;
+                  for (uint32_t i = 0; i < num_values; i++) {
+                    buf[ret + i] = first + i;
+                  }
+                  ret += num_values;
+                  if (num_values < left) {
+                    it->in_run_index += num_values;
+                  } else {
+                    it->in_run_index = 0;
+                    it->run_index++;
+                  }
                 }
-                it->in_run_index = 0;
-                it->run_index++;
-                if(it->run_index < ((const run_container_t *)container)->n_runs) {
-                  it->current_value = highbits | (((const run_container_t *)container)->runs[it->run_index].value);
-                  return true;
+                if (it->run_index < rcont->n_runs) {
+                  it->current_value = highbits | (rcont->runs[it->run_index].value + it->in_run_index);
+                  return ret;
                 }
                 break;
             default:
                 // if this ever happens, bug!
                 assert(false);
-    }//switch (typecode)
+      }//switch (typecode)
+    }
     // moving to next container
     it->container_index++;
     it->has_value = loadfirstvalue(it);
+  }
+  return ret;
+}
+
+bool roaring_move_uint32_iterator_equalorlarger(roaring_uint32_iterator_t *it, uint32_t val) {
+    uint16_t hb = val >> 16;
+    const int32_t i = ra_get_index(&it->parent->high_low_container, hb);
+    if (i >= 0) {
+      uint16_t lb = val & 0xFFFF;
+      if (container_maximum(it->parent->high_low_container.containers[i], it->parent->high_low_container.typecodes[i]) < lb) {
+        it->container_index = i + 1; // the first value of the next container
+      } else { // val is within the range of the container
+        it->container_index = i;
+        it->has_value = loadfirstvalue_largeorequal(it, val);
+        return it->has_value;
+      }
+    } else {
+      // no container for hb, so the next one is next
+      it->container_index = -i - 1;
+    }
+    it->has_value = loadfirstvalue(it);
     return it->has_value;
 }
 
@@ -8049,7 +9722,8 @@ roaring_bitmap_t *roaring_bitmap_flip(const roaring_bitmap_t *x1,
 
         if (lb_end != 0xFFFF) --hb_end;  // later we'll handle the partial block
 
-        for (uint16_t hb = hb_start; hb <= hb_end; ++hb) {
+        // hb_end can be 0xFFFF, where a 16-bit counter would wrap around
+        for (uint32_t hb = hb_start; hb <= hb_end; ++hb) {
             insert_fully_flipped_container(& ans->high_low_container, & x1->high_low_container, hb);
         }
 
@@ -8090,7 +9764,8 @@ void roaring_bitmap_flip_inplace(roaring_bitmap_t *x1, uint64_t range_start,
 
         if (lb_end != 0xFFFF) --hb_end;
 
-        for (uint16_t hb = hb_start; hb <= hb_end; ++hb) {
+        // hb_end can be 0xFFFF, where a 16-bit counter would wrap around
+        for (uint32_t hb = hb_start; hb <= hb_end; ++hb) {
             inplace_fully_flip_container(& x1->high_low_container, hb);
         }
 
@@ -8469,6 +10144,142 @@ uint64_t  roaring_bitmap_rank(const roaring_bitmap_t *bm, uint32_t x) {
     return size;
 }
 
+roaring_rank_index_t *roaring_rank_index_create(const roaring_bitmap_t *r) {
+    const roaring_array_t *ra = &r->high_low_container;
+    roaring_rank_index_t *index =
+        (roaring_rank_index_t *)malloc(sizeof(roaring_rank_index_t));
+    if (index == NULL) return NULL;
+    index->size = ra->size;
+    index->n_bitsets = 0;
+    for (int32_t i = 0; i < ra->size; ++i) {
+        uint8_t type = ra->typecodes[i];
+        container_unwrap_shared(ra->containers[i], &type);
+        if (type == BITSET_CONTAINER_TYPE_CODE) index->n_bitsets++;
+    }
+    index->cumulative =
+        (uint64_t *)malloc((ra->size + 1) * sizeof(uint64_t));
+    index->blocks = (int32_t *)malloc((ra->size + 1) * sizeof(int32_t));
+    index->block_ranks = (uint16_t *)malloc(
+        (index->n_bitsets * ROARING_RANK_BLOCKS + 1) * sizeof(uint16_t));
+    if (index->cumulative == NULL || index->blocks == NULL ||
+        index->block_ranks == NULL) {
+        roaring_rank_index_free(index);
+        return NULL;
+    }
+
+    uint64_t card = 0;
+    int32_t bitsets = 0;
+    for (int32_t i = 0; i < ra->size; ++i) {
+        index->cumulative[i] = card;
+        uint8_t type = ra->typecodes[i];
+        const void *c = container_unwrap_shared(ra->containers[i], &type);
+        card += container_get_cardinality(c, type);
+        if (type != BITSET_CONTAINER_TYPE_CODE) {
+            index->blocks[i] = -1;
+            continue;
+        }
+        const uint64_t *words = ((const bitset_container_t *)c)->array;
+        uint16_t *block_ranks = index->block_ranks + bitsets * ROARING_RANK_BLOCKS;
+        uint32_t before = 0;
+        for (int32_t b = 0; b < ROARING_RANK_BLOCKS; ++b) {
+            block_ranks[b] = (uint16_t)before;
+            for (int32_t w = 0; w < ROARING_RANK_BLOCK_WORDS; ++w) {
+                before += hamming(words[b * ROARING_RANK_BLOCK_WORDS + w]);
+            }
+        }
+        index->blocks[i] = bitsets * ROARING_RANK_BLOCKS;
+        bitsets++;
+    }
+    index->cumulative[ra->size] = card;
+    return index;
+}
+
+void roaring_rank_index_free(roaring_rank_index_t *index) {
+    free(index->cumulative);
+    free(index->blocks);
+    free(index->block_ranks);
+    free(index);
+}
+
+size_t roaring_rank_index_size_in_bytes(const roaring_rank_index_t *index) {
+    return sizeof(roaring_rank_index_t) +
+           (index->size + 1) * (sizeof(uint64_t) + sizeof(int32_t)) +
+           (index->n_bitsets * ROARING_RANK_BLOCKS + 1) * sizeof(uint16_t);
+}
+
+uint64_t roaring_bitmap_rank_indexed(const roaring_bitmap_t *r,
+                                     const roaring_rank_index_t *index,
+                                     uint32_t x) {
+    const roaring_array_t *ra = &r->high_low_container;
+    const int32_t i = binarySearch(ra->keys, ra->size, (uint16_t)(x >> 16));
+    if (i < 0) return index->cumulative[-i - 1];
+
+    const uint16_t low = (uint16_t)x;
+    uint8_t type = ra->typecodes[i];
+    const void *c = container_unwrap_shared(ra->containers[i], &type);
+    if (type != BITSET_CONTAINER_TYPE_CODE) {
+        return index->cumulative[i] + container_rank(c, type, low);
+    }
+
+    // the values before the block of x, then those of the block up to x
+    const uint64_t *words = ((const bitset_container_t *)c)->array;
+    const uint32_t block = low / (64 * ROARING_RANK_BLOCK_WORDS);
+    const uint32_t last = low / 64;
+    uint64_t rank = index->cumulative[i] + index->block_ranks[index->blocks[i] + block];
+    for (uint32_t w = block * ROARING_RANK_BLOCK_WORDS; w < last; ++w) {
+        rank += hamming(words[w]);
+    }
+    return rank + hamming(words[last] & (UINT64_MAX >> (63 - low % 64)));
+}
+
+bool roaring_bitmap_select_indexed(const roaring_bitmap_t *r,
+                                   const roaring_rank_index_t *index,
+                                   uint64_t rank, uint32_t *element) {
+    if (rank >= index->cumulative[index->size]) return false;
+
+    // the last container with fewer values before it than rank + 1, no
+    // container being empty
+    int32_t lo = 0, hi = index->size - 1;
+    while (lo < hi) {
+        const int32_t mid = (lo + hi + 1) / 2;
+        if (index->cumulative[mid] <= rank) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    const roaring_array_t *ra = &r->high_low_container;
+    uint32_t in_container = (uint32_t)(rank - index->cumulative[lo]);
+    uint8_t type = ra->typecodes[lo];
+    const void *c = container_unwrap_shared(ra->containers[lo], &type);
+    const uint32_t key = (uint32_t)ra->keys[lo] << 16;
+
+    if (type != BITSET_CONTAINER_TYPE_CODE) {
+        uint32_t start_rank = 0;
+        container_select(c, type, &start_rank, in_container, element);
+        *element |= key;
+        return true;
+    }
+
+    // the last block with at most in_container values before it
+    const uint16_t *block_ranks = index->block_ranks + index->blocks[lo];
+    int32_t b = 0;
+    for (int32_t step = ROARING_RANK_BLOCKS / 2; step > 0; step /= 2) {
+        if (block_ranks[b + step] <= in_container) b += step;
+    }
+    in_container -= block_ranks[b];
+    const uint64_t *words = ((const bitset_container_t *)c)->array;
+    for (int32_t w = b * ROARING_RANK_BLOCK_WORDS;; ++w) {
+        uint64_t word = words[w];
+        const uint32_t count = hamming(word);
+        if (in_container < count) {
+            for (; in_container > 0; --in_container) word &= word - 1;
+            *element = key | (uint32_t)(w * 64 + __builtin_ctzll(word));
+            return true;
+        }
+        in_container -= count;
+    }
+}
 
 /**
 * roaring_bitmap_smallest returns the smallest value in the set.
@@ -8599,6 +10410,7 @@ bool ra_init_with_capacity(roaring_array_t *new_ra, uint32_t cap) {
     new_ra->keys = (uint16_t *)(new_ra->containers + cap);
     new_ra->typecodes = (uint8_t *)(new_ra->keys + cap);
     new_ra->size = 0;
+    new_ra->flags = 0;
 
     return true;
 }
@@ -8633,8 +10445,9 @@ bool ra_copy(const roaring_array_t *source, roaring_array_t * dest, bool copy_on
     } else {
         memcpy(dest->typecodes, source->typecodes, dest->size * sizeof(uint8_t));
         for (int32_t i = 0; i < dest->size; i++) {
-            dest->containers[i] =
-                container_clone(source->containers[i], source->typecodes[i]);
+            // unwraps shared containers, fixing up the typecode accordingly
+            dest->containers[i] = get_copy_of_container(
+                source->containers[i], &dest->typecodes[i], copy_on_write);
             if (dest->containers[i] == NULL) {
                 for (int32_t j = 0; j < i; j++) {
                     container_free(dest->containers[j], dest->typecodes[j]);
@@ -8669,8 +10482,9 @@ bool ra_overwrite(const roaring_array_t *source, roaring_array_t * dest, bool co
     } else {
         memcpy(dest->typecodes, source->typecodes, dest->size * sizeof(uint8_t));
         for (int32_t i = 0; i < dest->size; i++) {
-            dest->containers[i] =
-                container_clone(source->containers[i], source->typecodes[i]);
+            // unwraps shared containers, fixing up the typecode accordingly
+            dest->containers[i] = get_copy_of_container(
+                source->containers[i], &dest->typecodes[i], copy_on_write);
             if (dest->containers[i] == NULL) {
                 for (int32_t j = 0; j < i; j++) {
                     container_free(dest->containers[j], dest->typecodes[j]);
@@ -8740,9 +10554,9 @@ void ra_append_copy(roaring_array_t *ra, const roaring_array_t *sa, uint16_t ind
         ra->containers[pos] = sa->containers[index];
         ra->typecodes[pos] = sa->typecodes[index];
     } else {
-        ra->containers[pos] =
-            container_clone(sa->containers[index], sa->typecodes[index]);
         ra->typecodes[pos] = sa->typecodes[index];
+        ra->containers[pos] = get_copy_of_container(
+            sa->containers[index], &ra->typecodes[pos], copy_on_write);
     }
     ra->size++;
 }
@@ -8769,9 +10583,9 @@ void ra_append_copy_range(roaring_array_t *ra, const roaring_array_t *sa,
             ra->containers[pos] = sa->containers[i];
             ra->typecodes[pos] = sa->typecodes[i];
         } else {
-            ra->containers[pos] =
-                container_clone(sa->containers[i], sa->typecodes[i]);
             ra->typecodes[pos] = sa->typecodes[i];
+            ra->containers[pos] = get_copy_of_container(
+                sa->containers[i], &ra->typecodes[pos], copy_on_write);
         }
         ra->size++;
     }
@@ -8815,9 +10629,9 @@ void ra_append_range(roaring_array_t *ra, roaring_array_t *sa,
             ra->containers[pos] = sa->containers[i];
             ra->typecodes[pos] = sa->typecodes[i];
         } else {
-            ra->containers[pos] =
-                container_clone(sa->containers[i], sa->typecodes[i]);
             ra->typecodes[pos] = sa->typecodes[i];
+            ra->containers[pos] = get_copy_of_container(
+                sa->containers[i], &ra->typecodes[pos], copy_on_write);
         }
         ra->size++;
     }
@@ -8995,6 +10809,15 @@ size_t ra_portable_size_in_bytes(const roaring_array_t *ra) {
 }
 
 size_t ra_portable_serialize(const roaring_array_t *ra, char *buf) {
+    char *initbuf = buf;
+    buf += ra_portable_serialize_header(ra, buf);
+    for (int32_t k = 0; k < ra->size; ++k) {
+        buf += container_write(ra->containers[k], ra->typecodes[k], buf);
+    }
+    return buf - initbuf;
+}
+
+size_t ra_portable_serialize_header(const roaring_array_t *ra, char *buf) {
     char *initbuf = buf;
     uint32_t startOffset = 0;
     bool hasrun = ra_has_run_container(ra);
@@ -9048,9 +10871,6 @@ size_t ra_portable_serialize(const roaring_array_t *ra, char *buf) {
                 container_size_in_bytes(ra->containers[k], ra->typecodes[k]);
         }
     }
-    for (int32_t k = 0; k < ra->size; ++k) {
-        buf += container_write(ra->containers[k], ra->typecodes[k], buf);
-    }
     return buf - initbuf;
 }
 
@@ -9137,7 +10957,641 @@ bool ra_portable_deserialize(roaring_array_t *answer, const char *buf) {
     return true;
 }
 
+static void *read_container_stream(int32_t card, uint8_t typecode,
+                                   roaring_read_callback read, void *param) {
+    if (typecode == BITSET_CONTAINER_TYPE_CODE) {
+        bitset_container_t *c = bitset_container_create();
+        if (c == NULL) return NULL;
+        if (!read(c->array, BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t),
+                  param)) {
+            bitset_container_free(c);
+            return NULL;
+        }
+        c->cardinality = bitset_container_compute_cardinality(c);
+        if (c->cardinality != card) {
+            bitset_container_free(c);
+            return NULL;
+        }
+        return c;
+    } else if (typecode == RUN_CONTAINER_TYPE_CODE) {
+        uint16_t n_runs;
+        if (!read(&n_runs, sizeof(n_runs), param) || n_runs == 0) return NULL;
+        run_container_t *c = run_container_create_given_capacity(n_runs);
+        if (c == NULL) return NULL;
+        if (!read(c->runs, n_runs * sizeof(rle16_t), param)) {
+            run_container_free(c);
+            return NULL;
+        }
+        c->n_runs = n_runs;
+        int32_t sum = 0;
+        for (int32_t i = 0; i < n_runs; ++i) {
+            const uint32_t end =
+                (uint32_t)c->runs[i].value + c->runs[i].length;
+            if (end > UINT16_MAX ||
+                (i > 0 && c->runs[i].value <=
+                              c->runs[i - 1].value + c->runs[i - 1].length)) {
+                run_container_free(c);
+                return NULL;
+            }
+            sum += c->runs[i].length + 1;
+        }
+        if (sum != card) {
+            run_container_free(c);
+            return NULL;
+        }
+        return c;
+    } else {
+        array_container_t *c = array_container_create_given_capacity(card);
+        if (c == NULL) return NULL;
+        if (!read(c->array, card * sizeof(uint16_t), param)) {
+            array_container_free(c);
+            return NULL;
+        }
+        c->cardinality = card;
+        for (int32_t i = 1; i < card; ++i) {
+            if (c->array[i] <= c->array[i - 1]) {
+                array_container_free(c);
+                return NULL;
+            }
+        }
+        return c;
+    }
+}
+
+bool ra_portable_deserialize_stream(roaring_array_t *answer,
+                                    roaring_read_callback read, void *param) {
+    // empty until the header is read, so that it can be cleared on failure
+    memset(answer, 0, sizeof(*answer));
+    uint32_t cookie;
+    if (!read(&cookie, sizeof(cookie), param)) return false;
+    if ((cookie & 0xFFFF) != SERIAL_COOKIE &&
+        cookie != SERIAL_COOKIE_NO_RUNCONTAINER) {
+        return false;
+    }
+    const bool hasrun = (cookie & 0xFFFF) == SERIAL_COOKIE;
+    int32_t size;
+    if (hasrun) {
+        size = (cookie >> 16) + 1;
+    } else {
+        if (!read(&size, sizeof(size), param)) return false;
+        if (size < 0 || size > (1 << 16)) return false;
+    }
+    if (!ra_init_with_capacity(answer, size)) return false;
+    if (size > 0 && answer->containers == NULL) return false;
+
+    // the run flags, then the keys and cardinalities, then maybe the offsets
+    const int32_t s = hasrun ? (size + 7) / 8 : 0;
+    const bool hasoffsets = (!hasrun) || (size >= NO_OFFSET_THRESHOLD);
+    const size_t header = s + size * 4 + (hasoffsets ? size * 4 : 0);
+    uint8_t *buf = (uint8_t *)malloc(header > 0 ? header : 1);
+    if (buf == NULL) return false;
+    if (!read(buf, header, param)) {
+        free(buf);
+        return false;
+    }
+    const uint8_t *bitmapOfRunContainers = buf;
+    const uint8_t *keyscards = buf + s;
+
+    bool is_ok = true;
+    for (int32_t k = 0; k < size && is_ok; ++k) {
+        uint16_t key, tmp;
+        memcpy(&key, keyscards + 4 * k, sizeof(key));
+        memcpy(&tmp, keyscards + 4 * k + 2, sizeof(tmp));
+        const int32_t card = 1 + tmp;
+        if (k > 0 && key <= answer->keys[k - 1]) {
+            is_ok = false;
+            break;
+        }
+        uint8_t typecode = card > DEFAULT_MAX_SIZE ? BITSET_CONTAINER_TYPE_CODE
+                                                   : ARRAY_CONTAINER_TYPE_CODE;
+        if (hasrun && (bitmapOfRunContainers[k / 8] & (1 << (k % 8))) != 0) {
+            typecode = RUN_CONTAINER_TYPE_CODE;
+        }
+        void *c = read_container_stream(card, typecode, read, param);
+        if (c == NULL) {
+            is_ok = false;
+            break;
+        }
+        answer->keys[k] = key;
+        answer->containers[k] = c;
+        answer->typecodes[k] = typecode;
+        answer->size = k + 1;
+    }
+    free(buf);
+    return is_ok;
+}
+
+size_t ra_portable_deserialize_size(const char *buf, const size_t maxbytes) {
+    const char *start = buf;
+    size_t bytestotal = sizeof(uint32_t);
+    if (bytestotal > maxbytes) return 0;
+    uint32_t cookie;
+    memcpy(&cookie, buf, sizeof(cookie));
+    buf += sizeof(cookie);
+    if ((cookie & 0xFFFF) != SERIAL_COOKIE &&
+        cookie != SERIAL_COOKIE_NO_RUNCONTAINER) {
+        return 0;
+    }
+    const bool hasrun = (cookie & 0xFFFF) == SERIAL_COOKIE;
+    int32_t size;
+    if (hasrun) {
+        size = (cookie >> 16) + 1;
+    } else {
+        bytestotal += sizeof(int32_t);
+        if (bytestotal > maxbytes) return 0;
+        memcpy(&size, buf, sizeof(size));
+        buf += sizeof(size);
+        if (size < 0 || size > (1 << 16)) return 0;
+    }
+    const char *bitmapOfRunContainers = NULL;
+    if (hasrun) {
+        const int32_t s = (size + 7) / 8;
+        bytestotal += s;
+        if (bytestotal > maxbytes) return 0;
+        bitmapOfRunContainers = buf;
+        buf += s;
+    }
+    const char *keyscards = buf;
+    bytestotal += size * 4;
+    if (bytestotal > maxbytes) return 0;
+    buf += size * 4;
+    const char *offsets = NULL;
+    if ((!hasrun) || (size >= NO_OFFSET_THRESHOLD)) {
+        bytestotal += size * 4;
+        if (bytestotal > maxbytes) return 0;
+        offsets = buf;
+        buf += size * 4;
+    }
+
+    for (int32_t k = 0; k < size; ++k) {
+        uint16_t key, prevkey, tmp;
+        memcpy(&key, keyscards + 4 * k, sizeof(key));
+        memcpy(&tmp, keyscards + 4 * k + 2, sizeof(tmp));
+        if (k > 0) {
+            memcpy(&prevkey, keyscards + 4 * (k - 1), sizeof(prevkey));
+            if (key <= prevkey) return 0;
+        }
+        if (offsets != NULL) {
+            uint32_t offset;
+            memcpy(&offset, offsets + 4 * k, sizeof(offset));
+            if (offset != (uint32_t)(buf - start)) return 0;
+        }
+        const int32_t card = 1 + tmp;
+        if (bitmapOfRunContainers != NULL &&
+            (bitmapOfRunContainers[k / 8] & (1 << (k % 8))) != 0) {
+            uint16_t n_runs;
+            bytestotal += sizeof(n_runs);
+            if (bytestotal > maxbytes) return 0;
+            memcpy(&n_runs, buf, sizeof(n_runs));
+            buf += sizeof(n_runs);
+            bytestotal += n_runs * sizeof(rle16_t);
+            if (bytestotal > maxbytes) return 0;
+            int32_t sum = 0;
+            uint32_t next = 0;  // smallest value the next run may start at
+            for (int32_t i = 0; i < n_runs; ++i) {
+                rle16_t run;
+                memcpy(&run, buf + i * sizeof(rle16_t), sizeof(run));
+                if (run.value < next ||
+                    (uint32_t)run.value + run.length > UINT16_MAX) {
+                    return 0;
+                }
+                next = (uint32_t)run.value + run.length + 1;
+                sum += run.length + 1;
+            }
+            if (sum != card) return 0;
+            buf += n_runs * sizeof(rle16_t);
+        } else if (card > DEFAULT_MAX_SIZE) {
+            const size_t words = BITSET_CONTAINER_SIZE_IN_WORDS;
+            bytestotal += words * sizeof(uint64_t);
+            if (bytestotal > maxbytes) return 0;
+            int32_t sum = 0;
+            for (size_t i = 0; i < words; ++i) {
+                uint64_t word;
+                memcpy(&word, buf + i * sizeof(word), sizeof(word));
+                sum += hamming(word);
+            }
+            if (sum != card) return 0;
+            buf += words * sizeof(uint64_t);
+        } else {
+            bytestotal += card * sizeof(uint16_t);
+            if (bytestotal > maxbytes) return 0;
+            uint16_t prev, value;
+            memcpy(&prev, buf, sizeof(prev));
+            for (int32_t i = 1; i < card; ++i) {
+                memcpy(&value, buf + i * sizeof(value), sizeof(value));
+                if (value <= prev) return 0;
+                prev = value;
+            }
+            buf += card * sizeof(uint16_t);
+        }
+    }
+    return bytestotal;
+}
+
+static inline bool portable_is_run(const char *bitmapOfRunContainers,
+                                   int32_t k) {
+    return bitmapOfRunContainers != NULL &&
+           (bitmapOfRunContainers[k / 8] & (1 << (k % 8))) != 0;
+}
+
+static inline int32_t portable_card(const char *keyscards, int32_t k) {
+    uint16_t tmp;
+    memcpy(&tmp, keyscards + 4 * k + 2, sizeof(tmp));
+    return 1 + tmp;
+}
+
+uint64_t ra_portable_cardinality(const char *buf) {
+    uint32_t cookie;
+    memcpy(&cookie, buf, sizeof(cookie));
+    buf += sizeof(cookie);
+    int32_t size;
+    if ((cookie & 0xFFFF) == SERIAL_COOKIE) {
+        size = (cookie >> 16) + 1;
+        buf += (size + 7) / 8;
+    } else {
+        memcpy(&size, buf, sizeof(size));
+        buf += sizeof(size);
+    }
+    uint64_t card = 0;
+    for (int32_t k = 0; k < size; ++k) card += portable_card(buf, k);
+    return card;
+}
+
+bool ra_portable_contains(const char *buf, uint32_t x) {
+    const char *start = buf;
+    const uint16_t hb = x >> 16;
+    const uint16_t lb = x & 0xFFFF;
+    uint32_t cookie;
+    memcpy(&cookie, buf, sizeof(cookie));
+    buf += sizeof(cookie);
+    const bool hasrun = (cookie & 0xFFFF) == SERIAL_COOKIE;
+    int32_t size;
+    if (hasrun) {
+        size = (cookie >> 16) + 1;
+    } else {
+        memcpy(&size, buf, sizeof(size));
+        buf += sizeof(size);
+    }
+    const char *bitmapOfRunContainers = NULL;
+    if (hasrun) {
+        bitmapOfRunContainers = buf;
+        buf += (size + 7) / 8;
+    }
+    const char *keyscards = buf;
+    buf += size * 4;
+    const bool hasoffsets = (!hasrun) || (size >= NO_OFFSET_THRESHOLD);
+
+    // binary search over the keys of the header
+    int32_t low = 0, high = size - 1, k = -1;
+    while (low <= high) {
+        const int32_t middle = (low + high) >> 1;
+        uint16_t key;
+        memcpy(&key, keyscards + 4 * middle, sizeof(key));
+        if (key < hb) {
+            low = middle + 1;
+        } else if (key > hb) {
+            high = middle - 1;
+        } else {
+            k = middle;
+            break;
+        }
+    }
+    if (k < 0) return false;
+
+    const char *container;
+    if (hasoffsets) {
+        uint32_t offset;
+        memcpy(&offset, buf + 4 * k, sizeof(offset));
+        container = start + offset;
+    } else {
+        // without offsets there are fewer than NO_OFFSET_THRESHOLD containers
+        container = buf;
+        for (int32_t i = 0; i < k; ++i) {
+            const int32_t card = portable_card(keyscards, i);
+            if (portable_is_run(bitmapOfRunContainers, i)) {
+                uint16_t n_runs;
+                memcpy(&n_runs, container, sizeof(n_runs));
+                container += sizeof(n_runs) + n_runs * sizeof(rle16_t);
+            } else if (card > DEFAULT_MAX_SIZE) {
+                container += BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+            } else {
+                container += card * sizeof(uint16_t);
+            }
+        }
+    }
+
+    const int32_t card = portable_card(keyscards, k);
+    if (portable_is_run(bitmapOfRunContainers, k)) {
+        uint16_t n_runs;
+        memcpy(&n_runs, container, sizeof(n_runs));
+        container += sizeof(n_runs);
+        // last run starting at or before lb
+        int32_t lo = 0, hi = n_runs - 1, found = -1;
+        while (lo <= hi) {
+            const int32_t middle = (lo + hi) >> 1;
+            rle16_t run;
+            memcpy(&run, container + middle * sizeof(rle16_t), sizeof(run));
+            if (run.value <= lb) {
+                found = middle;
+                lo = middle + 1;
+            } else {
+                hi = middle - 1;
+            }
+        }
+        if (found < 0) return false;
+        rle16_t run;
+        memcpy(&run, container + found * sizeof(rle16_t), sizeof(run));
+        return lb - run.value <= run.length;
+    } else if (card > DEFAULT_MAX_SIZE) {
+        // the words are little endian, so bit i lives in byte i / 8
+        return ((uint8_t)container[lb / 8] >> (lb % 8)) & 1;
+    } else {
+        int32_t lo = 0, hi = card - 1;
+        while (lo <= hi) {
+            const int32_t middle = (lo + hi) >> 1;
+            uint16_t value;
+            memcpy(&value, container + middle * sizeof(value), sizeof(value));
+            if (value < lb) {
+                lo = middle + 1;
+            } else if (value > lb) {
+                hi = middle - 1;
+            } else {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
 /* end file src/roaring_array.c */
+/* begin file src/roaring_parallel.c */
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#define ROARING_HAVE_THREADS
+#endif
+
+/* below this many containers per range, a thread costs more than it saves */
+#define PARALLEL_MIN_CONTAINERS 256
+
+typedef enum {
+    PARALLEL_AND,
+    PARALLEL_OR,
+    PARALLEL_XOR,
+    PARALLEL_ANDNOT,
+    PARALLEL_OR_MANY
+} parallel_op_t;
+
+/* one key range [begin, end) of the operation, computed by one thread */
+typedef struct parallel_task_s {
+    parallel_op_t op;
+    size_t number;
+    const roaring_bitmap_t **x;
+    uint32_t begin;
+    uint32_t end;
+    roaring_bitmap_t *result;
+} parallel_task_t;
+
+/* index of the first key >= key, key being at most 1 << 16 */
+static int32_t key_lower_bound(const roaring_array_t *ra, uint32_t key) {
+    if (key > UINT16_MAX) return ra->size;
+    int32_t i = ra_get_index(ra, (uint16_t)key);
+    return i >= 0 ? i : -i - 1;
+}
+
+/*
+ * Points 'view' at the containers of x within the key range, without copying
+ * anything. The view must not be freed or modified.
+ */
+static void make_view(const roaring_bitmap_t *x, uint32_t begin, uint32_t end,
+                      roaring_bitmap_t *view) {
+    const roaring_array_t *ra = &x->high_low_container;
+    const int32_t start = key_lower_bound(ra, begin);
+    const int32_t stop = key_lower_bound(ra, end);
+    view->high_low_container.size = stop - start;
+    view->high_low_container.allocation_size = stop - start;
+    view->high_low_container.keys = ra->keys + start;
+    view->high_low_container.containers = ra->containers + start;
+    view->high_low_container.typecodes = ra->typecodes + start;
+    view->high_low_container.flags = ra->flags;
+    view->copy_on_write = x->copy_on_write;
+}
+
+static void *parallel_run(void *arg) {
+    parallel_task_t *task = (parallel_task_t *)arg;
+    roaring_bitmap_t pair[2];
+    roaring_bitmap_t *views = pair;
+    const roaring_bitmap_t **ptrs = NULL;
+
+    if (task->number > 2) {
+        views = (roaring_bitmap_t *)malloc(task->number * sizeof(roaring_bitmap_t));
+        ptrs = (const roaring_bitmap_t **)malloc(task->number *
+                                                 sizeof(roaring_bitmap_t *));
+        if (views == NULL || ptrs == NULL) {
+            free(views);
+            free(ptrs);
+            task->result = NULL;
+            return NULL;
+        }
+    }
+    for (size_t i = 0; i < task->number; ++i) {
+        make_view(task->x[i], task->begin, task->end, &views[i]);
+        if (ptrs != NULL) ptrs[i] = &views[i];
+    }
+
+    switch (task->op) {
+        case PARALLEL_AND:
+            task->result = roaring_bitmap_and(&views[0], &views[1]);
+            break;
+        case PARALLEL_OR:
+            task->result = roaring_bitmap_or(&views[0], &views[1]);
+            break;
+        case PARALLEL_XOR:
+            task->result = roaring_bitmap_xor(&views[0], &views[1]);
+            break;
+        case PARALLEL_ANDNOT:
+            task->result = roaring_bitmap_andnot(&views[0], &views[1]);
+            break;
+        case PARALLEL_OR_MANY:
+            if (ptrs != NULL) {
+                task->result = roaring_bitmap_or_many(task->number, ptrs);
+            } else {
+                const roaring_bitmap_t *two[2] = {&views[0], &views[1]};
+                task->result = roaring_bitmap_or_many(task->number, two);
+            }
+            break;
+    }
+
+    if (views != pair) {
+        free(views);
+        free(ptrs);
+    }
+    return NULL;
+}
+
+/*
+ * Chooses the end of every range so that each holds about as many input
+ * containers: the boundary is the smallest key with enough containers below
+ * it, found by bisecting the key space.
+ */
+static void split_key_space(size_t number, const roaring_bitmap_t **x,
+                            uint64_t total, int parts, uint32_t *ends) {
+    uint32_t lo = 0;
+    for (int p = 1; p < parts; ++p) {
+        const uint64_t target = total * p / parts;
+        uint32_t hi = 1 << 16;
+        while (lo < hi) {
+            const uint32_t mid = lo + (hi - lo) / 2;
+            uint64_t below = 0;
+            for (size_t i = 0; i < number; ++i) {
+                below += key_lower_bound(&x[i]->high_low_container, mid);
+            }
+            if (below >= target) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        ends[p - 1] = lo;
+    }
+    ends[parts - 1] = 1 << 16;
+}
+
+/* moves the containers of the partial results, in order, into one bitmap */
+static roaring_bitmap_t *stitch(parallel_task_t *tasks, int parts) {
+    int32_t size = 0;
+    for (int p = 0; p < parts; ++p) {
+        size += tasks[p].result->high_low_container.size;
+    }
+    roaring_bitmap_t *answer = roaring_bitmap_create_with_capacity(size);
+    if (answer == NULL) return NULL;
+    roaring_array_t *ra = &answer->high_low_container;
+    answer->copy_on_write = tasks[0].result->copy_on_write;
+
+    for (int p = 0; p < parts; ++p) {
+        roaring_array_t *part = &tasks[p].result->high_low_container;
+        memcpy(ra->keys + ra->size, part->keys, part->size * sizeof(uint16_t));
+        memcpy(ra->containers + ra->size, part->containers,
+               part->size * sizeof(void *));
+        memcpy(ra->typecodes + ra->size, part->typecodes,
+               part->size * sizeof(uint8_t));
+        ra->size += part->size;
+        ra_clear_without_containers(part);
+        free(tasks[p].result);
+        tasks[p].result = NULL;
+    }
+    return answer;
+}
+
+static roaring_bitmap_t *parallel_op(parallel_op_t op, size_t number,
+                                     const roaring_bitmap_t **x, int threads) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < number; ++i) {
+        total += x[i]->high_low_container.size;
+    }
+    int parts = threads;
+    if ((uint64_t)parts > total / PARALLEL_MIN_CONTAINERS) {
+        parts = (int)(total / PARALLEL_MIN_CONTAINERS);
+    }
+    if (parts > (1 << 16)) parts = 1 << 16;
+    if (parts <= 1) return NULL;
+
+    parallel_task_t *tasks =
+        (parallel_task_t *)calloc(parts, sizeof(parallel_task_t));
+    uint32_t *ends = (uint32_t *)malloc(parts * sizeof(uint32_t));
+    if (tasks == NULL || ends == NULL) {
+        free(tasks);
+        free(ends);
+        return NULL;
+    }
+    split_key_space(number, x, total, parts, ends);
+    for (int p = 0; p < parts; ++p) {
+        tasks[p].op = op;
+        tasks[p].number = number;
+        tasks[p].x = x;
+        tasks[p].begin = p == 0 ? 0 : ends[p - 1];
+        tasks[p].end = ends[p];
+    }
+    free(ends);
+
+#ifdef ROARING_HAVE_THREADS
+    pthread_t *workers = (pthread_t *)malloc(parts * sizeof(pthread_t));
+    bool *started = (bool *)calloc(parts, sizeof(bool));
+    if (workers != NULL && started != NULL) {
+        for (int p = 1; p < parts; ++p) {
+            started[p] =
+                pthread_create(&workers[p], NULL, parallel_run, &tasks[p]) == 0;
+        }
+    }
+    parallel_run(&tasks[0]);
+    for (int p = 1; p < parts; ++p) {
+        // ranges that did not get a thread are done by the caller
+        if (started != NULL && started[p]) {
+            pthread_join(workers[p], NULL);
+        } else {
+            parallel_run(&tasks[p]);
+        }
+    }
+    free(workers);
+    free(started);
+#else
+    for (int p = 0; p < parts; ++p) parallel_run(&tasks[p]);
+#endif
+
+    roaring_bitmap_t *answer = NULL;
+    bool complete = true;
+    for (int p = 0; p < parts; ++p) complete &= tasks[p].result != NULL;
+    if (complete) answer = stitch(tasks, parts);
+    for (int p = 0; p < parts; ++p) {
+        if (tasks[p].result != NULL) roaring_bitmap_free(tasks[p].result);
+    }
+    free(tasks);
+    return answer;
+}
+
+roaring_bitmap_t *roaring_bitmap_and_parallel(const roaring_bitmap_t *x1,
+                                              const roaring_bitmap_t *x2,
+                                              int threads) {
+    const roaring_bitmap_t *x[2] = {x1, x2};
+    roaring_bitmap_t *answer = parallel_op(PARALLEL_AND, 2, x, threads);
+    return answer != NULL ? answer : roaring_bitmap_and(x1, x2);
+}
+
+roaring_bitmap_t *roaring_bitmap_or_parallel(const roaring_bitmap_t *x1,
+                                             const roaring_bitmap_t *x2,
+                                             int threads) {
+    const roaring_bitmap_t *x[2] = {x1, x2};
+    roaring_bitmap_t *answer = parallel_op(PARALLEL_OR, 2, x, threads);
+    return answer != NULL ? answer : roaring_bitmap_or(x1, x2);
+}
+
+roaring_bitmap_t *roaring_bitmap_xor_parallel(const roaring_bitmap_t *x1,
+                                              const roaring_bitmap_t *x2,
+                                              int threads) {
+    const roaring_bitmap_t *x[2] = {x1, x2};
+    roaring_bitmap_t *answer = parallel_op(PARALLEL_XOR, 2, x, threads);
+    return answer != NULL ? answer : roaring_bitmap_xor(x1, x2);
+}
+
+roaring_bitmap_t *roaring_bitmap_andnot_parallel(const roaring_bitmap_t *x1,
+                                                 const roaring_bitmap_t *x2,
+                                                 int threads) {
+    const roaring_bitmap_t *x[2] = {x1, x2};
+    roaring_bitmap_t *answer = parallel_op(PARALLEL_ANDNOT, 2, x, threads);
+    return answer != NULL ? answer : roaring_bitmap_andnot(x1, x2);
+}
+
+roaring_bitmap_t *roaring_bitmap_or_many_parallel(size_t number,
+                                                  const roaring_bitmap_t **x,
+                                                  int threads) {
+    roaring_bitmap_t *answer = NULL;
+    if (number > 1) answer = parallel_op(PARALLEL_OR_MANY, number, x, threads);
+    return answer != NULL ? answer : roaring_bitmap_or_many(number, x);
+}
+/* end file src/roaring_parallel.c */
 /* begin file src/roaring_priority_queue.c */
 
 struct roaring_pq_element_s {
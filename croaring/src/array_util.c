@@ -604,6 +604,72 @@ int32_t intersect_skewed_uint16(const uint16_t *small, size_t size_s,
     return pos;
 }
 
+/**
+ * Cardinality-only version of intersect_skewed_uint16.
+ */
+int32_t intersect_skewed_uint16_cardinality(const uint16_t *small,
+                                            size_t size_s,
+                                            const uint16_t *large,
+                                            size_t size_l) {
+    size_t pos = 0, idx_l = 0, idx_s = 0;
+
+    if (0 == size_s) {
+        return 0;
+    }
+
+    uint16_t val_l = large[idx_l], val_s = small[idx_s];
+
+    while (true) {
+        if (val_l < val_s) {
+            idx_l = advanceUntil(large, idx_l, size_l, val_s);
+            if (idx_l == size_l) break;
+            val_l = large[idx_l];
+        } else if (val_s < val_l) {
+            idx_s++;
+            if (idx_s == size_s) break;
+            val_s = small[idx_s];
+        } else {
+            pos++;
+            idx_s++;
+            if (idx_s == size_s) break;
+            val_s = small[idx_s];
+            idx_l = advanceUntil(large, idx_l, size_l, val_s);
+            if (idx_l == size_l) break;
+            val_l = large[idx_l];
+        }
+    }
+
+    return pos;
+}
+
+/**
+ * Cardinality-only version of intersect_uint16.
+ */
+int32_t intersect_uint16_cardinality(const uint16_t *A, const size_t lenA,
+                                     const uint16_t *B, const size_t lenB) {
+    int32_t answer = 0;
+    if (lenA == 0 || lenB == 0) return 0;
+    const uint16_t *endA = A + lenA;
+    const uint16_t *endB = B + lenB;
+
+    while (1) {
+        while (*A < *B) {
+        SKIP_FIRST_COMPARE:
+            if (++A == endA) return answer;
+        }
+        while (*A > *B) {
+            if (++B == endB) return answer;
+        }
+        if (*A == *B) {
+            ++answer;
+            if (++A == endA || ++B == endB) return answer;
+        } else {
+            goto SKIP_FIRST_COMPARE;
+        }
+    }
+    return answer;  // NOTREACHED
+}
+
 /**
  * Generic intersection function. Passes unit tests.
  */
@@ -1558,3 +1624,40 @@ size_t union_uint32_card(const uint32_t *set_1, size_t size_1,
     }
     return pos;
 }
+
+size_t radix_sort_unique_uint32(uint32_t *vals, uint32_t *buffer, size_t n) {
+    if (n == 0) return 0;
+    size_t counts[4][256];
+    memset(counts, 0, sizeof(counts));
+    for (size_t i = 0; i < n; i++) {
+        const uint32_t val = vals[i];
+        counts[0][val & 0xFF]++;
+        counts[1][(val >> 8) & 0xFF]++;
+        counts[2][(val >> 16) & 0xFF]++;
+        counts[3][val >> 24]++;
+    }
+    uint32_t *src = vals, *dst = buffer;
+    for (int pass = 0; pass < 4; pass++) {
+        const int shift = pass * 8;
+        if (counts[pass][(src[0] >> shift) & 0xFF] == n) continue;
+        size_t offset = 0;
+        for (int b = 0; b < 256; b++) {
+            const size_t count = counts[pass][b];
+            counts[pass][b] = offset;
+            offset += count;
+        }
+        for (size_t i = 0; i < n; i++) {
+            const uint32_t val = src[i];
+            dst[counts[pass][(val >> shift) & 0xFF]++] = val;
+        }
+        uint32_t *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+    size_t unique = 1;
+    vals[0] = src[0];
+    for (size_t i = 1; i < n; i++) {
+        if (src[i] != vals[unique - 1]) vals[unique++] = src[i];
+    }
+    return unique;
+}
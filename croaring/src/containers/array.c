@@ -11,6 +11,7 @@
 extern inline uint16_t array_container_minimum(const array_container_t *arr) ;
 extern inline uint16_t array_container_maximum(const array_container_t *arr);
 extern inline int array_container_rank(const array_container_t *arr, uint16_t x) ;
+extern inline int array_container_index_equalorlarger(const array_container_t *arr, uint16_t x);
 extern inline bool array_container_contains(const array_container_t *arr,
                                              uint16_t pos);
 extern int array_container_cardinality(const array_container_t *array);
@@ -265,6 +266,24 @@ void array_container_intersection_inplace(array_container_t *src_1,
     }
 }
 
+/* computes the size of the intersection of array1 and array2
+ * */
+int array_container_intersection_cardinality(const array_container_t *src_1,
+                                             const array_container_t *src_2) {
+    int32_t card_1 = src_1->cardinality, card_2 = src_2->cardinality;
+    const int threshold = 64;  // subject to tuning
+    if (card_1 * threshold < card_2) {
+        return intersect_skewed_uint16_cardinality(src_1->array, card_1,
+                                                   src_2->array, card_2);
+    } else if (card_2 * threshold < card_1) {
+        return intersect_skewed_uint16_cardinality(src_2->array, card_2,
+                                                   src_1->array, card_1);
+    } else {
+        return intersect_uint16_cardinality(src_1->array, card_1,
+                                            src_2->array, card_2);
+    }
+}
+
 int array_container_to_uint32_array(void *vout,
                                     const array_container_t *cont,
                                     uint32_t base) {
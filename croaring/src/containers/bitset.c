@@ -557,8 +557,25 @@ int bitset_container_rank(const bitset_container_t *container, uint16_t x) {
   // we have that k < x, but not so large that k+63<=x
   // k is a power of 64
   int bitsleft = x32 - k + 1;// will be in [0,64)
-  uint64_t leftoverword = container->array[k / 64];// k / 64 should be within scope
+  // nothing is left when x ends a word, and for x = 0xFFFF, k / 64 is past the end
+  if (bitsleft == 0) return sum;
+  uint64_t leftoverword = container->array[k / 64];
   leftoverword = leftoverword & ((UINT64_C(1) << bitsleft) - 1);
   sum += hamming(leftoverword);
   return sum;
 }
+
+/* Returns the first value equal or larger than x, or -1 */
+int bitset_container_index_equalorlarger(const bitset_container_t *container, uint16_t x) {
+  uint32_t x32 = x;
+  uint32_t k = x32 / 64;
+  uint64_t word = container->array[k];
+  const int diff = x32 - k * 64; // in [0,64)
+  word = (word >> diff) << diff; // clears the bits below x
+  while (word == 0) {
+    k++;
+    if (k == BITSET_CONTAINER_SIZE_IN_WORDS) return -1;
+    word = container->array[k];
+  }
+  return k * 64 + __builtin_ctzll(word);
+}
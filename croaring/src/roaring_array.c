@@ -73,6 +73,7 @@ bool ra_init_with_capacity(roaring_array_t *new_ra, uint32_t cap) {
     new_ra->keys = (uint16_t *)(new_ra->containers + cap);
     new_ra->typecodes = (uint8_t *)(new_ra->keys + cap);
     new_ra->size = 0;
+    new_ra->flags = 0;
 
     return true;
 }
@@ -107,8 +108,9 @@ bool ra_copy(const roaring_array_t *source, roaring_array_t * dest, bool copy_on
     } else {
         memcpy(dest->typecodes, source->typecodes, dest->size * sizeof(uint8_t));
         for (int32_t i = 0; i < dest->size; i++) {
-            dest->containers[i] =
-                container_clone(source->containers[i], source->typecodes[i]);
+            // unwraps shared containers, fixing up the typecode accordingly
+            dest->containers[i] = get_copy_of_container(
+                source->containers[i], &dest->typecodes[i], copy_on_write);
             if (dest->containers[i] == NULL) {
                 for (int32_t j = 0; j < i; j++) {
                     container_free(dest->containers[j], dest->typecodes[j]);
@@ -143,8 +145,9 @@ bool ra_overwrite(const roaring_array_t *source, roaring_array_t * dest, bool co
     } else {
         memcpy(dest->typecodes, source->typecodes, dest->size * sizeof(uint8_t));
         for (int32_t i = 0; i < dest->size; i++) {
-            dest->containers[i] =
-                container_clone(source->containers[i], source->typecodes[i]);
+            // unwraps shared containers, fixing up the typecode accordingly
+            dest->containers[i] = get_copy_of_container(
+                source->containers[i], &dest->typecodes[i], copy_on_write);
             if (dest->containers[i] == NULL) {
                 for (int32_t j = 0; j < i; j++) {
                     container_free(dest->containers[j], dest->typecodes[j]);
@@ -214,9 +217,9 @@ void ra_append_copy(roaring_array_t *ra, const roaring_array_t *sa, uint16_t ind
         ra->containers[pos] = sa->containers[index];
         ra->typecodes[pos] = sa->typecodes[index];
     } else {
-        ra->containers[pos] =
-            container_clone(sa->containers[index], sa->typecodes[index]);
         ra->typecodes[pos] = sa->typecodes[index];
+        ra->containers[pos] = get_copy_of_container(
+            sa->containers[index], &ra->typecodes[pos], copy_on_write);
     }
     ra->size++;
 }
@@ -243,9 +246,9 @@ void ra_append_copy_range(roaring_array_t *ra, const roaring_array_t *sa,
             ra->containers[pos] = sa->containers[i];
             ra->typecodes[pos] = sa->typecodes[i];
         } else {
-            ra->containers[pos] =
-                container_clone(sa->containers[i], sa->typecodes[i]);
             ra->typecodes[pos] = sa->typecodes[i];
+            ra->containers[pos] = get_copy_of_container(
+                sa->containers[i], &ra->typecodes[pos], copy_on_write);
         }
         ra->size++;
     }
@@ -289,9 +292,9 @@ void ra_append_range(roaring_array_t *ra, roaring_array_t *sa,
             ra->containers[pos] = sa->containers[i];
             ra->typecodes[pos] = sa->typecodes[i];
         } else {
-            ra->containers[pos] =
-                container_clone(sa->containers[i], sa->typecodes[i]);
             ra->typecodes[pos] = sa->typecodes[i];
+            ra->containers[pos] = get_copy_of_container(
+                sa->containers[i], &ra->typecodes[pos], copy_on_write);
         }
         ra->size++;
     }
@@ -469,6 +472,15 @@ size_t ra_portable_size_in_bytes(const roaring_array_t *ra) {
 }
 
 size_t ra_portable_serialize(const roaring_array_t *ra, char *buf) {
+    char *initbuf = buf;
+    buf += ra_portable_serialize_header(ra, buf);
+    for (int32_t k = 0; k < ra->size; ++k) {
+        buf += container_write(ra->containers[k], ra->typecodes[k], buf);
+    }
+    return buf - initbuf;
+}
+
+size_t ra_portable_serialize_header(const roaring_array_t *ra, char *buf) {
     char *initbuf = buf;
     uint32_t startOffset = 0;
     bool hasrun = ra_has_run_container(ra);
@@ -522,9 +534,6 @@ size_t ra_portable_serialize(const roaring_array_t *ra, char *buf) {
                 container_size_in_bytes(ra->containers[k], ra->typecodes[k]);
         }
     }
-    for (int32_t k = 0; k < ra->size; ++k) {
-        buf += container_write(ra->containers[k], ra->typecodes[k], buf);
-    }
     return buf - initbuf;
 }
 
@@ -611,3 +620,369 @@ bool ra_portable_deserialize(roaring_array_t *answer, const char *buf) {
     return true;
 }
 
+static void *read_container_stream(int32_t card, uint8_t typecode,
+                                   roaring_read_callback read, void *param) {
+    if (typecode == BITSET_CONTAINER_TYPE_CODE) {
+        bitset_container_t *c = bitset_container_create();
+        if (c == NULL) return NULL;
+        if (!read(c->array, BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t),
+                  param)) {
+            bitset_container_free(c);
+            return NULL;
+        }
+        c->cardinality = bitset_container_compute_cardinality(c);
+        if (c->cardinality != card) {
+            bitset_container_free(c);
+            return NULL;
+        }
+        return c;
+    } else if (typecode == RUN_CONTAINER_TYPE_CODE) {
+        uint16_t n_runs;
+        if (!read(&n_runs, sizeof(n_runs), param) || n_runs == 0) return NULL;
+        run_container_t *c = run_container_create_given_capacity(n_runs);
+        if (c == NULL) return NULL;
+        if (!read(c->runs, n_runs * sizeof(rle16_t), param)) {
+            run_container_free(c);
+            return NULL;
+        }
+        c->n_runs = n_runs;
+        int32_t sum = 0;
+        for (int32_t i = 0; i < n_runs; ++i) {
+            const uint32_t end =
+                (uint32_t)c->runs[i].value + c->runs[i].length;
+            if (end > UINT16_MAX ||
+                (i > 0 && c->runs[i].value <=
+                              c->runs[i - 1].value + c->runs[i - 1].length)) {
+                run_container_free(c);
+                return NULL;
+            }
+            sum += c->runs[i].length + 1;
+        }
+        if (sum != card) {
+            run_container_free(c);
+            return NULL;
+        }
+        return c;
+    } else {
+        array_container_t *c = array_container_create_given_capacity(card);
+        if (c == NULL) return NULL;
+        if (!read(c->array, card * sizeof(uint16_t), param)) {
+            array_container_free(c);
+            return NULL;
+        }
+        c->cardinality = card;
+        for (int32_t i = 1; i < card; ++i) {
+            if (c->array[i] <= c->array[i - 1]) {
+                array_container_free(c);
+                return NULL;
+            }
+        }
+        return c;
+    }
+}
+
+bool ra_portable_deserialize_stream(roaring_array_t *answer,
+                                    roaring_read_callback read, void *param) {
+    // empty until the header is read, so that it can be cleared on failure
+    memset(answer, 0, sizeof(*answer));
+    uint32_t cookie;
+    if (!read(&cookie, sizeof(cookie), param)) return false;
+    if ((cookie & 0xFFFF) != SERIAL_COOKIE &&
+        cookie != SERIAL_COOKIE_NO_RUNCONTAINER) {
+        return false;
+    }
+    const bool hasrun = (cookie & 0xFFFF) == SERIAL_COOKIE;
+    int32_t size;
+    if (hasrun) {
+        size = (cookie >> 16) + 1;
+    } else {
+        if (!read(&size, sizeof(size), param)) return false;
+        if (size < 0 || size > (1 << 16)) return false;
+    }
+    if (!ra_init_with_capacity(answer, size)) return false;
+    if (size > 0 && answer->containers == NULL) return false;
+
+    // the run flags, then the keys and cardinalities, then maybe the offsets
+    const int32_t s = hasrun ? (size + 7) / 8 : 0;
+    const bool hasoffsets = (!hasrun) || (size >= NO_OFFSET_THRESHOLD);
+    const size_t header = s + size * 4 + (hasoffsets ? size * 4 : 0);
+    uint8_t *buf = (uint8_t *)malloc(header > 0 ? header : 1);
+    if (buf == NULL) return false;
+    if (!read(buf, header, param)) {
+        free(buf);
+        return false;
+    }
+    const uint8_t *bitmapOfRunContainers = buf;
+    const uint8_t *keyscards = buf + s;
+
+    bool is_ok = true;
+    for (int32_t k = 0; k < size && is_ok; ++k) {
+        uint16_t key, tmp;
+        memcpy(&key, keyscards + 4 * k, sizeof(key));
+        memcpy(&tmp, keyscards + 4 * k + 2, sizeof(tmp));
+        const int32_t card = 1 + tmp;
+        if (k > 0 && key <= answer->keys[k - 1]) {
+            is_ok = false;
+            break;
+        }
+        uint8_t typecode = card > DEFAULT_MAX_SIZE ? BITSET_CONTAINER_TYPE_CODE
+                                                   : ARRAY_CONTAINER_TYPE_CODE;
+        if (hasrun && (bitmapOfRunContainers[k / 8] & (1 << (k % 8))) != 0) {
+            typecode = RUN_CONTAINER_TYPE_CODE;
+        }
+        void *c = read_container_stream(card, typecode, read, param);
+        if (c == NULL) {
+            is_ok = false;
+            break;
+        }
+        answer->keys[k] = key;
+        answer->containers[k] = c;
+        answer->typecodes[k] = typecode;
+        answer->size = k + 1;
+    }
+    free(buf);
+    return is_ok;
+}
+
+size_t ra_portable_deserialize_size(const char *buf, const size_t maxbytes) {
+    const char *start = buf;
+    size_t bytestotal = sizeof(uint32_t);
+    if (bytestotal > maxbytes) return 0;
+    uint32_t cookie;
+    memcpy(&cookie, buf, sizeof(cookie));
+    buf += sizeof(cookie);
+    if ((cookie & 0xFFFF) != SERIAL_COOKIE &&
+        cookie != SERIAL_COOKIE_NO_RUNCONTAINER) {
+        return 0;
+    }
+    const bool hasrun = (cookie & 0xFFFF) == SERIAL_COOKIE;
+    int32_t size;
+    if (hasrun) {
+        size = (cookie >> 16) + 1;
+    } else {
+        bytestotal += sizeof(int32_t);
+        if (bytestotal > maxbytes) return 0;
+        memcpy(&size, buf, sizeof(size));
+        buf += sizeof(size);
+        if (size < 0 || size > (1 << 16)) return 0;
+    }
+    const char *bitmapOfRunContainers = NULL;
+    if (hasrun) {
+        const int32_t s = (size + 7) / 8;
+        bytestotal += s;
+        if (bytestotal > maxbytes) return 0;
+        bitmapOfRunContainers = buf;
+        buf += s;
+    }
+    const char *keyscards = buf;
+    bytestotal += size * 4;
+    if (bytestotal > maxbytes) return 0;
+    buf += size * 4;
+    const char *offsets = NULL;
+    if ((!hasrun) || (size >= NO_OFFSET_THRESHOLD)) {
+        bytestotal += size * 4;
+        if (bytestotal > maxbytes) return 0;
+        offsets = buf;
+        buf += size * 4;
+    }
+
+    for (int32_t k = 0; k < size; ++k) {
+        uint16_t key, prevkey, tmp;
+        memcpy(&key, keyscards + 4 * k, sizeof(key));
+        memcpy(&tmp, keyscards + 4 * k + 2, sizeof(tmp));
+        if (k > 0) {
+            memcpy(&prevkey, keyscards + 4 * (k - 1), sizeof(prevkey));
+            if (key <= prevkey) return 0;
+        }
+        if (offsets != NULL) {
+            uint32_t offset;
+            memcpy(&offset, offsets + 4 * k, sizeof(offset));
+            if (offset != (uint32_t)(buf - start)) return 0;
+        }
+        const int32_t card = 1 + tmp;
+        if (bitmapOfRunContainers != NULL &&
+            (bitmapOfRunContainers[k / 8] & (1 << (k % 8))) != 0) {
+            uint16_t n_runs;
+            bytestotal += sizeof(n_runs);
+            if (bytestotal > maxbytes) return 0;
+            memcpy(&n_runs, buf, sizeof(n_runs));
+            buf += sizeof(n_runs);
+            bytestotal += n_runs * sizeof(rle16_t);
+            if (bytestotal > maxbytes) return 0;
+            int32_t sum = 0;
+            uint32_t next = 0;  // smallest value the next run may start at
+            for (int32_t i = 0; i < n_runs; ++i) {
+                rle16_t run;
+                memcpy(&run, buf + i * sizeof(rle16_t), sizeof(run));
+                if (run.value < next ||
+                    (uint32_t)run.value + run.length > UINT16_MAX) {
+                    return 0;
+                }
+                next = (uint32_t)run.value + run.length + 1;
+                sum += run.length + 1;
+            }
+            if (sum != card) return 0;
+            buf += n_runs * sizeof(rle16_t);
+        } else if (card > DEFAULT_MAX_SIZE) {
+            const size_t words = BITSET_CONTAINER_SIZE_IN_WORDS;
+            bytestotal += words * sizeof(uint64_t);
+            if (bytestotal > maxbytes) return 0;
+            int32_t sum = 0;
+            for (size_t i = 0; i < words; ++i) {
+                uint64_t word;
+                memcpy(&word, buf + i * sizeof(word), sizeof(word));
+                sum += hamming(word);
+            }
+            if (sum != card) return 0;
+            buf += words * sizeof(uint64_t);
+        } else {
+            bytestotal += card * sizeof(uint16_t);
+            if (bytestotal > maxbytes) return 0;
+            uint16_t prev, value;
+            memcpy(&prev, buf, sizeof(prev));
+            for (int32_t i = 1; i < card; ++i) {
+                memcpy(&value, buf + i * sizeof(value), sizeof(value));
+                if (value <= prev) return 0;
+                prev = value;
+            }
+            buf += card * sizeof(uint16_t);
+        }
+    }
+    return bytestotal;
+}
+
+static inline bool portable_is_run(const char *bitmapOfRunContainers,
+                                   int32_t k) {
+    return bitmapOfRunContainers != NULL &&
+           (bitmapOfRunContainers[k / 8] & (1 << (k % 8))) != 0;
+}
+
+static inline int32_t portable_card(const char *keyscards, int32_t k) {
+    uint16_t tmp;
+    memcpy(&tmp, keyscards + 4 * k + 2, sizeof(tmp));
+    return 1 + tmp;
+}
+
+uint64_t ra_portable_cardinality(const char *buf) {
+    uint32_t cookie;
+    memcpy(&cookie, buf, sizeof(cookie));
+    buf += sizeof(cookie);
+    int32_t size;
+    if ((cookie & 0xFFFF) == SERIAL_COOKIE) {
+        size = (cookie >> 16) + 1;
+        buf += (size + 7) / 8;
+    } else {
+        memcpy(&size, buf, sizeof(size));
+        buf += sizeof(size);
+    }
+    uint64_t card = 0;
+    for (int32_t k = 0; k < size; ++k) card += portable_card(buf, k);
+    return card;
+}
+
+bool ra_portable_contains(const char *buf, uint32_t x) {
+    const char *start = buf;
+    const uint16_t hb = x >> 16;
+    const uint16_t lb = x & 0xFFFF;
+    uint32_t cookie;
+    memcpy(&cookie, buf, sizeof(cookie));
+    buf += sizeof(cookie);
+    const bool hasrun = (cookie & 0xFFFF) == SERIAL_COOKIE;
+    int32_t size;
+    if (hasrun) {
+        size = (cookie >> 16) + 1;
+    } else {
+        memcpy(&size, buf, sizeof(size));
+        buf += sizeof(size);
+    }
+    const char *bitmapOfRunContainers = NULL;
+    if (hasrun) {
+        bitmapOfRunContainers = buf;
+        buf += (size + 7) / 8;
+    }
+    const char *keyscards = buf;
+    buf += size * 4;
+    const bool hasoffsets = (!hasrun) || (size >= NO_OFFSET_THRESHOLD);
+
+    // binary search over the keys of the header
+    int32_t low = 0, high = size - 1, k = -1;
+    while (low <= high) {
+        const int32_t middle = (low + high) >> 1;
+        uint16_t key;
+        memcpy(&key, keyscards + 4 * middle, sizeof(key));
+        if (key < hb) {
+            low = middle + 1;
+        } else if (key > hb) {
+            high = middle - 1;
+        } else {
+            k = middle;
+            break;
+        }
+    }
+    if (k < 0) return false;
+
+    const char *container;
+    if (hasoffsets) {
+        uint32_t offset;
+        memcpy(&offset, buf + 4 * k, sizeof(offset));
+        container = start + offset;
+    } else {
+        // without offsets there are fewer than NO_OFFSET_THRESHOLD containers
+        container = buf;
+        for (int32_t i = 0; i < k; ++i) {
+            const int32_t card = portable_card(keyscards, i);
+            if (portable_is_run(bitmapOfRunContainers, i)) {
+                uint16_t n_runs;
+                memcpy(&n_runs, container, sizeof(n_runs));
+                container += sizeof(n_runs) + n_runs * sizeof(rle16_t);
+            } else if (card > DEFAULT_MAX_SIZE) {
+                container += BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t);
+            } else {
+                container += card * sizeof(uint16_t);
+            }
+        }
+    }
+
+    const int32_t card = portable_card(keyscards, k);
+    if (portable_is_run(bitmapOfRunContainers, k)) {
+        uint16_t n_runs;
+        memcpy(&n_runs, container, sizeof(n_runs));
+        container += sizeof(n_runs);
+        // last run starting at or before lb
+        int32_t lo = 0, hi = n_runs - 1, found = -1;
+        while (lo <= hi) {
+            const int32_t middle = (lo + hi) >> 1;
+            rle16_t run;
+            memcpy(&run, container + middle * sizeof(rle16_t), sizeof(run));
+            if (run.value <= lb) {
+                found = middle;
+                lo = middle + 1;
+            } else {
+                hi = middle - 1;
+            }
+        }
+        if (found < 0) return false;
+        rle16_t run;
+        memcpy(&run, container + found * sizeof(rle16_t), sizeof(run));
+        return lb - run.value <= run.length;
+    } else if (card > DEFAULT_MAX_SIZE) {
+        // the words are little endian, so bit i lives in byte i / 8
+        return ((uint8_t)container[lb / 8] >> (lb % 8)) & 1;
+    } else {
+        int32_t lo = 0, hi = card - 1;
+        while (lo <= hi) {
+            const int32_t middle = (lo + hi) >> 1;
+            uint16_t value;
+            memcpy(&value, container + middle * sizeof(value), sizeof(value));
+            if (value < lb) {
+                lo = middle + 1;
+            } else if (value > lb) {
+                hi = middle - 1;
+            } else {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
@@ -0,0 +1,268 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <roaring/roaring.h>
+#include <roaring/roaring_array.h>
+
+#ifndef _MSC_VER
+#include <pthread.h>
+#define ROARING_HAVE_THREADS
+#endif
+
+/* below this many containers per range, a thread costs more than it saves */
+#define PARALLEL_MIN_CONTAINERS 256
+
+typedef enum {
+    PARALLEL_AND,
+    PARALLEL_OR,
+    PARALLEL_XOR,
+    PARALLEL_ANDNOT,
+    PARALLEL_OR_MANY
+} parallel_op_t;
+
+/* one key range [begin, end) of the operation, computed by one thread */
+typedef struct parallel_task_s {
+    parallel_op_t op;
+    size_t number;
+    const roaring_bitmap_t **x;
+    uint32_t begin;
+    uint32_t end;
+    roaring_bitmap_t *result;
+} parallel_task_t;
+
+/* index of the first key >= key, key being at most 1 << 16 */
+static int32_t key_lower_bound(const roaring_array_t *ra, uint32_t key) {
+    if (key > UINT16_MAX) return ra->size;
+    int32_t i = ra_get_index(ra, (uint16_t)key);
+    return i >= 0 ? i : -i - 1;
+}
+
+/*
+ * Points 'view' at the containers of x within the key range, without copying
+ * anything. The view must not be freed or modified.
+ */
+static void make_view(const roaring_bitmap_t *x, uint32_t begin, uint32_t end,
+                      roaring_bitmap_t *view) {
+    const roaring_array_t *ra = &x->high_low_container;
+    const int32_t start = key_lower_bound(ra, begin);
+    const int32_t stop = key_lower_bound(ra, end);
+    view->high_low_container.size = stop - start;
+    view->high_low_container.allocation_size = stop - start;
+    view->high_low_container.keys = ra->keys + start;
+    view->high_low_container.containers = ra->containers + start;
+    view->high_low_container.typecodes = ra->typecodes + start;
+    view->high_low_container.flags = ra->flags;
+    view->copy_on_write = x->copy_on_write;
+}
+
+static void *parallel_run(void *arg) {
+    parallel_task_t *task = (parallel_task_t *)arg;
+    roaring_bitmap_t pair[2];
+    roaring_bitmap_t *views = pair;
+    const roaring_bitmap_t **ptrs = NULL;
+
+    if (task->number > 2) {
+        views = (roaring_bitmap_t *)malloc(task->number * sizeof(roaring_bitmap_t));
+        ptrs = (const roaring_bitmap_t **)malloc(task->number *
+                                                 sizeof(roaring_bitmap_t *));
+        if (views == NULL || ptrs == NULL) {
+            free(views);
+            free(ptrs);
+            task->result = NULL;
+            return NULL;
+        }
+    }
+    for (size_t i = 0; i < task->number; ++i) {
+        make_view(task->x[i], task->begin, task->end, &views[i]);
+        if (ptrs != NULL) ptrs[i] = &views[i];
+    }
+
+    switch (task->op) {
+        case PARALLEL_AND:
+            task->result = roaring_bitmap_and(&views[0], &views[1]);
+            break;
+        case PARALLEL_OR:
+            task->result = roaring_bitmap_or(&views[0], &views[1]);
+            break;
+        case PARALLEL_XOR:
+            task->result = roaring_bitmap_xor(&views[0], &views[1]);
+            break;
+        case PARALLEL_ANDNOT:
+            task->result = roaring_bitmap_andnot(&views[0], &views[1]);
+            break;
+        case PARALLEL_OR_MANY:
+            if (ptrs != NULL) {
+                task->result = roaring_bitmap_or_many(task->number, ptrs);
+            } else {
+                const roaring_bitmap_t *two[2] = {&views[0], &views[1]};
+                task->result = roaring_bitmap_or_many(task->number, two);
+            }
+            break;
+    }
+
+    if (views != pair) {
+        free(views);
+        free(ptrs);
+    }
+    return NULL;
+}
+
+/*
+ * Chooses the end of every range so that each holds about as many input
+ * containers: the boundary is the smallest key with enough containers below
+ * it, found by bisecting the key space.
+ */
+static void split_key_space(size_t number, const roaring_bitmap_t **x,
+                            uint64_t total, int parts, uint32_t *ends) {
+    uint32_t lo = 0;
+    for (int p = 1; p < parts; ++p) {
+        const uint64_t target = total * p / parts;
+        uint32_t hi = 1 << 16;
+        while (lo < hi) {
+            const uint32_t mid = lo + (hi - lo) / 2;
+            uint64_t below = 0;
+            for (size_t i = 0; i < number; ++i) {
+                below += key_lower_bound(&x[i]->high_low_container, mid);
+            }
+            if (below >= target) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        ends[p - 1] = lo;
+    }
+    ends[parts - 1] = 1 << 16;
+}
+
+/* moves the containers of the partial results, in order, into one bitmap */
+static roaring_bitmap_t *stitch(parallel_task_t *tasks, int parts) {
+    int32_t size = 0;
+    for (int p = 0; p < parts; ++p) {
+        size += tasks[p].result->high_low_container.size;
+    }
+    roaring_bitmap_t *answer = roaring_bitmap_create_with_capacity(size);
+    if (answer == NULL) return NULL;
+    roaring_array_t *ra = &answer->high_low_container;
+    answer->copy_on_write = tasks[0].result->copy_on_write;
+
+    for (int p = 0; p < parts; ++p) {
+        roaring_array_t *part = &tasks[p].result->high_low_container;
+        memcpy(ra->keys + ra->size, part->keys, part->size * sizeof(uint16_t));
+        memcpy(ra->containers + ra->size, part->containers,
+               part->size * sizeof(void *));
+        memcpy(ra->typecodes + ra->size, part->typecodes,
+               part->size * sizeof(uint8_t));
+        ra->size += part->size;
+        ra_clear_without_containers(part);
+        free(tasks[p].result);
+        tasks[p].result = NULL;
+    }
+    return answer;
+}
+
+static roaring_bitmap_t *parallel_op(parallel_op_t op, size_t number,
+                                     const roaring_bitmap_t **x, int threads) {
+    uint64_t total = 0;
+    for (size_t i = 0; i < number; ++i) {
+        total += x[i]->high_low_container.size;
+    }
+    int parts = threads;
+    if ((uint64_t)parts > total / PARALLEL_MIN_CONTAINERS) {
+        parts = (int)(total / PARALLEL_MIN_CONTAINERS);
+    }
+    if (parts > (1 << 16)) parts = 1 << 16;
+    if (parts <= 1) return NULL;
+
+    parallel_task_t *tasks =
+        (parallel_task_t *)calloc(parts, sizeof(parallel_task_t));
+    uint32_t *ends = (uint32_t *)malloc(parts * sizeof(uint32_t));
+    if (tasks == NULL || ends == NULL) {
+        free(tasks);
+        free(ends);
+        return NULL;
+    }
+    split_key_space(number, x, total, parts, ends);
+    for (int p = 0; p < parts; ++p) {
+        tasks[p].op = op;
+        tasks[p].number = number;
+        tasks[p].x = x;
+        tasks[p].begin = p == 0 ? 0 : ends[p - 1];
+        tasks[p].end = ends[p];
+    }
+    free(ends);
+
+#ifdef ROARING_HAVE_THREADS
+    pthread_t *workers = (pthread_t *)malloc(parts * sizeof(pthread_t));
+    bool *started = (bool *)calloc(parts, sizeof(bool));
+    if (workers != NULL && started != NULL) {
+        for (int p = 1; p < parts; ++p) {
+            started[p] =
+                pthread_create(&workers[p], NULL, parallel_run, &tasks[p]) == 0;
+        }
+    }
+    parallel_run(&tasks[0]);
+    for (int p = 1; p < parts; ++p) {
+        // ranges that did not get a thread are done by the caller
+        if (started != NULL && started[p]) {
+            pthread_join(workers[p], NULL);
+        } else {
+            parallel_run(&tasks[p]);
+        }
+    }
+    free(workers);
+    free(started);
+#else
+    for (int p = 0; p < parts; ++p) parallel_run(&tasks[p]);
+#endif
+
+    roaring_bitmap_t *answer = NULL;
+    bool complete = true;
+    for (int p = 0; p < parts; ++p) complete &= tasks[p].result != NULL;
+    if (complete) answer = stitch(tasks, parts);
+    for (int p = 0; p < parts; ++p) {
+        if (tasks[p].result != NULL) roaring_bitmap_free(tasks[p].result);
+    }
+    free(tasks);
+    return answer;
+}
+
+roaring_bitmap_t *roaring_bitmap_and_parallel(const roaring_bitmap_t *x1,
+                                              const roaring_bitmap_t *x2,
+                                              int threads) {
+    const roaring_bitmap_t *x[2] = {x1, x2};
+    roaring_bitmap_t *answer = parallel_op(PARALLEL_AND, 2, x, threads);
+    return answer != NULL ? answer : roaring_bitmap_and(x1, x2);
+}
+
+roaring_bitmap_t *roaring_bitmap_or_parallel(const roaring_bitmap_t *x1,
+                                             const roaring_bitmap_t *x2,
+                                             int threads) {
+    const roaring_bitmap_t *x[2] = {x1, x2};
+    roaring_bitmap_t *answer = parallel_op(PARALLEL_OR, 2, x, threads);
+    return answer != NULL ? answer : roaring_bitmap_or(x1, x2);
+}
+
+roaring_bitmap_t *roaring_bitmap_xor_parallel(const roaring_bitmap_t *x1,
+                                              const roaring_bitmap_t *x2,
+                                              int threads) {
+    const roaring_bitmap_t *x[2] = {x1, x2};
+    roaring_bitmap_t *answer = parallel_op(PARALLEL_XOR, 2, x, threads);
+    return answer != NULL ? answer : roaring_bitmap_xor(x1, x2);
+}
+
+roaring_bitmap_t *roaring_bitmap_andnot_parallel(const roaring_bitmap_t *x1,
+                                                 const roaring_bitmap_t *x2,
+                                                 int threads) {
+    const roaring_bitmap_t *x[2] = {x1, x2};
+    roaring_bitmap_t *answer = parallel_op(PARALLEL_ANDNOT, 2, x, threads);
+    return answer != NULL ? answer : roaring_bitmap_andnot(x1, x2);
+}
+
+roaring_bitmap_t *roaring_bitmap_or_many_parallel(size_t number,
+                                                  const roaring_bitmap_t **x,
+                                                  int threads) {
+    roaring_bitmap_t *answer = NULL;
+    if (number > 1) answer = parallel_op(PARALLEL_OR_MANY, number, x, threads);
+    return answer != NULL ? answer : roaring_bitmap_or_many(number, x);
+}
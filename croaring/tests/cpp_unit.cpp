@@ -8,6 +8,7 @@
 #include <string.h>
 #include <time.h>
 #include <iostream>
+#include <vector>
 #include <roaring/roaring.h>
 #include "roaring.hh"
 #include "roaring64map.hh"
@@ -190,6 +191,8 @@ void test_example_cpp(bool copy_on_write) {
     const Roaring *allmybitmaps[] = {&r1, &r2, &r3};
     Roaring bigunion = Roaring::fastunion(3, allmybitmaps);
     assert_true(r1_2_3 == bigunion);
+    Roaring threadedunion = Roaring::fastunion(3, allmybitmaps, 4);
+    assert_true(r1_2_3 == threadedunion);
 
     // we can compute intersection two-by-two
     Roaring i1_2 = r1 & r2;
@@ -218,6 +221,24 @@ void test_example_cpp(bool copy_on_write) {
        ++counter;
      }
      assert_true(counter == t.cardinality());
+
+     // or skip to a value and read many at once
+     Roaring many;
+     for (uint32_t i = 100; i < 1000; i++) {
+         many.add(i);
+     }
+     Roaring::const_iterator it = many.begin();
+     it.equalorlarger(500);
+     uint32_t buf[1000];
+     assert_true(it.read(buf, 1000) == 500);
+     assert_true(buf[0] == 500 && buf[499] == 999);
+     assert_true(it == many.end());
+
+     // sorted new values can be appended
+     uint32_t next[] = {1000, 1001, 5000};
+     assert_true(many.appendMany(3, next));
+     assert_false(many.appendMany(3, next));
+     assert_true(many.cardinality() == 903);
 }
 
 void test_example_cpp_64(bool copy_on_write) {
@@ -332,6 +353,51 @@ void test_example_cpp_64_true(void **) { test_example_cpp_64(true); }
 
 void test_example_cpp_64_false(void **) { test_example_cpp_64(false); }
 
+void test_fastunion_parallel(void **) {
+    // enough containers for every thread to get a range
+    Roaring r[3];
+    for (uint32_t k = 0; k < 3000; ++k) {
+        for (uint32_t j = 0; j < 3; ++j) {
+            if ((k + j) % 4 != 0) r[j].add((k << 16) + j * 7 + (k % 100));
+        }
+        if (k % 5 == 0) {
+            const uint32_t run[] = {k << 16, (k << 16) + 1, (k << 16) + 2};
+            r[k % 3].addMany(3, run);
+        }
+    }
+    const Roaring *inputs[] = {&r[0], &r[1], &r[2]};
+    Roaring serial = Roaring::fastunion(3, inputs);
+    Roaring threaded = Roaring::fastunion(3, inputs, 8);
+    assert_true(serial == threaded);
+    assert_true(serial == (r[0] | r[1] | r[2]));
+}
+
+void test_frozen_view(void **) {
+    Roaring r;
+    for (uint32_t k = 0; k < 100; ++k) {
+        r.add(k * 3);
+        r.add((1 << 16) + k);
+        r.add((k << 16) + 2);
+    }
+    for (uint32_t k = 0; k < 10000; ++k) r.add((200 << 16) + k * 2);
+    r.runOptimize();
+
+    const size_t size = r.getFrozenSizeInBytes();
+    std::vector<char> storage(size + 31);
+    char *buf = (char *)(((uintptr_t)storage.data() + 31) & ~(uintptr_t)31);
+    r.writeFrozen(buf);
+    const Roaring view = Roaring::frozenView(buf, size);
+    assert_true(view == r);
+    assert_true(view.contains((200 << 16) + 2));
+    assert_false(view.contains((200 << 16) + 3));
+    assert_true((view | r) == r);
+    assert_true((view & r) == r);
+    Roaring copy(view);
+    copy.add(1);
+    assert_true(copy.contains(1));
+    assert_false(view.contains(1));
+}
+
 int main() {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_example_true),
@@ -339,7 +405,9 @@ int main() {
         cmocka_unit_test(test_example_cpp_true),
         cmocka_unit_test(test_example_cpp_false),
         cmocka_unit_test(test_example_cpp_64_true),
-        cmocka_unit_test(test_example_cpp_64_false)};
+        cmocka_unit_test(test_example_cpp_64_false),
+        cmocka_unit_test(test_fastunion_parallel),
+        cmocka_unit_test(test_frozen_view)};
 
     return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -2595,6 +2595,32 @@ static uint64_t rank(uint32_t * arr, size_t length, uint32_t x) {
 }
 
 
+// flipping up to the last container must stop there
+void test_flip_last_container() {
+    const uint64_t start = UINT64_C(0xFFFD) << 16, end = UINT64_C(1) << 32;
+    roaring_bitmap_t *r = roaring_bitmap_of(2, 5, 0xFFFE0001);
+    roaring_bitmap_t *flipped = roaring_bitmap_flip(r, start, end);
+    assert_int_equal(roaring_bitmap_get_cardinality(flipped), 1 + (3 << 16) - 1);
+    assert_false(roaring_bitmap_contains(flipped, 0xFFFE0001));
+    assert_true(roaring_bitmap_contains(flipped, 0xFFFFFFFF));
+    roaring_bitmap_flip_inplace(r, start, end);
+    assert_true(roaring_bitmap_equals(r, flipped));
+    roaring_bitmap_free(flipped);
+    roaring_bitmap_free(r);
+}
+
+// the rank of the last value of a bitset container reads no word past its end
+void test_rank_bitset_last_value() {
+    roaring_bitmap_t *r = roaring_bitmap_create();
+    for (uint32_t v = 0; v < 10000; v += 2) roaring_bitmap_add(r, v);
+    roaring_bitmap_add(r, 0xFFFF);
+    assert_int_equal(r->high_low_container.typecodes[0],
+                     BITSET_CONTAINER_TYPE_CODE);
+    assert_int_equal(roaring_bitmap_rank(r, 0xFFFF), 5001);
+    assert_int_equal(roaring_bitmap_rank(r, 0xFFFE), 5000);
+    roaring_bitmap_free(r);
+}
+
 void test_rank() {
     for(uint32_t mymin = 123; mymin < 1000000; mymin *=2) {
       // just arrays
@@ -2702,9 +2728,918 @@ void test_subset() {
     roaring_bitmap_free(rb2);
 }
 
+// builds a bitmap mixing array, bitset and run containers
+static roaring_bitmap_t *make_mixed_bitmap(uint32_t seed) {
+    roaring_bitmap_t *r = roaring_bitmap_create();
+    srand(seed);
+    for (uint32_t k = 0; k < 12; ++k) {
+        uint32_t base = ((k * 3 + seed) % 16) << 16;
+        switch ((k + seed) % 4) {
+            case 0:  // sparse
+                for (int i = 0; i < 500; ++i)
+                    roaring_bitmap_add(r, base + (rand() & 0xFFFF));
+                break;
+            case 1:  // dense
+                for (int i = 0; i < 20000; ++i)
+                    roaring_bitmap_add(r, base + (rand() & 0xFFFF));
+                break;
+            case 2:  // runs
+                for (uint32_t i = 0; i < 40; ++i) {
+                    uint32_t start = (uint32_t)(rand() & 0xFFFF);
+                    for (uint32_t j = start; j < start + 300 && j < 0x10000;
+                         ++j)
+                        roaring_bitmap_add(r, base + j);
+                }
+                break;
+            default:  // left empty
+                break;
+        }
+    }
+    roaring_bitmap_run_optimize(r);
+    return r;
+}
+
+void test_cardinality_operations() {
+    roaring_bitmap_t *bitmaps[5];
+    for (uint32_t i = 0; i < 5; ++i) bitmaps[i] = make_mixed_bitmap(i);
+
+    for (int i = 0; i < 5; ++i) {
+        for (int j = 0; j < 5; ++j) {
+            roaring_bitmap_t *x1 = bitmaps[i], *x2 = bitmaps[j];
+            roaring_bitmap_t *r = roaring_bitmap_and(x1, x2);
+            assert_int_equal(roaring_bitmap_get_cardinality(r),
+                             roaring_bitmap_and_cardinality(x1, x2));
+            roaring_bitmap_free(r);
+            r = roaring_bitmap_or(x1, x2);
+            assert_int_equal(roaring_bitmap_get_cardinality(r),
+                             roaring_bitmap_or_cardinality(x1, x2));
+            roaring_bitmap_free(r);
+            r = roaring_bitmap_xor(x1, x2);
+            assert_int_equal(roaring_bitmap_get_cardinality(r),
+                             roaring_bitmap_xor_cardinality(x1, x2));
+            roaring_bitmap_free(r);
+            r = roaring_bitmap_andnot(x1, x2);
+            assert_int_equal(roaring_bitmap_get_cardinality(r),
+                             roaring_bitmap_andnot_cardinality(x1, x2));
+            roaring_bitmap_free(r);
+        }
+    }
+
+    // every split of the five bitmaps into inclusions and exclusions
+    for (int mask = 0; mask < 32; ++mask) {
+        const roaring_bitmap_t *include[5], *exclude[5];
+        size_t ninclude = 0, nexclude = 0;
+        for (int i = 0; i < 5; ++i) {
+            if (mask & (1 << i))
+                include[ninclude++] = bitmaps[i];
+            else
+                exclude[nexclude++] = bitmaps[i];
+        }
+        roaring_bitmap_t *expected = roaring_bitmap_or_many(ninclude, include);
+        for (size_t i = 0; i < nexclude; ++i)
+            roaring_bitmap_andnot_inplace(expected, exclude[i]);
+        assert_int_equal(roaring_bitmap_get_cardinality(expected),
+                         roaring_bitmap_or_many_andnot_cardinality(
+                             ninclude, include, nexclude, exclude));
+        roaring_bitmap_free(expected);
+    }
+
+    for (int i = 0; i < 5; ++i) roaring_bitmap_free(bitmaps[i]);
+}
+
+// a plain copy of a bitmap holding shared containers must not stay shared
+void test_copy_of_shared_containers() {
+    roaring_bitmap_t *r1 = make_mixed_bitmap(3);
+    r1->copy_on_write = true;
+    roaring_bitmap_t *r2 = roaring_bitmap_copy(r1);
+    r2->copy_on_write = false;
+    roaring_bitmap_t *r3 = roaring_bitmap_copy(r2);
+    roaring_bitmap_t *r4 = roaring_bitmap_or(r2, r2);
+    for (int i = 0; i < r3->high_low_container.size; ++i) {
+        assert_int_not_equal(r3->high_low_container.typecodes[i],
+                             SHARED_CONTAINER_TYPE_CODE);
+    }
+    for (int i = 0; i < r4->high_low_container.size; ++i) {
+        assert_int_not_equal(r4->high_low_container.typecodes[i],
+                             SHARED_CONTAINER_TYPE_CODE);
+    }
+    assert_true(roaring_bitmap_equals(r1, r3));
+    assert_true(roaring_bitmap_equals(r1, r4));
+    roaring_bitmap_add(r3, 1);
+    roaring_bitmap_free(r4);
+    roaring_bitmap_free(r3);
+    roaring_bitmap_free(r2);
+    roaring_bitmap_free(r1);
+}
+
+// bitmaps spanning thousands of keys, so that every thread gets a range
+static roaring_bitmap_t *make_wide_bitmap(uint32_t seed) {
+    roaring_bitmap_t *r = roaring_bitmap_create();
+    for (uint32_t k = seed; k < 5000; k += 1 + (k + seed) % 3) {
+        const uint32_t base = k << 16;
+        if (k % 7 == 0) {
+            for (uint32_t i = 0; i < 5000; ++i) roaring_bitmap_add(r, base + i * 13);
+        } else if (k % 7 == 1) {
+            for (uint32_t i = 100; i < 2000; ++i) roaring_bitmap_add(r, base + i);
+        } else {
+            for (uint32_t i = 0; i < 20; ++i) roaring_bitmap_add(r, base + i * (k % 50 + seed));
+        }
+    }
+    roaring_bitmap_run_optimize(r);
+    return r;
+}
+
+void parallel_operations(bool copy_on_write) {
+    roaring_bitmap_t *r1 = make_wide_bitmap(0);
+    roaring_bitmap_t *r2 = make_wide_bitmap(1);
+    roaring_bitmap_t *r3 = make_wide_bitmap(2);
+    r1->copy_on_write = copy_on_write;
+    r2->copy_on_write = copy_on_write;
+    r3->copy_on_write = copy_on_write;
+    const roaring_bitmap_t *all[] = {r1, r2, r3};
+
+    for (int threads = 1; threads <= 9; threads += 4) {
+        roaring_bitmap_t *serial = roaring_bitmap_and(r1, r2);
+        roaring_bitmap_t *parallel = roaring_bitmap_and_parallel(r1, r2, threads);
+        assert_true(roaring_bitmap_equals(serial, parallel));
+        roaring_bitmap_free(serial);
+        roaring_bitmap_free(parallel);
+
+        serial = roaring_bitmap_or(r1, r2);
+        parallel = roaring_bitmap_or_parallel(r1, r2, threads);
+        assert_true(roaring_bitmap_equals(serial, parallel));
+        roaring_bitmap_free(serial);
+        roaring_bitmap_free(parallel);
+
+        serial = roaring_bitmap_xor(r1, r2);
+        parallel = roaring_bitmap_xor_parallel(r1, r2, threads);
+        assert_true(roaring_bitmap_equals(serial, parallel));
+        roaring_bitmap_free(serial);
+        roaring_bitmap_free(parallel);
+
+        serial = roaring_bitmap_andnot(r1, r2);
+        parallel = roaring_bitmap_andnot_parallel(r1, r2, threads);
+        assert_true(roaring_bitmap_equals(serial, parallel));
+        roaring_bitmap_free(serial);
+        roaring_bitmap_free(parallel);
+
+        serial = roaring_bitmap_or_many(3, all);
+        parallel = roaring_bitmap_or_many_parallel(3, all, threads);
+        assert_true(roaring_bitmap_equals(serial, parallel));
+        // the result owns its containers, the inputs can go independently
+        roaring_bitmap_add(parallel, UINT32_MAX);
+        assert_false(roaring_bitmap_contains(r1, UINT32_MAX));
+        roaring_bitmap_free(serial);
+        roaring_bitmap_free(parallel);
+    }
+
+    roaring_bitmap_free(r1);
+    roaring_bitmap_free(r2);
+    roaring_bitmap_free(r3);
+}
+
+void test_parallel_operations_true() { parallel_operations(true); }
+
+void test_parallel_operations_false() { parallel_operations(false); }
+
+// the portable header followed by the containers is the portable format
+void test_portable_serialize_header() {
+    roaring_bitmap_t *bitmaps[] = {roaring_bitmap_create(),
+                                   roaring_bitmap_of(2, 1, 100000),
+                                   make_mixed_bitmap(5), make_wide_bitmap(3)};
+    roaring_bitmap_run_optimize(bitmaps[1]);
+    for (size_t i = 0; i < sizeof(bitmaps) / sizeof(bitmaps[0]); ++i) {
+        roaring_bitmap_t *r = bitmaps[i];
+        const size_t size = roaring_bitmap_portable_size_in_bytes(r);
+        char *expected = (char *)malloc(size);
+        char *actual = (char *)malloc(size);
+        assert_int_equal(roaring_bitmap_portable_serialize(r, expected), size);
+
+        size_t header = roaring_bitmap_portable_serialize_header(r, actual);
+        assert_int_equal(header, roaring_bitmap_portable_header_size_in_bytes(r));
+        char *buf = actual + header;
+        for (int32_t k = 0; k < r->high_low_container.size; ++k) {
+            buf += container_write(r->high_low_container.containers[k],
+                                   r->high_low_container.typecodes[k], buf);
+        }
+        assert_int_equal(buf - actual, size);
+        assert_memory_equal(expected, actual, size);
+        free(expected);
+        free(actual);
+        roaring_bitmap_free(r);
+    }
+}
+
+typedef struct {
+    const char *buf;
+    size_t len;
+} read_stream_t;
+
+static bool read_stream(void *buf, size_t len, void *param) {
+    read_stream_t *stream = (read_stream_t *)param;
+    if (len > stream->len) return false;
+    memcpy(buf, stream->buf, len);
+    stream->buf += len;
+    stream->len -= len;
+    return true;
+}
+
+void test_portable_deserialize_stream() {
+    roaring_bitmap_t *bitmaps[] = {roaring_bitmap_create(),
+                                   roaring_bitmap_of(2, 1, 100000),
+                                   make_mixed_bitmap(5), make_wide_bitmap(3)};
+    roaring_bitmap_run_optimize(bitmaps[1]);
+    for (size_t i = 0; i < sizeof(bitmaps) / sizeof(bitmaps[0]); ++i) {
+        roaring_bitmap_t *r = bitmaps[i];
+        const size_t size = roaring_bitmap_portable_size_in_bytes(r);
+        char *buf = (char *)malloc(size);
+        roaring_bitmap_portable_serialize(r, buf);
+
+        read_stream_t stream = {buf, size};
+        roaring_bitmap_t *t =
+            roaring_bitmap_portable_deserialize_stream(read_stream, &stream);
+        assert_non_null(t);
+        assert_int_equal(stream.len, 0);
+        assert_true(roaring_bitmap_equals(r, t));
+        roaring_bitmap_free(t);
+
+        // every truncated input is rejected
+        for (size_t len = 0; len < size; len += 1 + len / 3) {
+            read_stream_t truncated = {buf, len};
+            assert_null(roaring_bitmap_portable_deserialize_stream(
+                read_stream, &truncated));
+        }
+        free(buf);
+        roaring_bitmap_free(r);
+    }
+
+    // values out of order
+    roaring_bitmap_t *r = roaring_bitmap_of(3, 1, 2, 3);
+    const size_t size = roaring_bitmap_portable_size_in_bytes(r);
+    char *buf = (char *)malloc(size);
+    roaring_bitmap_portable_serialize(r, buf);
+    const uint16_t swapped[3] = {2, 1, 3};
+    memcpy(buf + size - sizeof(swapped), swapped, sizeof(swapped));
+    read_stream_t stream = {buf, size};
+    assert_null(roaring_bitmap_portable_deserialize_stream(read_stream, &stream));
+
+    // unknown cookie
+    memset(buf, 0, size);
+    stream.buf = buf;
+    stream.len = size;
+    assert_null(roaring_bitmap_portable_deserialize_stream(read_stream, &stream));
+    free(buf);
+    roaring_bitmap_free(r);
+}
+
+void test_portable_contains() {
+    // three containers with a run one: no offsets in the header
+    roaring_bitmap_t *few = roaring_bitmap_from_range(10, 5000, 1);
+    roaring_bitmap_add(few, 70000);
+    roaring_bitmap_add(few, 70002);
+    roaring_bitmap_add(few, 200000);
+    roaring_bitmap_run_optimize(few);
+    roaring_bitmap_t *bitmaps[] = {roaring_bitmap_create(), few,
+                                   make_mixed_bitmap(5), make_wide_bitmap(3)};
+    for (size_t i = 0; i < sizeof(bitmaps) / sizeof(bitmaps[0]); ++i) {
+        roaring_bitmap_t *r = bitmaps[i];
+        const size_t size = roaring_bitmap_portable_size_in_bytes(r);
+        char *buf = (char *)malloc(size);
+        roaring_bitmap_portable_serialize(r, buf);
+        assert_int_equal(roaring_bitmap_portable_deserialize_size(buf, size),
+                         size);
+        assert_int_equal(
+            roaring_bitmap_portable_deserialize_size(buf, size - 1), 0);
+        assert_int_equal(roaring_bitmap_portable_cardinality(buf),
+                         roaring_bitmap_get_cardinality(r));
+
+        roaring_uint32_iterator_t *it = roaring_create_iterator(r);
+        for (; it->has_value; roaring_advance_uint32_iterator(it)) {
+            const uint32_t v = it->current_value;
+            assert_true(roaring_bitmap_portable_contains(buf, v));
+            assert_int_equal(roaring_bitmap_portable_contains(buf, v + 1),
+                             roaring_bitmap_contains(r, v + 1));
+            assert_int_equal(roaring_bitmap_portable_contains(buf, v - 1),
+                             roaring_bitmap_contains(r, v - 1));
+        }
+        roaring_free_uint32_iterator(it);
+        assert_false(roaring_bitmap_portable_contains(buf, UINT32_MAX));
+        free(buf);
+        roaring_bitmap_free(r);
+    }
+
+    // values out of order
+    roaring_bitmap_t *r = roaring_bitmap_of(3, 1, 2, 3);
+    const size_t size = roaring_bitmap_portable_size_in_bytes(r);
+    char *buf = (char *)malloc(size);
+    roaring_bitmap_portable_serialize(r, buf);
+    const uint16_t swapped[3] = {2, 1, 3};
+    memcpy(buf + size - sizeof(swapped), swapped, sizeof(swapped));
+    assert_int_equal(roaring_bitmap_portable_deserialize_size(buf, size), 0);
+    free(buf);
+    roaring_bitmap_free(r);
+}
+
+void test_frozen_serialization() {
+    roaring_bitmap_t *cow = make_mixed_bitmap(2);
+    cow->copy_on_write = true;
+    roaring_bitmap_t *shared = roaring_bitmap_copy(cow);
+    roaring_bitmap_t *bitmaps[] = {roaring_bitmap_create(),
+                                   roaring_bitmap_of(2, 1, 100000),
+                                   make_mixed_bitmap(5), shared};
+    for (size_t i = 0; i < sizeof(bitmaps) / sizeof(bitmaps[0]); ++i) {
+        roaring_bitmap_t *r = bitmaps[i];
+        const size_t size = roaring_bitmap_frozen_size_in_bytes(r);
+        char *storage = (char *)malloc(size + 32);
+        char *buf = (char *)(((uintptr_t)storage + 31) & ~(uintptr_t)31);
+        roaring_bitmap_frozen_serialize(r, buf);
+
+        const roaring_bitmap_t *view = roaring_bitmap_frozen_view(buf, size);
+        assert_non_null(view);
+        assert_true(roaring_bitmap_equals(view, r));
+        assert_int_equal(roaring_bitmap_get_cardinality(view),
+                         roaring_bitmap_get_cardinality(r));
+        roaring_uint32_iterator_t *it = roaring_create_iterator(view);
+        for (; it->has_value; roaring_advance_uint32_iterator(it)) {
+            assert_true(roaring_bitmap_contains(r, it->current_value));
+        }
+        roaring_free_uint32_iterator(it);
+
+        roaring_bitmap_t *other = make_mixed_bitmap(7);
+        roaring_bitmap_t *expected = roaring_bitmap_or(r, other);
+        roaring_bitmap_t *actual = roaring_bitmap_or(view, other);
+        assert_true(roaring_bitmap_equals(expected, actual));
+        roaring_bitmap_free(expected);
+        roaring_bitmap_free(actual);
+        expected = roaring_bitmap_and(r, other);
+        actual = roaring_bitmap_and(other, view);
+        assert_true(roaring_bitmap_equals(expected, actual));
+        roaring_bitmap_free(expected);
+        roaring_bitmap_free(actual);
+        roaring_bitmap_free(other);
+
+        // copies are regular bitmaps, even when asking for copy-on-write
+        ((roaring_bitmap_t *)view)->copy_on_write = true;
+        roaring_bitmap_t *copy = roaring_bitmap_copy(view);
+        ((roaring_bitmap_t *)view)->copy_on_write = false;
+        roaring_bitmap_add(copy, 123456789);
+        assert_false(roaring_bitmap_contains(view, 123456789));
+        roaring_bitmap_free(copy);
+
+        assert_null(roaring_bitmap_frozen_view(buf + 1, size - 1));
+        assert_null(roaring_bitmap_frozen_view(buf, size - 1));
+        roaring_bitmap_free((roaring_bitmap_t *)view);
+        free(storage);
+        roaring_bitmap_free(r);
+    }
+    roaring_bitmap_free(cow);
+}
+
+void test_frozen_view_checked() {
+    // a bitset, an array and a run container, in that order in the buffer
+    roaring_bitmap_t *r = roaring_bitmap_create();
+    for (uint32_t i = 0; i < 10000; i += 2) roaring_bitmap_add(r, i);
+    roaring_bitmap_add(r, 65536 + 3);
+    roaring_bitmap_add(r, 65536 + 5);
+    roaring_bitmap_add_range(r, 2 * 65536 + 100, 2 * 65536 + 200);
+    roaring_bitmap_run_optimize(r);
+    const size_t size = roaring_bitmap_frozen_size_in_bytes(r);
+    char *storage = (char *)malloc(size + 32);
+    char *buf = (char *)(((uintptr_t)storage + 31) & ~(uintptr_t)31);
+    uint16_t *counts = (uint16_t *)(buf + size - 4 - 3 * 3);
+    rle16_t *run = (rle16_t *)(buf + BITSET_CONTAINER_SIZE_IN_WORDS * 8);
+    uint16_t *array = (uint16_t *)(run + 1);
+
+    roaring_bitmap_frozen_serialize(r, buf);
+    const roaring_bitmap_t *view = roaring_bitmap_frozen_view_checked(buf, size);
+    assert_non_null(view);
+    assert_true(roaring_bitmap_equals(view, r));
+    roaring_bitmap_free((roaring_bitmap_t *)view);
+
+    // a bitset claiming fewer values than it holds
+    counts[0] = 0;
+    view = roaring_bitmap_frozen_view(buf, size);
+    assert_non_null(view);
+    roaring_bitmap_free((roaring_bitmap_t *)view);
+    assert_null(roaring_bitmap_frozen_view_checked(buf, size));
+
+    // array values out of order
+    roaring_bitmap_frozen_serialize(r, buf);
+    array[0] = 5;
+    array[1] = 3;
+    assert_null(roaring_bitmap_frozen_view_checked(buf, size));
+
+    // a run past the end of its chunk
+    roaring_bitmap_frozen_serialize(r, buf);
+    run->length = UINT16_MAX;
+    assert_null(roaring_bitmap_frozen_view_checked(buf, size));
+
+    free(storage);
+    roaring_bitmap_free(r);
+}
+
+void test_range_operations() {
+    // keys 0..15 are populated, ranges reach past them on both sides
+    const uint64_t ranges[][2] = {{0, 1},          {5, 70000},
+                                  {65536, 131072}, {65535, 196609},
+                                  {100, 100},      {3 << 16, 11 << 16},
+                                  {123456, 987654}, {900000, 1200000}};
+    for (size_t k = 0; k < sizeof(ranges) / sizeof(ranges[0]); ++k) {
+        const uint64_t min = ranges[k][0], max = ranges[k][1];
+        roaring_bitmap_t *range =
+            min < max ? roaring_bitmap_from_range((uint32_t)min, (uint32_t)max, 1)
+                      : roaring_bitmap_create();
+        roaring_bitmap_t *r = make_mixed_bitmap((uint32_t)k);
+        r->copy_on_write = true;
+        roaring_bitmap_t *shared = roaring_bitmap_copy(r);
+
+        uint64_t expected_card = roaring_bitmap_and_cardinality(r, range);
+        assert_int_equal(roaring_bitmap_range_cardinality(r, min, max),
+                         expected_card);
+        assert_int_equal(roaring_bitmap_contains_range(r, min, max),
+                         expected_card == max - min);
+
+        roaring_bitmap_t *expected = roaring_bitmap_or(r, range);
+        roaring_bitmap_add_range(r, min, max);
+        assert_true(roaring_bitmap_equals(r, expected));
+        assert_true(roaring_bitmap_contains_range(r, min, max));
+        assert_int_equal(roaring_bitmap_range_cardinality(r, min, max),
+                         max - min);
+        roaring_bitmap_free(expected);
+
+        expected = roaring_bitmap_andnot(shared, range);
+        roaring_bitmap_remove_range(shared, min, max);
+        assert_true(roaring_bitmap_equals(shared, expected));
+        assert_int_equal(roaring_bitmap_range_cardinality(shared, min, max), 0);
+        assert_int_equal(roaring_bitmap_contains_range(shared, min, max),
+                         min == max);
+        roaring_bitmap_free(expected);
+
+        roaring_bitmap_free(range);
+        roaring_bitmap_free(r);
+        roaring_bitmap_free(shared);
+    }
+
+    // the whole 32-bit range, including the last value
+    const uint64_t end = UINT64_C(1) << 32;
+    roaring_bitmap_t *r = roaring_bitmap_of(2, 1, 100000);
+    roaring_bitmap_add_range(r, 4294967290u, end + 10);
+    assert_int_equal(roaring_bitmap_get_cardinality(r), 8);
+    assert_true(roaring_bitmap_contains(r, 4294967295u));
+    assert_true(roaring_bitmap_contains_range(r, 4294967290u, end));
+    roaring_bitmap_add_range(r, 0, end);
+    assert_int_equal(roaring_bitmap_get_cardinality(r), end);
+    assert_true(roaring_bitmap_portable_size_in_bytes(r) < (1 << 20));
+    roaring_bitmap_remove_range(r, 1, end - 1);
+    assert_int_equal(roaring_bitmap_get_cardinality(r), 2);
+    assert_true(roaring_bitmap_contains(r, 0));
+    assert_true(roaring_bitmap_contains(r, 4294967295u));
+    roaring_bitmap_flip_inplace(r, 0, end);
+    assert_int_equal(roaring_bitmap_range_cardinality(r, 0, end), end - 2);
+    roaring_bitmap_remove_range(r, 0, end);
+    assert_true(roaring_bitmap_is_empty(r));
+    roaring_bitmap_free(r);
+}
+
+void test_rank_index() {
+    roaring_bitmap_t *cow = make_mixed_bitmap(3);
+    cow->copy_on_write = true;
+    roaring_bitmap_t *shared = roaring_bitmap_copy(cow);
+    roaring_bitmap_t *full = roaring_bitmap_from_range(0, 1 << 17, 1);
+    roaring_bitmap_t *bitmaps[] = {roaring_bitmap_create(),
+                                   roaring_bitmap_of(3, 0, 65535, 4294967295u),
+                                   make_mixed_bitmap(0), shared, full};
+    for (size_t k = 0; k < sizeof(bitmaps) / sizeof(bitmaps[0]); ++k) {
+        roaring_bitmap_t *r = bitmaps[k];
+        roaring_rank_index_t *index = roaring_rank_index_create(r);
+        assert_non_null(index);
+        assert_true(roaring_rank_index_size_in_bytes(index) > 0);
+        const uint64_t card = roaring_bitmap_get_cardinality(r);
+
+        // every value, its neighbours and the container edges around it
+        roaring_uint32_iterator_t *it = roaring_create_iterator(r);
+        uint64_t rank = 0;
+        for (; it->has_value; roaring_advance_uint32_iterator(it), ++rank) {
+            const uint32_t v = it->current_value;
+            assert_int_equal(roaring_bitmap_rank_indexed(r, index, v), rank + 1);
+            if (v > 0) {
+                assert_int_equal(roaring_bitmap_rank_indexed(r, index, v - 1),
+                                 roaring_bitmap_rank(r, v - 1));
+            }
+            if (rank % 7 == 0) {
+                assert_int_equal(roaring_bitmap_rank_indexed(r, index, v | 0xFFFF),
+                                 roaring_bitmap_rank(r, v | 0xFFFF));
+            }
+            uint32_t element;
+            assert_true(roaring_bitmap_select_indexed(r, index, rank, &element));
+            assert_int_equal(element, v);
+        }
+        roaring_free_uint32_iterator(it);
+        assert_int_equal(rank, card);
+
+        uint32_t element;
+        assert_false(roaring_bitmap_select_indexed(r, index, card, &element));
+        assert_int_equal(roaring_bitmap_rank_indexed(r, index, 4294967295u), card);
+        assert_int_equal(roaring_bitmap_rank_indexed(r, index, 0),
+                         roaring_bitmap_contains(r, 0));
+        roaring_rank_index_free(index);
+        roaring_bitmap_free(r);
+    }
+    roaring_bitmap_free(cow);
+}
+
+void test_checked_add_remove() {
+    roaring_bitmap_t *cow = make_mixed_bitmap(1);
+    cow->copy_on_write = true;
+    roaring_bitmap_t *r = roaring_bitmap_copy(cow);
+    roaring_bitmap_t *expected = roaring_bitmap_copy(cow);
+    uint64_t card = roaring_bitmap_get_cardinality(r);
+
+    srand(42);
+    uint32_t vals[4000];
+    for (int round = 0; round < 3; ++round) {
+        // sorted runs and random values over populated and empty keys
+        for (int i = 0; i < 4000; ++i) {
+            vals[i] = i < 2000 ? (uint32_t)(i * 37 + round * 100000)
+                               : (uint32_t)(rand() % (20 << 16));
+        }
+        const uint64_t added = roaring_bitmap_add_many_checked(r, 4000, vals);
+        roaring_bitmap_add_many(expected, 4000, vals);
+        assert_true(roaring_bitmap_equals(r, expected));
+        card += added;
+        assert_int_equal(roaring_bitmap_get_cardinality(r), card);
+        assert_int_equal(roaring_bitmap_add_many_checked(r, 4000, vals), 0);
+    }
+
+    for (uint32_t v = 0; v < (20 << 16); v += 97) {
+        const bool present = roaring_bitmap_contains(r, v);
+        assert_int_equal(roaring_bitmap_add_checked(r, v), !present);
+        assert_false(roaring_bitmap_add_checked(r, v));
+        assert_true(roaring_bitmap_remove_checked(r, v));
+        assert_false(roaring_bitmap_remove_checked(r, v));
+        assert_false(roaring_bitmap_contains(r, v));
+    }
+    // removing the last value drops its container
+    roaring_bitmap_t *single = roaring_bitmap_of(1, 70000);
+    assert_true(roaring_bitmap_remove_checked(single, 70000));
+    assert_int_equal(single->high_low_container.size, 0);
+    assert_true(roaring_bitmap_add_checked(single, 70000));
+
+    roaring_bitmap_free(single);
+    roaring_bitmap_free(expected);
+    roaring_bitmap_free(r);
+    roaring_bitmap_free(cow);
+}
+
+void test_iterator_equalorlarger() {
+    roaring_bitmap_t *cow = make_mixed_bitmap(1);
+    cow->copy_on_write = true;
+    // shared containers are unwrapped as well
+    roaring_bitmap_t *r = roaring_bitmap_copy(cow);
+    roaring_bitmap_add(r, UINT32_MAX);
+    const uint64_t card = roaring_bitmap_get_cardinality(r);
+    uint32_t *values = malloc(card * sizeof(uint32_t));
+    roaring_bitmap_to_uint32_array(r, values);
+
+    roaring_uint32_iterator_t *it = roaring_create_iterator(r);
+    // moves forward and backward, to values present and missing
+    for (uint32_t v = 0; v < (17 << 16); v += 41) {
+        for (int back = 0; back < 2; ++back) {
+            uint32_t target = back ? v / 2 : v;
+            // index of the first value >= target
+            uint64_t expected = 0, high = card;
+            while (expected < high) {
+                uint64_t middle = (expected + high) / 2;
+                if (values[middle] < target) expected = middle + 1;
+                else high = middle;
+            }
+            assert_int_equal(roaring_move_uint32_iterator_equalorlarger(it, target), expected < card);
+            if (expected < card) {
+                assert_int_equal(it->current_value, values[expected]);
+                // the iteration goes on from there
+                roaring_advance_uint32_iterator(it);
+                assert_int_equal(it->has_value, expected + 1 < card);
+                if (expected + 1 < card) assert_int_equal(it->current_value, values[expected + 1]);
+            }
+        }
+    }
+    for (uint64_t i = 0; i < card; i += 13) {
+        assert_true(roaring_move_uint32_iterator_equalorlarger(it, values[i]));
+        assert_int_equal(it->current_value, values[i]);
+    }
+    assert_true(roaring_move_uint32_iterator_equalorlarger(it, UINT32_MAX));
+    assert_int_equal(it->current_value, UINT32_MAX);
+    assert_false(roaring_advance_uint32_iterator(it));
+
+    roaring_bitmap_t *empty = roaring_bitmap_create();
+    roaring_uint32_iterator_t *none = roaring_create_iterator(empty);
+    assert_false(roaring_move_uint32_iterator_equalorlarger(none, 0));
+
+    roaring_free_uint32_iterator(none);
+    roaring_bitmap_free(empty);
+    roaring_free_uint32_iterator(it);
+    free(values);
+    roaring_bitmap_free(r);
+    roaring_bitmap_free(cow);
+}
+
+static int compare_uint32(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+void test_contains_many() {
+    roaring_bitmap_t *cow = make_mixed_bitmap(4);
+    cow->copy_on_write = true;
+    roaring_bitmap_t *r = roaring_bitmap_copy(cow);
+    roaring_bitmap_add(r, UINT32_MAX);
+
+    srand(7);
+    enum { N = 20000 };
+    uint32_t *vals = malloc(N * sizeof(uint32_t));
+    bool *answer = malloc(N * sizeof(bool));
+    for (int i = 0; i < N; ++i) {
+        // repeats, values around present ones and keys with no container
+        vals[i] = i % 10 == 0 ? vals[i / 2] : (uint32_t)(rand() % (18 << 16));
+    }
+    vals[N - 1] = UINT32_MAX;
+    vals[N - 2] = UINT32_MAX - 1;
+    qsort(vals, N, sizeof(uint32_t), compare_uint32);
+    roaring_bitmap_contains_many(r, N, vals, answer);
+    size_t present = 0;
+    for (int i = 0; i < N; ++i) {
+        assert_int_equal(answer[i], roaring_bitmap_contains(r, vals[i]));
+        present += answer[i];
+    }
+    assert_true(present > 0 && present < N);
+
+    roaring_bitmap_t *empty = roaring_bitmap_create();
+    roaring_bitmap_contains_many(empty, N, vals, answer);
+    for (int i = 0; i < N; ++i) assert_false(answer[i]);
+    roaring_bitmap_contains_many(r, 0, vals, answer);
+
+    roaring_bitmap_free(empty);
+    free(answer);
+    free(vals);
+    roaring_bitmap_free(r);
+    roaring_bitmap_free(cow);
+}
+
+void test_remove_many() {
+    roaring_bitmap_t *cow = make_mixed_bitmap(5);
+    cow->copy_on_write = true;
+    srand(11);
+    enum { N = 70000 };
+    uint32_t *vals = malloc(N * sizeof(uint32_t));
+    for (int round = 0; round < 3; ++round) {
+        roaring_bitmap_t *r = roaring_bitmap_copy(cow);
+        roaring_bitmap_t *expected = roaring_bitmap_copy(cow);
+        for (int i = 0; i < N; ++i) {
+            // sorted, unsorted, and with repeats
+            vals[i] = round == 1 ? (uint32_t)(rand() % (16 << 16))
+                                 : (uint32_t)i * (round == 0 ? 17 : 11) % (16 << 16);
+            if (i % 7 == 0 && i > 0) vals[i] = vals[i - 1];
+        }
+        if (round == 0) qsort(vals, N, sizeof(uint32_t), compare_uint32);
+        const uint64_t card = roaring_bitmap_get_cardinality(r);
+        const uint64_t removed = roaring_bitmap_remove_many_checked(r, N, vals);
+        for (int i = 0; i < N; ++i) roaring_bitmap_remove(expected, vals[i]);
+        assert_true(roaring_bitmap_equals(r, expected));
+        assert_int_equal(roaring_bitmap_get_cardinality(r), card - removed);
+        assert_int_equal(roaring_bitmap_remove_many_checked(r, N, vals), 0);
+        // the source of the shared containers is left alone
+        assert_int_equal(roaring_bitmap_get_cardinality(cow),
+                         roaring_bitmap_get_cardinality(r) + removed);
+        roaring_bitmap_free(expected);
+        roaring_bitmap_free(r);
+    }
+
+    // emptied containers are dropped, and full bitsets become arrays at once
+    roaring_bitmap_t *r = roaring_bitmap_from_range(0, 3 << 16, 1);
+    for (int i = 0; i < 65536; ++i) vals[i] = 65536 + i;
+    roaring_bitmap_remove_many(r, 65536, vals);
+    assert_int_equal(r->high_low_container.size, 2);
+    assert_int_equal(roaring_bitmap_get_cardinality(r), 2 << 16);
+    roaring_bitmap_t *dense = roaring_bitmap_create();
+    for (uint32_t v = 0; v < 65536; v += 2) roaring_bitmap_add(dense, v);
+    for (int i = 0; i < 30000; ++i) vals[i] = (uint32_t)i * 2;
+    assert_int_equal(roaring_bitmap_remove_many_checked(dense, 30000, vals), 30000);
+    assert_int_equal(dense->high_low_container.typecodes[0], ARRAY_CONTAINER_TYPE_CODE);
+    assert_int_equal(roaring_bitmap_get_cardinality(dense), 32768 - 30000);
+
+    roaring_bitmap_free(dense);
+    roaring_bitmap_free(r);
+    free(vals);
+    roaring_bitmap_free(cow);
+}
+
+void test_append_many() {
+    enum { N = 100000 };
+    uint32_t *vals = malloc(N * sizeof(uint32_t));
+    int n = 0;
+    for (uint32_t v = 10; v < 20000; ++v) vals[n++] = v;              // run
+    for (uint32_t v = 1 << 16; v < (1 << 16) + 3000 * 7; v += 7)      // array
+        vals[n++] = v;
+    for (uint32_t v = 3 << 16; v < (4 << 16); v += 2) vals[n++] = v;  // bitset
+    vals[n++] = 5 << 16;
+    vals[n++] = UINT32_MAX;
+    roaring_bitmap_t *r = roaring_bitmap_create();
+    roaring_bitmap_t *expected = roaring_bitmap_of_ptr(n, vals);
+    assert_true(roaring_bitmap_append_many(r, n, vals));
+    assert_true(roaring_bitmap_equals(r, expected));
+    assert_int_equal(r->high_low_container.size, 5);
+    assert_int_equal(r->high_low_container.typecodes[0], RUN_CONTAINER_TYPE_CODE);
+    assert_int_equal(r->high_low_container.typecodes[1], ARRAY_CONTAINER_TYPE_CODE);
+    assert_int_equal(r->high_low_container.typecodes[2], BITSET_CONTAINER_TYPE_CODE);
+    assert_int_equal(roaring_bitmap_get_cardinality(r), n);
+
+    // values out of order, repeated or not past the maximum are refused
+    assert_false(roaring_bitmap_append_many(r, 1, vals));
+    roaring_bitmap_remove(r, UINT32_MAX);
+    uint32_t unsorted[] = {(6 << 16) + 2, (6 << 16) + 1};
+    assert_false(roaring_bitmap_append_many(r, 2, unsorted));
+    assert_int_equal(roaring_bitmap_get_cardinality(r), n - 1);
+    roaring_bitmap_free(r);
+    uint32_t repeated[] = {1, 2, 2};
+    r = roaring_bitmap_create();
+    assert_false(roaring_bitmap_append_many(r, 3, repeated));
+    assert_true(roaring_bitmap_is_empty(r));
+    assert_true(roaring_bitmap_append_many(r, 0, repeated));
+    roaring_bitmap_free(r);
+
+    // the first values go to the last container when they share its key,
+    // leaving the source of a shared container alone
+    roaring_bitmap_t *cow = roaring_bitmap_of(2, 5 << 16, (5 << 16) + 1);
+    cow->copy_on_write = true;
+    r = roaring_bitmap_copy(cow);
+    roaring_bitmap_free(expected);
+    expected = roaring_bitmap_copy(cow);
+    n = 0;
+    for (uint32_t v = (5 << 16) + 10; v < (7 << 16); v += 3) vals[n++] = v;
+    // read from an unaligned buffer, like the values of a blob
+    char *buffer = malloc(n * sizeof(uint32_t) + 1);
+    memcpy(buffer + 1, vals, n * sizeof(uint32_t));
+    assert_true(roaring_bitmap_append_many(r, n, (const uint32_t *)(buffer + 1)));
+    roaring_bitmap_add_many(expected, n, vals);
+    assert_true(roaring_bitmap_equals(r, expected));
+    assert_int_equal(roaring_bitmap_get_cardinality(cow), 2);
+
+    free(buffer);
+    roaring_bitmap_free(cow);
+    roaring_bitmap_free(expected);
+    roaring_bitmap_free(r);
+    free(vals);
+}
+
+void test_add_many_unsorted() {
+    roaring_bitmap_t *cow = make_mixed_bitmap(5);
+    cow->copy_on_write = true;
+    srand(13);
+    enum { N = 200000 };
+    uint32_t *vals = malloc(N * sizeof(uint32_t));
+    for (int round = 0; round < 3; ++round) {
+        roaring_bitmap_t *r = roaring_bitmap_copy(cow);
+        roaring_bitmap_t *expected = roaring_bitmap_copy(cow);
+        for (int i = 0; i < N; ++i) {
+            // random over the mixed containers and past them, all over the
+            // range, and with repeats
+            vals[i] = round == 0 ? (uint32_t)(rand() % (20 << 16))
+                    : round == 1 ? (uint32_t)rand() * 2654435761u
+                                 : (uint32_t)(rand() % 1000) * 37;
+        }
+        const uint64_t card = roaring_bitmap_get_cardinality(r);
+        const uint64_t added = roaring_bitmap_add_many_unsorted(r, N, vals);
+        roaring_bitmap_add_many(expected, N, vals);
+        assert_true(roaring_bitmap_equals(r, expected));
+        assert_int_equal(roaring_bitmap_get_cardinality(r), card + added);
+        assert_int_equal(roaring_bitmap_add_many_unsorted(r, N, vals), 0);
+        // the source of the shared containers is left alone
+        assert_int_equal(roaring_bitmap_get_cardinality(cow),
+                         roaring_bitmap_get_cardinality(r) - added);
+        roaring_bitmap_free(expected);
+        roaring_bitmap_free(r);
+    }
+    uint32_t same[] = {7, 7, 7};
+    roaring_bitmap_t *r = roaring_bitmap_create();
+    assert_int_equal(roaring_bitmap_add_many_unsorted(r, 3, same), 1);
+    assert_int_equal(roaring_bitmap_add_many_unsorted(r, 0, same), 0);
+    assert_int_equal(roaring_bitmap_get_cardinality(r), 1);
+
+    roaring_bitmap_free(r);
+    free(vals);
+    roaring_bitmap_free(cow);
+}
+
+void test_reverse_iterator() {
+    roaring_bitmap_t *cow = make_mixed_bitmap(3);
+    cow->copy_on_write = true;
+    roaring_bitmap_t *r = roaring_bitmap_copy(cow);
+    roaring_bitmap_add(r, 0);
+    roaring_bitmap_add_range(r, UINT64_C(0xFFFFFFF0), UINT64_C(0x100000000));
+    const uint64_t card = roaring_bitmap_get_cardinality(r);
+    uint32_t *values = malloc(card * sizeof(uint32_t));
+    roaring_bitmap_to_uint32_array(r, values);
+
+    roaring_uint32_iterator_t *it = roaring_create_iterator_last(r);
+    for (uint64_t i = card; i > 0; --i) {
+        assert_true(it->has_value);
+        assert_int_equal(it->current_value, values[i - 1]);
+        // a step forward and back lands on the same value
+        if (i % 1000 == 0) {
+            assert_int_equal(roaring_advance_uint32_iterator(it), i < card);
+            if (i < card) {
+                assert_int_equal(it->current_value, values[i]);
+                assert_true(roaring_previous_uint32_iterator(it));
+            } else {
+                assert_true(roaring_previous_uint32_iterator(it));
+            }
+            assert_int_equal(it->current_value, values[i - 1]);
+        }
+        roaring_previous_uint32_iterator(it);
+    }
+    assert_false(it->has_value);
+    assert_false(roaring_previous_uint32_iterator(it));
+    // past the first value, the iteration can start over
+    assert_true(roaring_advance_uint32_iterator(it));
+    assert_int_equal(it->current_value, 0);
+
+    // backward from a moved iterator
+    assert_true(roaring_move_uint32_iterator_equalorlarger(it, values[card / 2]));
+    assert_true(roaring_previous_uint32_iterator(it));
+    assert_int_equal(it->current_value, values[card / 2 - 1]);
+    roaring_free_uint32_iterator(it);
+
+    roaring_bitmap_t *empty = roaring_bitmap_create();
+    it = roaring_create_iterator_last(empty);
+    assert_false(it->has_value);
+    assert_false(roaring_previous_uint32_iterator(it));
+    assert_false(roaring_advance_uint32_iterator(it));
+
+    roaring_free_uint32_iterator(it);
+    roaring_bitmap_free(empty);
+    free(values);
+    roaring_bitmap_free(r);
+    roaring_bitmap_free(cow);
+}
+
+void test_read_uint32_iterator() {
+    roaring_bitmap_t *cow = make_mixed_bitmap(2);
+    cow->copy_on_write = true;
+    roaring_bitmap_t *r = roaring_bitmap_copy(cow);
+    roaring_bitmap_add_range(r, UINT64_C(0xFFFFFF00), UINT64_C(0x100000000));
+    const uint64_t card = roaring_bitmap_get_cardinality(r);
+    uint32_t *values = malloc(card * sizeof(uint32_t));
+    uint32_t *buf = malloc(card * sizeof(uint32_t));
+    roaring_bitmap_to_uint32_array(r, values);
+
+    // buffers smaller and larger than the containers, from their starts and not
+    const uint32_t counts[] = {1, 7, 300, 4096, 70000, 1000000};
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        roaring_uint32_iterator_t *it = roaring_create_iterator(r);
+        uint64_t pos = 0;
+        for (;;) {
+            const uint32_t read = roaring_read_uint32_iterator(it, buf, counts[c]);
+            assert_true(read <= counts[c]);
+            for (uint32_t i = 0; i < read; ++i) {
+                assert_int_equal(buf[i], values[pos + i]);
+            }
+            pos += read;
+            assert_int_equal(it->has_value, pos < card);
+            if (pos == card) {
+                break;
+            }
+            assert_int_equal(read, counts[c]);
+            assert_int_equal(it->current_value, values[pos]);
+            // mixed with single steps and moves
+            assert_int_equal(roaring_advance_uint32_iterator(it), ++pos < card);
+            if (pos < card) {
+                assert_int_equal(it->current_value, values[pos]);
+            }
+            if (pos + 17 < card) {
+                pos += 17;
+                assert_true(roaring_move_uint32_iterator_equalorlarger(it, values[pos]));
+            }
+        }
+        assert_int_equal(roaring_read_uint32_iterator(it, buf, counts[c]), 0);
+        roaring_free_uint32_iterator(it);
+    }
+    roaring_uint32_iterator_t *it = roaring_create_iterator(r);
+    assert_int_equal(roaring_read_uint32_iterator(it, buf, (uint32_t)card), card);
+    assert_int_equal(memcmp(buf, values, card * sizeof(uint32_t)), 0);
+    assert_false(it->has_value);
+
+    roaring_free_uint32_iterator(it);
+    free(buf);
+    free(values);
+    roaring_bitmap_free(r);
+    roaring_bitmap_free(cow);
+}
+
 int main() {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_rank),
+        cmocka_unit_test(test_flip_last_container),
+        cmocka_unit_test(test_rank_bitset_last_value),
         cmocka_unit_test(test_maximum_minimum),
         cmocka_unit_test(test_stats),
         cmocka_unit_test(test_addremove),
@@ -2780,6 +3715,25 @@ int main() {
         cmocka_unit_test(test_flip_run_container_removal2),
         cmocka_unit_test(select_test),
         cmocka_unit_test(test_subset),
+        cmocka_unit_test(test_cardinality_operations),
+        cmocka_unit_test(test_copy_of_shared_containers),
+        cmocka_unit_test(test_parallel_operations_true),
+        cmocka_unit_test(test_parallel_operations_false),
+        cmocka_unit_test(test_portable_serialize_header),
+        cmocka_unit_test(test_portable_deserialize_stream),
+        cmocka_unit_test(test_portable_contains),
+        cmocka_unit_test(test_frozen_serialization),
+        cmocka_unit_test(test_frozen_view_checked),
+        cmocka_unit_test(test_range_operations),
+        cmocka_unit_test(test_rank_index),
+        cmocka_unit_test(test_checked_add_remove),
+        cmocka_unit_test(test_iterator_equalorlarger),
+        cmocka_unit_test(test_read_uint32_iterator),
+        cmocka_unit_test(test_reverse_iterator),
+        cmocka_unit_test(test_contains_many),
+        cmocka_unit_test(test_remove_many),
+        cmocka_unit_test(test_append_many),
+        cmocka_unit_test(test_add_many_unsorted),
         // cmocka_unit_test(test_run_to_bitset),
         // cmocka_unit_test(test_run_to_array),
     };
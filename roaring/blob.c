@@ -0,0 +1,51 @@
+#include "./blob.h"
+
+void RoaringBlob_InitDeltas(RoaringDeltaReader *reader, const char *blob, size_t len) {
+    reader->next = (const unsigned char*)blob;
+    reader->end = (const unsigned char*)blob + len;
+    reader->previous = 0;
+}
+
+long long RoaringBlob_ReadDeltas(RoaringDeltaReader *reader, uint32_t *out, size_t max) {
+    size_t n = 0;
+    while (n < max && reader->next < reader->end) {
+        uint64_t delta = 0;
+        int shift = 0;
+        for (;;) {
+            // A uint32 fits in 5 bytes
+            if (reader->next == reader->end || shift > 28) {
+                return -1;
+            }
+            unsigned char byte = *reader->next++;
+            delta |= (uint64_t)(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                break;
+            }
+            shift += 7;
+        }
+        uint64_t value = reader->previous + delta;
+        if (value > UINT32_MAX) {
+            return -1;
+        }
+        if (out != NULL) {
+            out[n] = (uint32_t)value;
+        }
+        reader->previous = value;
+        n++;
+    }
+    return (long long)n;
+}
+
+bool RoaringBlob_PlainIsHostOrder(void) {
+    // Compilers fold this to a constant
+    const uint32_t one = 1;
+    return *(const unsigned char*)&one == 1;
+}
+
+void RoaringBlob_ReadPlain(const char *blob, size_t count, uint32_t *out) {
+    const unsigned char *bytes = (const unsigned char*)blob;
+    for (size_t i = 0; i < count; i++) {
+        const unsigned char *b = bytes + i * 4;
+        out[i] = (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+    }
+}
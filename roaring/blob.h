@@ -0,0 +1,43 @@
+#ifndef __ROARING_BLOB_H__
+#define __ROARING_BLOB_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Decoding of the binary blobs taken by ROARING.ADDBLOB and ROARING.REMOVEBLOB.
+ *
+ * Plain blobs hold the values as little-endian 4 byte integers. DELTA blobs
+ * hold them sorted, each as the difference with the one before (the first as
+ * is) in an unsigned LEB128 varint, which takes at most 5 bytes for a uint32.
+ *
+ * Nothing here knows about Redis, so the decoding can be tested on its own.
+ */
+
+/* Reads the values of a DELTA blob, a batch at a time */
+typedef struct {
+    const unsigned char *next;
+    const unsigned char *end;
+    uint64_t previous;
+} RoaringDeltaReader;
+
+/* Starts reading the len bytes of a DELTA blob from the first value */
+void RoaringBlob_InitDeltas(RoaringDeltaReader *reader, const char *blob, size_t len);
+
+/**
+ * Decodes up to max values to out, or only checks them if out is NULL.
+ *
+ * Returns the number of values decoded, 0 once the blob is exhausted, or -1 if
+ * the blob is not valid: a varint cut short or longer than 5 bytes, or a value
+ * past UINT32_MAX.
+ */
+long long RoaringBlob_ReadDeltas(RoaringDeltaReader *reader, uint32_t *out, size_t max);
+
+/* Whether the values of a plain blob are already in host order, so it can be used in place */
+bool RoaringBlob_PlainIsHostOrder(void);
+
+/* Converts count values of a plain blob, which needs no alignment, to host order */
+void RoaringBlob_ReadPlain(const char *blob, size_t count, uint32_t *out);
+
+#endif
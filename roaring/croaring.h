@@ -288,6 +288,19 @@ int32_t intersect_skewed_uint16(const uint16_t *small, size_t size_s,
 int32_t intersect_uint16(const uint16_t *A, const size_t lenA,
                          const uint16_t *B, const size_t lenB, uint16_t *out);
 
+/* Computes the size of the intersection between one small and one large set of
+ * uint16_t. */
+int32_t intersect_skewed_uint16_cardinality(const uint16_t *small,
+                                            size_t size_s,
+                                            const uint16_t *large,
+                                            size_t size_l);
+
+/**
+ * Generic intersection function, returns just the cardinality.
+ */
+int32_t intersect_uint16_cardinality(const uint16_t *A, const size_t lenA,
+                                     const uint16_t *B, const size_t lenB);
+
 /**
  * Generic union function.
  */
@@ -350,6 +363,14 @@ int32_t difference_vector16(const uint16_t * A, size_t s_a, const uint16_t * B,
 size_t union_uint32_card(const uint32_t *set_1, size_t size_1,
                          const uint32_t *set_2, size_t size_2);
 
+/**
+ * Sorts the n values of vals with a least significant digit radix sort, one
+ * byte at a time, using buffer (of n values) as scratch space, then removes
+ * the duplicates. Bytes that are the same in all values are skipped. Returns
+ * the number of distinct values left at the start of vals.
+ */
+size_t radix_sort_unique_uint32(uint32_t *vals, uint32_t *buffer, size_t n);
+
 #endif
 /* end file /code/roaring/CRoaring/include/roaring/array_util.h */
 /* begin file /code/roaring/CRoaring/include/roaring/roaring_types.h */
@@ -363,6 +384,11 @@ size_t union_uint32_card(const uint32_t *set_1, size_t size_1,
 typedef bool (*roaring_iterator)(uint32_t value, void *param);
 typedef bool (*roaring_iterator64)(uint64_t value, void *param);
 
+/**
+ * Reads exactly len bytes into buf, returns false if they are not available.
+ */
+typedef bool (*roaring_read_callback)(void *buf, size_t len, void *param);
+
 /**
 *  (For advanced users.)
 * The roaring_statistics_t can be used to collect detailed statistics about
@@ -549,6 +575,28 @@ static inline void bitset_reset_range(uint64_t *bitmap, uint32_t start,
     bitmap[endword] &= ~((~UINT64_C(0)) >> ((-end) % 64));
 }
 
+/*
+ * Returns the number of set bits in indexes [begin,begin+lenminusone].
+ */
+static inline int bitset_lenrange_cardinality(const uint64_t *bitmap,
+                                              uint32_t start,
+                                              uint32_t lenminusone) {
+    uint32_t firstword = start / 64;
+    uint32_t endword = (start + lenminusone) / 64;
+    if (firstword == endword) {
+        return hamming(bitmap[firstword] &
+                       ((~UINT64_C(0)) >> ((63 - lenminusone)))
+                           << (start % 64));
+    }
+    int answer = hamming(bitmap[firstword] & ((~UINT64_C(0)) << (start % 64)));
+    for (uint32_t i = firstword + 1; i < endword; i++) {
+        answer += hamming(bitmap[i]);
+    }
+    answer += hamming(bitmap[endword] &
+                      (~UINT64_C(0)) >> ((-start - lenminusone - 1) % 64));
+    return answer;
+}
+
 /*
  * Given a bitset containing "length" 64-bit words, write out the position
  * of all the set bits to "out", values start at "base".
@@ -1079,6 +1127,11 @@ void array_container_intersection(const array_container_t *src_1,
 void array_container_intersection_inplace(array_container_t *src_1,
                                           const array_container_t *src_2);
 
+/* computes the size of the intersection of array1 and array2
+ * */
+int array_container_intersection_cardinality(const array_container_t *src_1,
+                                             const array_container_t *src_2);
+
 /* computes the negation of an array container src, writing to dst,
  *  assumed distinct from src
  *  moved to mixed_negation  TODO: clean me up here
@@ -1294,6 +1347,19 @@ inline int array_container_rank(const array_container_t *arr, uint16_t x) {
   }
 }
 
+/* Returns the index of the first value equal or larger than x, or -1 */
+inline int array_container_index_equalorlarger(const array_container_t *arr, uint16_t x) {
+  const int32_t idx = binarySearch(arr->array, arr->cardinality, x);
+  const bool is_present = idx >= 0;
+  if (is_present) {
+    return idx;
+  } else {
+    int32_t candidate = -idx - 1;
+    if (candidate < arr->cardinality) return candidate;
+    return -1;
+  }
+}
+
 #endif /* INCLUDE_CONTAINERS_ARRAY_H_ */
 /* end file /code/roaring/CRoaring/include/roaring/containers/array.h */
 /* begin file /code/roaring/CRoaring/include/roaring/containers/bitset.h */
@@ -1710,6 +1776,9 @@ uint16_t bitset_container_maximum(const bitset_container_t *container);
 
 /* Returns the number of values equal or smaller than x */
 int bitset_container_rank(const bitset_container_t *container, uint16_t x);
+
+/* Returns the first value equal or larger than x, or -1 */
+int bitset_container_index_equalorlarger(const bitset_container_t *container, uint16_t x);
 #endif /* INCLUDE_CONTAINERS_BITSET_H_ */
 /* end file /code/roaring/CRoaring/include/roaring/containers/bitset.h */
 /* begin file /code/roaring/CRoaring/include/roaring/containers/run.h */
@@ -2005,6 +2074,10 @@ void run_container_intersection(const run_container_t *src_1,
                                 const run_container_t *src_2,
                                 run_container_t *dst);
 
+/* Compute the size of the intersection of src_1 and src_2 . */
+int run_container_intersection_cardinality(const run_container_t *src_1,
+                                           const run_container_t *src_2);
+
 /* Compute the symmetric difference of `src_1' and `src_2' and write the result
  * to `dst'
  * It is assumed that `dst' is distinct from both `src_1' and `src_2'. */
@@ -2142,6 +2215,9 @@ inline uint16_t run_container_maximum(const run_container_t *run) {
 
 /* Returns the number of values equal or smaller than x */
 int run_container_rank(const run_container_t *arr, uint16_t x);
+
+/* Returns the index of the first run containing a value equal or larger than x, or -1 */
+int run_container_index_equalorlarger(const run_container_t *arr, uint16_t x);
 #endif /* INCLUDE_CONTAINERS_RUN_H_ */
 /* end file /code/roaring/CRoaring/include/roaring/containers/run.h */
 /* begin file /code/roaring/CRoaring/include/roaring/containers/convert.h */
@@ -2480,6 +2556,18 @@ bool run_bitset_container_intersection(const run_container_t *src_1,
  * to free the container.
  * In all cases, the result is in *dst.
  */
+/* Compute the size of the intersection of src_1 and src_2 . */
+int array_bitset_container_intersection_cardinality(
+    const array_container_t *src_1, const bitset_container_t *src_2);
+
+/* Compute the size of the intersection of src_1 and src_2 . */
+int array_run_container_intersection_cardinality(
+    const array_container_t *src_1, const run_container_t *src_2);
+
+/* Compute the size of the intersection of src_1 and src_2 . */
+int run_bitset_container_intersection_cardinality(
+    const run_container_t *src_1, const bitset_container_t *src_2);
+
 bool bitset_bitset_container_intersection_inplace(
     bitset_container_t *src_1, const bitset_container_t *src_2, void **dst);
 
@@ -3547,6 +3635,55 @@ static inline void *container_and(const void *c1, uint8_t type1, const void *c2,
     }
 }
 
+/**
+ * Compute the size of the intersection between two containers, requires a
+ * typecode. Nothing is allocated.
+ */
+static inline int container_and_cardinality(const void *c1, uint8_t type1,
+                                            const void *c2, uint8_t type2) {
+    c1 = container_unwrap_shared(c1, &type1);
+    c2 = container_unwrap_shared(c2, &type2);
+    switch (CONTAINER_PAIR(type1, type2)) {
+        case CONTAINER_PAIR(BITSET_CONTAINER_TYPE_CODE,
+                            BITSET_CONTAINER_TYPE_CODE):
+            return bitset_container_and_justcard(
+                (const bitset_container_t *)c1, (const bitset_container_t *)c2);
+        case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE,
+                            ARRAY_CONTAINER_TYPE_CODE):
+            return array_container_intersection_cardinality(
+                (const array_container_t *)c1, (const array_container_t *)c2);
+        case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE, RUN_CONTAINER_TYPE_CODE):
+            return run_container_intersection_cardinality(
+                (const run_container_t *)c1, (const run_container_t *)c2);
+        case CONTAINER_PAIR(BITSET_CONTAINER_TYPE_CODE,
+                            ARRAY_CONTAINER_TYPE_CODE):
+            return array_bitset_container_intersection_cardinality(
+                (const array_container_t *)c2, (const bitset_container_t *)c1);
+        case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE,
+                            BITSET_CONTAINER_TYPE_CODE):
+            return array_bitset_container_intersection_cardinality(
+                (const array_container_t *)c1, (const bitset_container_t *)c2);
+        case CONTAINER_PAIR(BITSET_CONTAINER_TYPE_CODE,
+                            RUN_CONTAINER_TYPE_CODE):
+            return run_bitset_container_intersection_cardinality(
+                (const run_container_t *)c2, (const bitset_container_t *)c1);
+        case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE,
+                            BITSET_CONTAINER_TYPE_CODE):
+            return run_bitset_container_intersection_cardinality(
+                (const run_container_t *)c1, (const bitset_container_t *)c2);
+        case CONTAINER_PAIR(ARRAY_CONTAINER_TYPE_CODE, RUN_CONTAINER_TYPE_CODE):
+            return array_run_container_intersection_cardinality(
+                (const array_container_t *)c1, (const run_container_t *)c2);
+        case CONTAINER_PAIR(RUN_CONTAINER_TYPE_CODE, ARRAY_CONTAINER_TYPE_CODE):
+            return array_run_container_intersection_cardinality(
+                (const array_container_t *)c2, (const run_container_t *)c1);
+        default:
+            assert(false);
+            __builtin_unreachable();
+            return 0;
+    }
+}
+
 /**
  * Compute intersection between two containers, with result in the first
  container if possible. If the returned pointer is identical to c1,
@@ -4882,6 +5019,7 @@ static inline int container_rank(const void *container, uint8_t typecode, uint16
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define MAX_CONTAINERS 65536
@@ -4892,9 +5030,13 @@ static inline int container_rank(const void *container, uint8_t typecode, uint16
 enum {
     SERIAL_COOKIE_NO_RUNCONTAINER = 12346,
     SERIAL_COOKIE = 12347,
+    FROZEN_COOKIE = 13766,
     NO_OFFSET_THRESHOLD = 4
 };
 
+/* the containers and keys live in a frozen buffer, see roaring_bitmap_frozen_view */
+#define ROARING_FLAG_FROZEN UINT8_C(0x1)
+
 /**
  * Roaring arrays are array-based key-value pairs having containers as values
  * and 16-bit integer keys. A roaring bitmap  might be implemented as such.
@@ -4911,6 +5053,7 @@ typedef struct roaring_array_s {
     void **containers;
     uint16_t *keys;
     uint8_t *typecodes;
+    uint8_t flags;
 } roaring_array_t;
 
 /**
@@ -5097,6 +5240,37 @@ size_t ra_portable_serialize(const roaring_array_t *ra, char *buf);
  */
 bool ra_portable_deserialize(roaring_array_t * ra, const char *buf);
 
+/**
+ * read a bitmap in the format of ra_portable_serialize from a stream, one
+ * container at a time, without a buffer holding the whole input. Every
+ * container gets exactly the capacity it needs. The input is validated
+ * (sorted keys, sorted values, cardinalities matching the header): returns
+ * false if it is not a valid bitmap, in which case the containers read so
+ * far are left in ra, that must still be cleared.
+ */
+bool ra_portable_deserialize_stream(roaring_array_t *ra,
+                                    roaring_read_callback read, void *param);
+
+/**
+ * Checks that buf, of at most maxbytes bytes, holds a valid bitmap in the
+ * format of ra_portable_serialize, without allocating anything. Returns its
+ * size in bytes, or 0 if it is not valid.
+ */
+size_t ra_portable_deserialize_size(const char *buf, const size_t maxbytes);
+
+/**
+ * Checks whether the serialized bitmap in buf contains x, looking only at the
+ * header and at the one container that could hold x. The buffer must have
+ * been checked with ra_portable_deserialize_size.
+ */
+bool ra_portable_contains(const char *buf, uint32_t x);
+
+/**
+ * Cardinality of the serialized bitmap in buf, read from its header. The
+ * buffer must have been checked with ra_portable_deserialize_size.
+ */
+uint64_t ra_portable_cardinality(const char *buf);
+
 /**
  * How many bytes are required to serialize this bitmap (meant to be
  * compatible
@@ -5115,6 +5289,13 @@ bool ra_has_run_container(const roaring_array_t *ra);
  */
 uint32_t ra_portable_header_size(const roaring_array_t *ra);
 
+/**
+ * write the header of ra_portable_serialize, that is everything before the
+ * first container, to a buffer of ra_portable_header_size(ra) bytes.
+ * Returns the number of bytes written.
+ */
+size_t ra_portable_serialize_header(const roaring_array_t *ra, char *buf);
+
 /**
  * If the container at the index i is share, unshare it (creating a local
  * copy if needed).
@@ -5401,6 +5582,34 @@ void roaring_bitmap_printf(const roaring_bitmap_t *ra);
 roaring_bitmap_t *roaring_bitmap_and(const roaring_bitmap_t *x1,
                                      const roaring_bitmap_t *x2);
 
+/**
+ * Computes the size of the intersection between two bitmaps.
+ *
+ */
+uint64_t roaring_bitmap_and_cardinality(const roaring_bitmap_t *x1,
+                                        const roaring_bitmap_t *x2);
+
+/**
+ * Computes the size of the union between two bitmaps.
+ *
+ */
+uint64_t roaring_bitmap_or_cardinality(const roaring_bitmap_t *x1,
+                                       const roaring_bitmap_t *x2);
+
+/**
+ * Computes the size of the difference (andnot) between two bitmaps.
+ *
+ */
+uint64_t roaring_bitmap_andnot_cardinality(const roaring_bitmap_t *x1,
+                                           const roaring_bitmap_t *x2);
+
+/**
+ * Computes the size of the symmetric difference (xor) between two bitmaps.
+ *
+ */
+uint64_t roaring_bitmap_xor_cardinality(const roaring_bitmap_t *x1,
+                                        const roaring_bitmap_t *x2);
+
 /**
  * Inplace version modifies x1, x1 == x2 is allowed
  */
@@ -5431,6 +5640,18 @@ void roaring_bitmap_or_inplace(roaring_bitmap_t *x1,
 roaring_bitmap_t *roaring_bitmap_or_many(size_t number,
                                          const roaring_bitmap_t **x);
 
+/**
+ * Computes the size of the union of the 'number_include' bitmaps from which
+ * the union of the 'number_exclude' bitmaps has been removed, that is
+ * | (include[0] | include[1] | ...) - (exclude[0] | exclude[1] | ...) |.
+ * The result is never materialized: a single scratch bitset is reused for
+ * the keys where several containers meet.
+ *
+ */
+uint64_t roaring_bitmap_or_many_andnot_cardinality(
+    size_t number_include, const roaring_bitmap_t **include,
+    size_t number_exclude, const roaring_bitmap_t **exclude);
+
 /**
  * Compute the union of 'number' bitmaps using a heap. This can
  * sometimes be faster than roaring_bitmap_or_many which uses
@@ -5478,6 +5699,36 @@ roaring_bitmap_t *roaring_bitmap_andnot(const roaring_bitmap_t *x1,
 void roaring_bitmap_andnot_inplace(roaring_bitmap_t *x1,
                                    const roaring_bitmap_t *x2);
 
+/**
+ * Parallel versions of roaring_bitmap_and, roaring_bitmap_or,
+ * roaring_bitmap_xor, roaring_bitmap_andnot and roaring_bitmap_or_many.
+ * The 16-bit key space is split into up to 'threads' ranges holding about
+ * as many containers each, every range is computed on its own thread, and
+ * the containers of the partial results are moved into the answer.
+ *
+ * Inputs too small to be worth splitting, or threads <= 1, fall back to
+ * the serial function. Caller is responsible for freeing the result.
+ */
+roaring_bitmap_t *roaring_bitmap_and_parallel(const roaring_bitmap_t *x1,
+                                              const roaring_bitmap_t *x2,
+                                              int threads);
+
+roaring_bitmap_t *roaring_bitmap_or_parallel(const roaring_bitmap_t *x1,
+                                             const roaring_bitmap_t *x2,
+                                             int threads);
+
+roaring_bitmap_t *roaring_bitmap_xor_parallel(const roaring_bitmap_t *x1,
+                                              const roaring_bitmap_t *x2,
+                                              int threads);
+
+roaring_bitmap_t *roaring_bitmap_andnot_parallel(const roaring_bitmap_t *x1,
+                                                 const roaring_bitmap_t *x2,
+                                                 int threads);
+
+roaring_bitmap_t *roaring_bitmap_or_many_parallel(size_t number,
+                                                  const roaring_bitmap_t **x,
+                                                  int threads);
+
 /**
  * Compute the xor of 'number' bitmaps using a heap. This can
  * sometimes be faster than roaring_bitmap_xor_many which uses
@@ -5501,18 +5752,105 @@ void roaring_bitmap_free(roaring_bitmap_t *r);
  */
 void roaring_bitmap_add_many(roaring_bitmap_t * r, size_t n_args, const uint32_t *vals);
 
+/**
+ * Same as roaring_bitmap_add_many, returning how many of the values were not
+ * in the bitmap yet. The count is taken from the cardinality of each container
+ * before and after its values are added, not value by value.
+ */
+uint64_t roaring_bitmap_add_many_checked(roaring_bitmap_t *r, size_t n_args,
+                                         const uint32_t *vals);
+
+/**
+ * Add value n_args from pointer vals, which must be strictly increasing and
+ * larger than the maximum of the bitmap, as when adding newly allocated ids.
+ * Each container is built at once and appended, with no search and no
+ * insertion: as a run container when the values are mostly consecutive, and
+ * with exactly the capacity it needs otherwise. All n_args values are new.
+ * Returns false, leaving the bitmap untouched, if the values are not in this
+ * order; roaring_bitmap_add_many can add them.
+ */
+bool roaring_bitmap_append_many(roaring_bitmap_t *r, size_t n_args,
+                                const uint32_t *vals);
+
+/**
+ * Same as roaring_bitmap_add_many_checked, for a large batch of values in any
+ * order. A copy of the values is radix sorted and deduplicated, then the
+ * values of each container are merged into it at once: set in place in a
+ * bitset, or in a single union otherwise. The keys are visited in order, so
+ * the cost grows linearly with the number of values instead of paying a
+ * search and an insertion each. Uses 8 * n_args bytes of temporary memory.
+ */
+uint64_t roaring_bitmap_add_many_unsorted(roaring_bitmap_t *r, size_t n_args,
+                                          const uint32_t *vals);
+
 /**
  * Add value x
  *
  */
 void roaring_bitmap_add(roaring_bitmap_t *r, uint32_t x);
 
+/**
+ * Add value x
+ * Returns true if a new value was added, false if the value was already existing.
+ */
+bool roaring_bitmap_add_checked(roaring_bitmap_t *r, uint32_t x);
+
 /**
  * Remove value x
  *
  */
 void roaring_bitmap_remove(roaring_bitmap_t *r, uint32_t x);
 
+/**
+ * Remove value x
+ * Returns true if a value was removed, false if the value was not existing.
+ */
+bool roaring_bitmap_remove_checked(roaring_bitmap_t *r, uint32_t x);
+
+/**
+ * Remove value n_args from pointer vals, faster than repeatedly calling
+ * roaring_bitmap_remove. Consecutive values of the same container are removed
+ * together: at once from array containers, with a single type conversion for
+ * bitset containers.
+ */
+void roaring_bitmap_remove_many(roaring_bitmap_t *r, size_t n_args,
+                                const uint32_t *vals);
+
+/**
+ * Same as roaring_bitmap_remove_many, returning how many of the values were
+ * in the bitmap.
+ */
+uint64_t roaring_bitmap_remove_many_checked(roaring_bitmap_t *r, size_t n_args,
+                                            const uint32_t *vals);
+
+/**
+ * Add all values in [min, max). Containers wholly inside the range become
+ * full run containers, so the cost is in the number of containers touched
+ * rather than in the number of values.
+ */
+void roaring_bitmap_add_range(roaring_bitmap_t *r, uint64_t min, uint64_t max);
+
+/**
+ * Remove all values in [min, max). Containers wholly inside the range are
+ * dropped without being looked at.
+ */
+void roaring_bitmap_remove_range(roaring_bitmap_t *r, uint64_t min, uint64_t max);
+
+/**
+ * Returns the number of values in [range_start, range_end). Only the
+ * containers at both ends of the range are searched.
+ */
+uint64_t roaring_bitmap_range_cardinality(const roaring_bitmap_t *r,
+                                          uint64_t range_start,
+                                          uint64_t range_end);
+
+/**
+ * Check whether all values in [range_start, range_end) are present. An empty
+ * range is always contained.
+ */
+bool roaring_bitmap_contains_range(const roaring_bitmap_t *r,
+                                   uint64_t range_start, uint64_t range_end);
+
 /**
  * Check if value x is present
  */
@@ -5534,6 +5872,16 @@ inline bool roaring_bitmap_contains(const roaring_bitmap_t *r,
     return container_contains(container, val & 0xFFFF, typecode);
 }
 
+/**
+ * Check which of the n_args values of vals are present, setting answer[i]
+ * for vals[i]. The values must be sorted in increasing order, repeats being
+ * allowed: the containers are then visited once, with galloping searches
+ * through the keys and the array containers, and direct bit tests in the
+ * bitset containers.
+ */
+void roaring_bitmap_contains_many(const roaring_bitmap_t *r, size_t n_args,
+                                  const uint32_t *vals, bool *answer);
+
 /**
  * Get the cardinality of the bitmap (number of elements).
  */
@@ -5609,6 +5957,86 @@ size_t roaring_bitmap_size_in_bytes(const roaring_bitmap_t *ra);
  */
 roaring_bitmap_t *roaring_bitmap_portable_deserialize(const char *buf);
 
+/**
+ * read a bitmap in the format of roaring_bitmap_portable_serialize from a
+ * stream: read(buf, len, param) is called for every piece of the input, in
+ * order, and the containers are built as they arrive, so that the whole
+ * serialized bitmap never needs to be in memory. Unlike
+ * roaring_bitmap_portable_deserialize, the input is validated: returns NULL
+ * if it cannot be read or is not a valid bitmap.
+ */
+roaring_bitmap_t *roaring_bitmap_portable_deserialize_stream(
+    roaring_read_callback read, void *param);
+
+/**
+ * Check how many bytes would be read (up to maxbytes) at this pointer if there
+ * is a bitmap in the format of roaring_bitmap_portable_serialize, returns zero
+ * if there is no valid bitmap. The whole bitmap is validated, like
+ * roaring_bitmap_portable_deserialize_stream does, but nothing is allocated.
+ */
+size_t roaring_bitmap_portable_deserialize_size(const char *buf, size_t maxbytes);
+
+/**
+ * Check if value x is present in a bitmap serialized with
+ * roaring_bitmap_portable_serialize, without deserializing it: only the
+ * container that could hold x is read. The buffer must have been validated
+ * with roaring_bitmap_portable_deserialize_size.
+ */
+bool roaring_bitmap_portable_contains(const char *buf, uint32_t x);
+
+/**
+ * Cardinality of a bitmap serialized with roaring_bitmap_portable_serialize,
+ * read from the header alone. The buffer must have been validated with
+ * roaring_bitmap_portable_deserialize_size.
+ */
+uint64_t roaring_bitmap_portable_cardinality(const char *buf);
+
+/**
+ * How many bytes are required to serialize this bitmap with
+ * roaring_bitmap_frozen_serialize.
+ */
+size_t roaring_bitmap_frozen_size_in_bytes(const roaring_bitmap_t *rb);
+
+/**
+ * Serializes the bitmap in the frozen format, that roaring_bitmap_frozen_view
+ * can use in place. The buffer must hold at least
+ * roaring_bitmap_frozen_size_in_bytes(rb) bytes, it does not need to be
+ * aligned. The frozen format is not compatible with other languages and
+ * uses the byte order of the machine.
+ */
+void roaring_bitmap_frozen_serialize(const roaring_bitmap_t *rb, char *buf);
+
+/**
+ * Creates a read-only bitmap that is a view of a buffer written by
+ * roaring_bitmap_frozen_serialize: the containers point into the buffer
+ * instead of being copied, and the only allocation is a single block for the
+ * container headers. The buffer must be aligned on 32 bytes and length must be
+ * exactly roaring_bitmap_frozen_size_in_bytes. Returns NULL if the buffer is
+ * not a frozen bitmap.
+ *
+ * The view can be used wherever a const bitmap is expected (contains,
+ * cardinality, the set operations, iteration...) and must be freed with
+ * roaring_bitmap_free. It must not be modified, nor made copy-on-write, and the
+ * buffer must outlive it. Copies of the view are regular bitmaps.
+ *
+ * Only the layout is checked, which takes time in the number of containers:
+ * the containers are trusted to hold what their header says. Buffers that may
+ * have been tampered with or damaged should go through
+ * roaring_bitmap_frozen_view_checked instead.
+ */
+const roaring_bitmap_t *roaring_bitmap_frozen_view(const char *buf,
+                                                   size_t length);
+
+/**
+ * Like roaring_bitmap_frozen_view, but also validates every container the way
+ * roaring_bitmap_portable_deserialize_size does: bitsets must hold as many
+ * values as their count, array values must be strictly increasing and runs
+ * sorted, disjoint and within their chunk. Reads the whole buffer once.
+ * Returns NULL if any check fails.
+ */
+const roaring_bitmap_t *roaring_bitmap_frozen_view_checked(const char *buf,
+                                                           size_t length);
+
 
 /**
  * How many bytes are required to serialize this bitmap (meant to be compatible
@@ -5626,6 +6054,22 @@ size_t roaring_bitmap_portable_size_in_bytes(const roaring_bitmap_t *ra);
  */
 size_t roaring_bitmap_portable_serialize(const roaring_bitmap_t *ra, char *buf);
 
+/**
+ * How many bytes of roaring_bitmap_portable_serialize come before the first
+ * container.
+ */
+size_t roaring_bitmap_portable_header_size_in_bytes(const roaring_bitmap_t *ra);
+
+/**
+ * Writes only the header of roaring_bitmap_portable_serialize to a buffer of
+ * roaring_bitmap_portable_header_size_in_bytes(ra) bytes. The header followed
+ * by the serialized containers, in key order, is the full portable format,
+ * which lets callers stream large bitmaps one container at a time rather
+ * than through a single buffer. Returns how many bytes were written.
+ */
+size_t roaring_bitmap_portable_serialize_header(const roaring_bitmap_t *ra,
+                                                char *buf);
+
 /**
  * Iterate over the bitmap elements. The function iterator is called once for
  *  all the values with ptr (can be NULL) as the second parameter of each call.
@@ -5750,6 +6194,59 @@ bool roaring_bitmap_select(const roaring_bitmap_t *ra, uint32_t rank,
 */
 uint64_t  roaring_bitmap_rank(const roaring_bitmap_t *bm, uint32_t x);
 
+// a block of a bitset container in the rank index covers 1024 bits
+#define ROARING_RANK_BLOCK_WORDS 16
+#define ROARING_RANK_BLOCKS (BITSET_CONTAINER_SIZE_IN_WORDS / ROARING_RANK_BLOCK_WORDS)
+
+/**
+ * Cumulative cardinalities of a bitmap, for rank and select in O(log n)
+ * instead of a scan over the containers. Bitset containers also get the
+ * number of values before each of their blocks of 1024 bits, so at most one
+ * block is counted within them.
+ *
+ * The index describes the bitmap as it was when the index was created: any
+ * write to the bitmap makes it stale, and it must be created anew.
+ */
+typedef struct roaring_rank_index_s {
+    int32_t size;
+    // size + 1 entries, values in the containers before each container
+    uint64_t *cumulative;
+    // for each container, the first of its entries in block_ranks, or -1 if
+    // it is not a bitset container
+    int32_t *blocks;
+    // ROARING_RANK_BLOCKS entries per bitset container, values in the
+    // container before each block
+    uint16_t *block_ranks;
+    int32_t n_bitsets;
+} roaring_rank_index_t;
+
+/**
+ * Builds the rank index of a bitmap, in a single pass over its containers.
+ * Returns NULL if memory runs out.
+ */
+roaring_rank_index_t *roaring_rank_index_create(const roaring_bitmap_t *r);
+
+void roaring_rank_index_free(roaring_rank_index_t *index);
+
+/**
+ * Memory used by the index, in bytes.
+ */
+size_t roaring_rank_index_size_in_bytes(const roaring_rank_index_t *index);
+
+/**
+ * Same as roaring_bitmap_rank, using the index of r.
+ */
+uint64_t roaring_bitmap_rank_indexed(const roaring_bitmap_t *r,
+                                     const roaring_rank_index_t *index,
+                                     uint32_t x);
+
+/**
+ * Same as roaring_bitmap_select, using the index of r.
+ */
+bool roaring_bitmap_select_indexed(const roaring_bitmap_t *r,
+                                   const roaring_rank_index_t *index,
+                                   uint64_t rank, uint32_t *element);
+
 
 /**
 * roaring_bitmap_smallest returns the smallest value in the set.
@@ -5816,6 +6313,13 @@ typedef struct roaring_uint32_iterator_s {
 */
 roaring_uint32_iterator_t * roaring_create_iterator(const roaring_bitmap_t *ra);
 
+/**
+* Same as roaring_create_iterator, except that the iterator is positioned on
+* the last value, to traverse the values in decreasing order with
+* roaring_previous_uint32_iterator.
+*/
+roaring_uint32_iterator_t * roaring_create_iterator_last(const roaring_bitmap_t *ra);
+
 /**
 * Advance the iterator. If there is a new value, then it->has_value is true.
 * The new value is in it->current_value. Values are traversed in increasing
@@ -5823,6 +6327,37 @@ roaring_uint32_iterator_t * roaring_create_iterator(const roaring_bitmap_t *ra);
 */
 bool roaring_advance_uint32_iterator(roaring_uint32_iterator_t *it);
 
+/**
+* Move the iterator back. If there is a previous value, then it->has_value is true.
+* The new value is in it->current_value. Values are traversed in decreasing
+* orders. For convenience, returns it->has_value. An iterator that went past
+* the last value moves back to it, and one that went past the first value
+* moves forward to it with roaring_advance_uint32_iterator.
+*/
+bool roaring_previous_uint32_iterator(roaring_uint32_iterator_t *it);
+
+/**
+* Move the iterator to the first value >= val. If there is a such a value, then it->has_value is true.
+* The new value is in it->current_value. For convenience, returns it->has_value.
+* The iterator may move backward, any value of the bitmap can be reached from any position.
+*/
+bool roaring_move_uint32_iterator_equalorlarger(roaring_uint32_iterator_t *it, uint32_t val) ;
+
+/**
+* Reads next ${count} values from iterator into user-supplied ${buf}.
+* Returns the number of read elements.
+* This number can be smaller than ${count}, which means that iterator is drained.
+*
+* This function satisfies semantics of iteration and can be used together with
+* other iterator functions.
+*  - first value is copied from ${it}->current_value
+*  - after function returns, iterator is positioned at the next element
+*
+* Whole containers that fit in the buffer are decoded at once, which is
+* much faster than advancing the iterator one value at a time.
+*/
+uint32_t roaring_read_uint32_iterator(roaring_uint32_iterator_t *it, uint32_t* buf, uint32_t count);
+
 /**
 * Creates a copy of an iterator.
 * Caller must free it.
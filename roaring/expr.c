@@ -0,0 +1,607 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "./expr.h"
+
+/* Deeper nesting than this is rejected instead of exhausting the stack */
+#define EXPR_MAX_DEPTH 128
+
+typedef enum {
+    EXPR_KEY,
+    EXPR_AND,
+    EXPR_OR,
+    EXPR_XOR,
+    EXPR_ANDNOT, /* children[0] minus every other child */
+} ExprOp;
+
+typedef struct ExprNode {
+    ExprOp op;
+    const char* key;
+    size_t keylen;
+    const roaring_bitmap_t* bitmap; /* EXPR_KEY only, NULL for a missing key */
+    struct ExprNode** children;
+    size_t count;
+    size_t capacity;
+    uint64_t estimate; /* upper bound of the cardinality, set by the planner */
+} ExprNode;
+
+struct RoaringExpr {
+    ExprNode* root;
+    ExprNode** keys;
+    size_t key_count;
+    size_t key_capacity;
+    bool planned;
+};
+
+typedef struct {
+    const char* p;
+    const char* end;
+    RoaringExpr* expr;
+    const char* err;
+    int depth;
+} ExprParser;
+
+/* Result of evaluating a node: either a borrowed key bitmap or a temporary */
+typedef struct {
+    const roaring_bitmap_t* bitmap; /* NULL for an empty set */
+    bool owned;
+} ExprValue;
+
+static ExprNode* node_new(ExprOp op) {
+    ExprNode* node = calloc(1, sizeof(ExprNode));
+    if (node != NULL) node->op = op;
+    return node;
+}
+
+static void node_free(ExprNode* node) {
+    if (node == NULL) return;
+    for (size_t i = 0; i < node->count; i++) {
+        node_free(node->children[i]);
+    }
+    free(node->children);
+    free(node);
+}
+
+static bool node_push(ExprNode* node, ExprNode* child) {
+    if (node->count == node->capacity) {
+        size_t capacity = node->capacity ? node->capacity * 2 : 4;
+        ExprNode** children = realloc(node->children, capacity * sizeof(ExprNode*));
+        if (children == NULL) return false;
+        node->children = children;
+        node->capacity = capacity;
+    }
+    node->children[node->count++] = child;
+    return true;
+}
+
+static ExprNode* node_binary(ExprOp op, ExprNode* left, ExprNode* right) {
+    ExprNode* node = node_new(op);
+    if (node == NULL || !node_push(node, left) || !node_push(node, right)) {
+        node_free(node);
+        return NULL;
+    }
+    return node;
+}
+
+/* ------------------------------------------------------------------------
+ * Parser
+ * ------------------------------------------------------------------------ */
+
+static bool is_operator(char c) {
+    return c == '(' || c == ')' || c == '&' || c == '|' || c == '^' || c == '-' || c == '"';
+}
+
+static bool is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+static char parser_peek(ExprParser* ps) {
+    while (ps->p < ps->end && is_space(*ps->p)) ps->p++;
+    return ps->p < ps->end ? *ps->p : '\0';
+}
+
+static ExprNode* parse_or(ExprParser* ps);
+
+static ExprNode* parse_key(ExprParser* ps) {
+    const char* start;
+    size_t len;
+
+    if (*ps->p == '"') {
+        start = ++ps->p;
+        while (ps->p < ps->end && *ps->p != '"') ps->p++;
+        if (ps->p == ps->end) {
+            ps->err = "ERR syntax error in expression: unterminated quoted key";
+            return NULL;
+        }
+        len = ps->p++ - start;
+    } else {
+        start = ps->p;
+        while (ps->p < ps->end && !is_space(*ps->p) && !is_operator(*ps->p)) ps->p++;
+        len = ps->p - start;
+    }
+    if (len == 0) {
+        ps->err = "ERR syntax error in expression: empty key name";
+        return NULL;
+    }
+
+    RoaringExpr* expr = ps->expr;
+    if (expr->key_count == expr->key_capacity) {
+        size_t capacity = expr->key_capacity ? expr->key_capacity * 2 : 8;
+        ExprNode** keys = realloc(expr->keys, capacity * sizeof(ExprNode*));
+        if (keys == NULL) return NULL;
+        expr->keys = keys;
+        expr->key_capacity = capacity;
+    }
+    ExprNode* node = node_new(EXPR_KEY);
+    if (node == NULL) return NULL;
+    node->key = start;
+    node->keylen = len;
+    expr->keys[expr->key_count++] = node;
+    return node;
+}
+
+static ExprNode* parse_factor(ExprParser* ps) {
+    char c = parser_peek(ps);
+
+    if (c == '(') {
+        if (++ps->depth > EXPR_MAX_DEPTH) {
+            ps->err = "ERR expression is nested too deeply";
+            return NULL;
+        }
+        ps->p++;
+        ExprNode* node = parse_or(ps);
+        if (node == NULL) return NULL;
+        if (parser_peek(ps) != ')') {
+            ps->err = "ERR syntax error in expression: missing ')'";
+            node_free(node);
+            return NULL;
+        }
+        ps->p++;
+        ps->depth--;
+        return node;
+    }
+    if (c == '\0' || (is_operator(c) && c != '"')) {
+        ps->err = c == '\0' ? "ERR syntax error in expression: unexpected end"
+                            : "ERR syntax error in expression: expected a key or '('";
+        return NULL;
+    }
+    return parse_key(ps);
+}
+
+/* '&' and '-' bind equally and associate to the left */
+static ExprNode* parse_term(ExprParser* ps) {
+    ExprNode* left = parse_factor(ps);
+    ExprNode* chain = NULL; /* n-ary node built by this loop, extended in place */
+
+    while (left != NULL) {
+        char c = parser_peek(ps);
+        if (c != '&' && c != '-') break;
+        ExprOp op = c == '&' ? EXPR_AND : EXPR_ANDNOT;
+        ps->p++;
+
+        ExprNode* right = parse_factor(ps);
+        if (right == NULL) {
+            node_free(left);
+            return NULL;
+        }
+        if (left == chain && chain->op == op) {
+            if (!node_push(chain, right)) {
+                node_free(right);
+                node_free(left);
+                return NULL;
+            }
+            continue;
+        }
+        chain = node_binary(op, left, right);
+        if (chain == NULL) {
+            node_free(left);
+            node_free(right);
+            return NULL;
+        }
+        left = chain;
+    }
+    return left;
+}
+
+static ExprNode* parse_chain(ExprParser* ps, char token, ExprOp op, ExprNode* (*operand)(ExprParser*)) {
+    ExprNode* left = operand(ps);
+    if (left == NULL || parser_peek(ps) != token) return left;
+
+    ExprNode* node = node_new(op);
+    if (node == NULL || !node_push(node, left)) {
+        node_free(node);
+        node_free(left);
+        return NULL;
+    }
+    while (parser_peek(ps) == token) {
+        ps->p++;
+        ExprNode* right = operand(ps);
+        if (right == NULL || !node_push(node, right)) {
+            node_free(right);
+            node_free(node);
+            return NULL;
+        }
+    }
+    return node;
+}
+
+static ExprNode* parse_xor(ExprParser* ps) {
+    return parse_chain(ps, '^', EXPR_XOR, parse_term);
+}
+
+static ExprNode* parse_or(ExprParser* ps) {
+    return parse_chain(ps, '|', EXPR_OR, parse_xor);
+}
+
+RoaringExpr* RoaringExpr_Parse(const char* text, size_t len, const char** err) {
+    RoaringExpr* expr = calloc(1, sizeof(RoaringExpr));
+    ExprParser ps = {text, text + len, expr, NULL, 0};
+
+    *err = "ERR out of memory";
+    if (expr == NULL) return NULL;
+    expr->root = parse_or(&ps);
+    parser_peek(&ps);
+    if (expr->root != NULL && ps.p < ps.end) {
+        ps.err = *ps.p == ')' ? "ERR syntax error in expression: unexpected ')'"
+                              : "ERR syntax error in expression: expected an operator";
+        node_free(expr->root);
+        expr->root = NULL;
+    }
+    if (expr->root == NULL) {
+        if (ps.err != NULL) *err = ps.err;
+        free(expr->keys);
+        free(expr);
+        return NULL;
+    }
+    return expr;
+}
+
+void RoaringExpr_Free(RoaringExpr* expr) {
+    if (expr == NULL) return;
+    node_free(expr->root);
+    free(expr->keys);
+    free(expr);
+}
+
+size_t RoaringExpr_KeyCount(const RoaringExpr* expr) {
+    return expr->key_count;
+}
+
+const char* RoaringExpr_KeyName(const RoaringExpr* expr, size_t i, size_t* len) {
+    *len = expr->keys[i]->keylen;
+    return expr->keys[i]->key;
+}
+
+void RoaringExpr_SetKeyBitmap(RoaringExpr* expr, size_t i, const roaring_bitmap_t* bitmap) {
+    expr->keys[i]->bitmap = bitmap;
+}
+
+/* ------------------------------------------------------------------------
+ * Planner
+ * ------------------------------------------------------------------------ */
+
+/* Moves the children of `child` into `node`, in place of `child` */
+static bool node_absorb(ExprNode* node, size_t i, ExprNode* child) {
+    size_t extra = child->count - 1;
+    size_t count = node->count + extra;
+
+    if (count > node->capacity) {
+        ExprNode** children = realloc(node->children, count * sizeof(ExprNode*));
+        if (children == NULL) return false;
+        node->children = children;
+        node->capacity = count;
+    }
+    memmove(node->children + i + child->count, node->children + i + 1,
+            (node->count - i - 1) * sizeof(ExprNode*));
+    memcpy(node->children + i, child->children, child->count * sizeof(ExprNode*));
+    node->count = count;
+    child->count = 0;
+    node_free(child);
+    return true;
+}
+
+static int compare_estimates(const void* a, const void* b) {
+    uint64_t x = (*(ExprNode* const*)a)->estimate;
+    uint64_t y = (*(ExprNode* const*)b)->estimate;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * Rewrites the tree bottom-up and computes cardinality estimates:
+ *
+ *  - nested AND/OR/XOR nodes of the same kind are flattened, so are the
+ *    left-hand sides of nested differences: (a - b) - c => a - (b, c)
+ *  - differences are pulled out of intersections: a & (b - c) => (a & b) - c,
+ *    so that the intersection runs first and the subtrahend is only applied
+ *    to what is left of it
+ *  - leaves are estimated with their exact cardinality, intersections with
+ *    the smallest input, unions and symmetric differences with the sum of
+ *    the inputs, differences with their left-hand side
+ *  - the inputs of intersections are sorted smallest first
+ */
+static ExprNode* plan(ExprNode* node) {
+    if (node->op == EXPR_KEY) {
+        node->estimate = node->bitmap ? roaring_bitmap_get_cardinality(node->bitmap) : 0;
+        return node;
+    }
+
+    for (size_t i = 0; i < node->count; i++) {
+        node->children[i] = plan(node->children[i]);
+    }
+    if (node->op != EXPR_ANDNOT) {
+        for (size_t i = 0; i < node->count; i++) {
+            ExprNode* child = node->children[i];
+            if (child->op == node->op && node_absorb(node, i, child)) i--;
+        }
+    } else if (node->children[0]->op == EXPR_ANDNOT) {
+        node_absorb(node, 0, node->children[0]);
+    }
+
+    /* Keep the minuends in the intersection and move the subtrahends out */
+    ExprNode* andnot = NULL;
+    if (node->op == EXPR_AND) {
+        size_t subtrahends = 0;
+        for (size_t i = 0; i < node->count; i++) {
+            if (node->children[i]->op == EXPR_ANDNOT) subtrahends += node->children[i]->count - 1;
+        }
+        if (subtrahends > 0) andnot = node_new(EXPR_ANDNOT);
+        if (andnot != NULL) {
+            andnot->capacity = subtrahends + 1;
+            andnot->children = malloc(andnot->capacity * sizeof(ExprNode*));
+            if (andnot->children == NULL) {
+                free(andnot);
+                andnot = NULL;
+            }
+        }
+        if (andnot != NULL) {
+            andnot->children[andnot->count++] = node;
+            for (size_t i = 0; i < node->count; i++) {
+                ExprNode* child = node->children[i];
+                if (child->op != EXPR_ANDNOT) continue;
+                memcpy(andnot->children + andnot->count, child->children + 1,
+                       (child->count - 1) * sizeof(ExprNode*));
+                andnot->count += child->count - 1;
+                node->children[i] = child->children[0];
+                child->count = 0;
+                node_free(child);
+                if (node->children[i]->op == EXPR_AND && node_absorb(node, i, node->children[i])) i--;
+            }
+        }
+    }
+
+    switch (node->op) {
+        case EXPR_AND:
+            qsort(node->children, node->count, sizeof(ExprNode*), compare_estimates);
+            node->estimate = node->children[0]->estimate;
+            break;
+        case EXPR_OR:
+        case EXPR_XOR:
+            node->estimate = 0;
+            for (size_t i = 0; i < node->count; i++) {
+                node->estimate += node->children[i]->estimate;
+            }
+            break;
+        default:
+            node->estimate = node->children[0]->estimate;
+            break;
+    }
+    if (andnot != NULL) {
+        andnot->estimate = node->estimate;
+        return andnot;
+    }
+    return node;
+}
+
+static void expr_plan(RoaringExpr* expr) {
+    if (!expr->planned) {
+        expr->root = plan(expr->root);
+        expr->planned = true;
+    }
+}
+
+/* ------------------------------------------------------------------------
+ * Evaluation
+ * ------------------------------------------------------------------------ */
+
+static const ExprValue EMPTY = {NULL, false};
+
+static void value_release(ExprValue v) {
+    if (v.owned) roaring_bitmap_free((roaring_bitmap_t*)v.bitmap);
+}
+
+static ExprValue value_owned(roaring_bitmap_t* bitmap) {
+    if (roaring_bitmap_is_empty(bitmap)) {
+        roaring_bitmap_free(bitmap);
+        return EMPTY;
+    }
+    return (ExprValue){bitmap, true};
+}
+
+static ExprValue evaluate(const ExprNode* node);
+
+static ExprValue evaluate_and(const ExprNode* node, size_t count) {
+    if (node->children[0]->estimate == 0) return EMPTY;
+
+    ExprValue acc = evaluate(node->children[0]);
+    for (size_t i = 1; i < count && acc.bitmap != NULL; i++) {
+        ExprValue v = evaluate(node->children[i]);
+        if (v.bitmap == NULL) {
+            value_release(acc);
+            return EMPTY;
+        }
+        if (acc.owned) {
+            roaring_bitmap_and_inplace((roaring_bitmap_t*)acc.bitmap, v.bitmap);
+            acc = value_owned((roaring_bitmap_t*)acc.bitmap);
+        } else {
+            acc = value_owned(roaring_bitmap_and(acc.bitmap, v.bitmap));
+        }
+        value_release(v);
+    }
+    return acc;
+}
+
+/* Evaluates the inputs of a union-like node, dropping the empty ones */
+static size_t evaluate_children(const ExprNode* node, size_t from, ExprValue* values) {
+    size_t n = 0;
+    for (size_t i = from; i < node->count; i++) {
+        if (node->children[i]->estimate == 0) continue;
+        ExprValue v = evaluate(node->children[i]);
+        if (v.bitmap != NULL) values[n++] = v;
+    }
+    return n;
+}
+
+/* Unions and symmetric differences accumulate lazily into a temporary */
+static ExprValue evaluate_lazy(const ExprNode* node) {
+    ExprValue* values = malloc(node->count * sizeof(ExprValue));
+    if (values == NULL) return EMPTY;
+    size_t n = evaluate_children(node, 0, values);
+    bool is_or = node->op == EXPR_OR;
+
+    if (n <= 1) {
+        ExprValue v = n ? values[0] : EMPTY;
+        free(values);
+        return v;
+    }
+
+    /* Reuse the largest temporary as the accumulator when there is one */
+    size_t acc_index = n;
+    uint64_t acc_card = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (!values[i].owned) continue;
+        uint64_t card = roaring_bitmap_get_cardinality(values[i].bitmap);
+        if (acc_index == n || card > acc_card) {
+            acc_index = i;
+            acc_card = card;
+        }
+    }
+
+    roaring_bitmap_t* acc;
+    size_t skip = acc_index, skip2 = n;
+    if (acc_index < n) {
+        acc = (roaring_bitmap_t*)values[acc_index].bitmap;
+    } else {
+        acc = is_or ? roaring_bitmap_lazy_or(values[0].bitmap, values[1].bitmap, LAZY_OR_BITSET_CONVERSION)
+                    : roaring_bitmap_lazy_xor(values[0].bitmap, values[1].bitmap);
+        skip = 0;
+        skip2 = 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if (i == skip || i == skip2) continue;
+        if (is_or) {
+            roaring_bitmap_lazy_or_inplace(acc, values[i].bitmap, LAZY_OR_BITSET_CONVERSION);
+        } else {
+            roaring_bitmap_lazy_xor_inplace(acc, values[i].bitmap);
+        }
+        value_release(values[i]);
+    }
+    roaring_bitmap_repair_after_lazy(acc);
+    free(values);
+    return value_owned(acc);
+}
+
+static ExprValue evaluate_andnot(const ExprNode* node) {
+    if (node->children[0]->estimate == 0) return EMPTY;
+
+    ExprValue acc = evaluate(node->children[0]);
+    for (size_t i = 1; i < node->count && acc.bitmap != NULL; i++) {
+        if (node->children[i]->estimate == 0) continue;
+        ExprValue v = evaluate(node->children[i]);
+        if (v.bitmap == NULL) continue;
+        if (acc.owned) {
+            roaring_bitmap_andnot_inplace((roaring_bitmap_t*)acc.bitmap, v.bitmap);
+            acc = value_owned((roaring_bitmap_t*)acc.bitmap);
+        } else {
+            acc = value_owned(roaring_bitmap_andnot(acc.bitmap, v.bitmap));
+        }
+        value_release(v);
+    }
+    return acc;
+}
+
+static ExprValue evaluate(const ExprNode* node) {
+    switch (node->op) {
+        case EXPR_KEY:
+            if (node->bitmap == NULL || roaring_bitmap_is_empty(node->bitmap)) return EMPTY;
+            return (ExprValue){node->bitmap, false};
+        case EXPR_AND:
+            return evaluate_and(node, node->count);
+        case EXPR_ANDNOT:
+            return evaluate_andnot(node);
+        default:
+            return evaluate_lazy(node);
+    }
+}
+
+roaring_bitmap_t* RoaringExpr_Evaluate(RoaringExpr* expr) {
+    expr_plan(expr);
+    ExprValue v = evaluate(expr->root);
+    if (v.bitmap == NULL) return roaring_bitmap_create();
+    if (v.owned) return (roaring_bitmap_t*)v.bitmap;
+    return roaring_bitmap_copy(v.bitmap);
+}
+
+uint64_t RoaringExpr_Cardinality(RoaringExpr* expr) {
+    expr_plan(expr);
+    const ExprNode* root = expr->root;
+    uint64_t card = 0;
+
+    if (root->estimate == 0) return 0;
+
+    switch (root->op) {
+        case EXPR_AND: {
+            /* Intersect all but the largest input, then only count the last step */
+            ExprValue acc = evaluate_and(root, root->count - 1);
+            if (acc.bitmap == NULL) return 0;
+            ExprValue last = evaluate(root->children[root->count - 1]);
+            if (last.bitmap != NULL) card = roaring_bitmap_and_cardinality(acc.bitmap, last.bitmap);
+            value_release(acc);
+            value_release(last);
+            return card;
+        }
+        case EXPR_OR:
+        case EXPR_ANDNOT: {
+            /* Both reduce to "union of includes minus union of excludes" */
+            ExprValue* values = malloc(root->count * sizeof(ExprValue));
+            if (values == NULL) return 0;
+            size_t n_include, n_exclude = 0;
+            if (root->op == EXPR_OR) {
+                n_include = evaluate_children(root, 0, values);
+            } else {
+                values[0] = evaluate(root->children[0]);
+                n_include = values[0].bitmap != NULL;
+                if (n_include) n_exclude = evaluate_children(root, 1, values + 1);
+            }
+            const roaring_bitmap_t** bitmaps = malloc((n_include + n_exclude + 1) * sizeof(roaring_bitmap_t*));
+            if (bitmaps != NULL) {
+                for (size_t i = 0; i < n_include + n_exclude; i++) bitmaps[i] = values[i].bitmap;
+                card = roaring_bitmap_or_many_andnot_cardinality(n_include, bitmaps, n_exclude, bitmaps + n_include);
+                free(bitmaps);
+            }
+            for (size_t i = 0; i < n_include + n_exclude; i++) value_release(values[i]);
+            free(values);
+            return card;
+        }
+        case EXPR_XOR:
+            if (root->count == 2) {
+                ExprValue a = evaluate(root->children[0]);
+                ExprValue b = evaluate(root->children[1]);
+                if (a.bitmap == NULL || b.bitmap == NULL) {
+                    card = a.bitmap ? roaring_bitmap_get_cardinality(a.bitmap)
+                                    : b.bitmap ? roaring_bitmap_get_cardinality(b.bitmap) : 0;
+                } else {
+                    card = roaring_bitmap_xor_cardinality(a.bitmap, b.bitmap);
+                }
+                value_release(a);
+                value_release(b);
+                return card;
+            }
+            /* fall through */
+        default: {
+            ExprValue v = evaluate(root);
+            if (v.bitmap != NULL) card = roaring_bitmap_get_cardinality(v.bitmap);
+            value_release(v);
+            return card;
+        }
+    }
+}
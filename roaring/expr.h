@@ -0,0 +1,66 @@
+#ifndef __ROARING_EXPR_H__
+#define __ROARING_EXPR_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "./croaring.h"
+
+/**
+ * Set algebra expressions over bitmaps, as used by ROARING.EVAL and ROARING.EVALSTORE.
+ *
+ * Grammar, from the loosest to the tightest binding operator:
+ *
+ *     expr   := xor ('|' xor)*           union
+ *     xor    := term ('^' term)*         symmetric difference
+ *     term   := factor (('&' | '-') factor)*   intersection, difference
+ *     factor := '(' expr ')' | key
+ *
+ * A key is any run of characters other than whitespace, parentheses and the
+ * operators above, or a string in double quotes. A '-' is always an operator,
+ * so `a-b` is a difference and a key named `user-1` has to be quoted.
+ *
+ * The expression knows nothing about Redis: once parsed, the caller resolves
+ * every key to a bitmap (or NULL for a missing key) and then asks for the
+ * result. Nodes are never evaluated before all of their inputs are known.
+ */
+typedef struct RoaringExpr RoaringExpr;
+
+/**
+ * Parses an expression. Returns NULL and points `err` at a static message
+ * if the text is not a valid expression.
+ */
+RoaringExpr *RoaringExpr_Parse(const char *text, size_t len, const char **err);
+
+/* Frees the expression. Resolved bitmaps are borrowed and are not freed. */
+void RoaringExpr_Free(RoaringExpr *expr);
+
+/* Number of key references in the expression, in order of appearance */
+size_t RoaringExpr_KeyCount(const RoaringExpr *expr);
+
+/* Name of the i-th key reference, not NUL terminated */
+const char *RoaringExpr_KeyName(const RoaringExpr *expr, size_t i, size_t *len);
+
+/* Binds the i-th key reference to a bitmap, NULL meaning an empty set */
+void RoaringExpr_SetKeyBitmap(RoaringExpr *expr, size_t i, const roaring_bitmap_t *bitmap);
+
+/**
+ * Plans and evaluates the expression. Every key must have been bound.
+ *
+ * The planner flattens nested operators of the same kind, pulls differences
+ * out of intersections so that the intersection is computed first, orders
+ * intersections from the smallest estimated input to the largest, stops as
+ * soon as an intersection or a difference becomes empty and uses lazy unions
+ * for wide ORs.
+ *
+ * Returns a new bitmap owned by the caller.
+ */
+roaring_bitmap_t *RoaringExpr_Evaluate(RoaringExpr *expr);
+
+/**
+ * Same as RoaringExpr_Evaluate, but only returns the cardinality. The last
+ * operation of the plan is done with the count-only kernels, so the final
+ * result is never materialized.
+ */
+uint64_t RoaringExpr_Cardinality(RoaringExpr *expr);
+
+#endif
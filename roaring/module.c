@@ -1,8 +1,17 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "../redismodule.h"
 #include "../rmutil/util.h"
 #include "../rmutil/strings.h"
 #include "../rmutil/test_util.h"
 #include "./croaring.h"
+#include "./blob.h"
+#include "./expr.h"
+#include "./pool.h"
 
 #define malloc RedisModule_Alloc
 #define calloc RedisModule_Calloc
@@ -13,6 +22,232 @@
 
 static RedisModuleType *RoaringType;
 
+// Worker pool for heavy read commands, NULL unless the module is loaded with THREADS
+static RoaringPool *Pool;
+// Commands only go to the pool once their inputs hold at least this many containers
+static long long OffloadThreshold = 1024;
+// Most values per ROARING.ADDBLOB emitted by AOF rewrite
+static long long AofBatchSize = 1024;
+// Keep keys loaded from the RDB serialized until they are first used
+static bool LazyLoad = false;
+// ROARING.ATTACH only maps files under this directory, and is disabled while it is empty
+static char AttachDir[PATH_MAX];
+
+/**
+ * Value of a roaring key.
+ *
+ * With LAZY, keys loaded from the RDB keep the portable serialization they
+ * were saved with and only become a bitmap the first time a command needs
+ * one. Until then ROARING.ISMEMBER reads the serialized bitmap directly.
+ *
+ * Keys created by ROARING.ATTACH point into a file mapping instead: either a
+ * frozen bitmap viewing the mapping, or a portable serialization served the
+ * same way as a lazy key. The first write turns them into a regular bitmap.
+ *
+ * The rank index is built by the first command that needs it, and dropped by
+ * the next write. The cardinality is counted once when it is not known, then
+ * kept up to date by the writes.
+ */
+typedef struct {
+    roaring_bitmap_t *bitmap;
+    // Portable serialization while bitmap is NULL, its first header_size bytes
+    // being the first string of the RDB encoding
+    char *serialized;
+    size_t size;
+    size_t header_size;
+    // File mapped by ROARING.ATTACH, that serialized or the frozen bitmap use
+    void *mapping;
+    size_t mapping_size;
+    roaring_rank_index_t *rank_index;
+    uint64_t cardinality;
+} RoaringValue;
+
+// Cardinality of a value that has yet to be counted
+#define CARDINALITY_UNKNOWN UINT64_MAX
+
+static RoaringValue *newValue(roaring_bitmap_t *bitmap) {
+    RoaringValue *value = calloc(1, sizeof(RoaringValue));
+    value->bitmap = bitmap;
+    value->cardinality = CARDINALITY_UNKNOWN;
+    return value;
+}
+
+static void unmapValue(RoaringValue *value) {
+    if (value->mapping != NULL) {
+        munmap(value->mapping, value->mapping_size);
+        value->mapping = NULL;
+    }
+}
+
+static roaring_bitmap_t *valueBitmap(RoaringValue *value) {
+    if (value->bitmap == NULL) {
+        // The serialization was validated when it was loaded or attached
+        value->bitmap = roaring_bitmap_portable_deserialize(value->serialized);
+        if (value->mapping != NULL) {
+            unmapValue(value);
+        } else {
+            free(value->serialized);
+        }
+        value->serialized = NULL;
+    }
+    return value->bitmap;
+}
+
+/* Bitmap stored at a key holding a roaring value, to be read only */
+static roaring_bitmap_t *getBitmap(RedisModuleKey *key) {
+    return valueBitmap(RedisModule_ModuleTypeGetValue(key));
+}
+
+/* Same as getBitmap, for commands that modify the bitmap */
+static roaring_bitmap_t *getWritableBitmap(RedisModuleKey *key) {
+    RoaringValue *value = RedisModule_ModuleTypeGetValue(key);
+    roaring_bitmap_t *bitmap = valueBitmap(value);
+    if (value->rank_index != NULL) {
+        roaring_rank_index_free(value->rank_index);
+        value->rank_index = NULL;
+    }
+    if (value->mapping != NULL) {
+        // A frozen view cannot change: its containers move to the heap
+        value->bitmap = roaring_bitmap_copy(bitmap);
+        roaring_bitmap_free(bitmap);
+        unmapValue(value);
+    }
+    return value->bitmap;
+}
+
+/* Rank index of the bitmap stored at a key, built if the key was written since */
+static const roaring_rank_index_t *getRankIndex(RedisModuleKey *key) {
+    RoaringValue *value = RedisModule_ModuleTypeGetValue(key);
+    roaring_bitmap_t *bitmap = valueBitmap(value);
+    if (value->rank_index == NULL) {
+        value->rank_index = roaring_rank_index_create(bitmap);
+    }
+    return value->rank_index;
+}
+
+/* Finds the value of a rank at a key, 0 being the rank of the smallest value */
+static bool selectValue(RedisModuleKey *key, uint64_t rank, uint32_t *element) {
+    roaring_bitmap_t *bitmap = getBitmap(key);
+    const roaring_rank_index_t *index = getRankIndex(key);
+    return index != NULL
+            ? roaring_bitmap_select_indexed(bitmap, index, rank, element)
+            : rank <= UINT32_MAX && roaring_bitmap_select(bitmap, (uint32_t)rank, element);
+}
+
+/* Number of values stored at a key, only counted if no write kept it up to date */
+static uint64_t getCardinality(RedisModuleKey *key) {
+    RoaringValue *value = RedisModule_ModuleTypeGetValue(key);
+    if (value->cardinality == CARDINALITY_UNKNOWN) {
+        value->cardinality = value->bitmap != NULL
+                ? roaring_bitmap_get_cardinality(value->bitmap)
+                : roaring_bitmap_portable_cardinality(value->serialized);
+    }
+    return value->cardinality;
+}
+
+/* Accounts for values a write added, or removed when delta is negative */
+static void addCardinality(RedisModuleKey *key, int64_t delta) {
+    RoaringValue *value = RedisModule_ModuleTypeGetValue(key);
+    if (value->cardinality != CARDINALITY_UNKNOWN) {
+        value->cardinality += (uint64_t)delta;
+    }
+}
+
+/* Stores a bitmap at a key, cardinality being CARDINALITY_UNKNOWN if it is not at hand */
+static void setBitmap(RedisModuleKey *key, roaring_bitmap_t *bitmap, uint64_t cardinality) {
+    RoaringValue *value = newValue(bitmap);
+    value->cardinality = cardinality;
+    RedisModule_ModuleTypeSetValue(key, RoaringType, value);
+}
+
+// Number of values decoded at once when replying with members
+#define REPLY_BATCH_SIZE 1024
+
+/* Replies with up to count values of the iterator, decoding them a batch at a time */
+static void replyWithValues(RedisModuleCtx *ctx, roaring_uint32_iterator_t *it, uint64_t count) {
+    uint32_t batch[REPLY_BATCH_SIZE];
+    while (count > 0) {
+        uint32_t read = roaring_read_uint32_iterator(it, batch, count < REPLY_BATCH_SIZE ? (uint32_t)count : REPLY_BATCH_SIZE);
+        if (read == 0) {
+            break;
+        }
+        for (uint32_t i = 0; i < read; i++) {
+            RedisModule_ReplyWithLongLong(ctx, batch[i]);
+        }
+        count -= read;
+    }
+}
+
+/* Replies with the array of the cardinality values of a bitmap */
+static void replyWithBitmap(RedisModuleCtx *ctx, const roaring_bitmap_t *bitmap, uint64_t cardinality) {
+    RedisModule_ReplyWithArray(ctx, cardinality);
+    roaring_uint32_iterator_t* it = roaring_create_iterator(bitmap);
+    replyWithValues(ctx, it, cardinality);
+    roaring_free_uint32_iterator(it);
+}
+
+/* A bitmap of count containers of another, from the one at index from, read where they are */
+static roaring_bitmap_t chunkView(const roaring_bitmap_t *bitmap, int32_t from, int32_t count) {
+    roaring_bitmap_t chunk = *bitmap;
+    chunk.high_low_container.keys += from;
+    chunk.high_low_container.containers += from;
+    chunk.high_low_container.typecodes += from;
+    chunk.high_low_container.size = count;
+    chunk.high_low_container.allocation_size = count;
+    return chunk;
+}
+
+// Most containers per command when a whole bitmap is replicated, about 1MB
+#define REPLICATE_CHUNK_SIZE 128
+
+/**
+ * Replicates a bitmap stored at key by value rather than by the command that
+ * computed it: ROARING.RESTORE <key> <first chunk> REPLACE, then one
+ * ROARING.RESTOREAPPEND per further chunk of containers, so neither a command
+ * nor a buffer ever holds the whole bitmap. The server wraps them in
+ * MULTI/EXEC. An empty bitmap replicates as a RESTORE that deletes the key.
+ */
+static void replicateBitmap(RedisModuleCtx *ctx, RedisModuleString *key, const roaring_bitmap_t *bitmap) {
+    int32_t size = bitmap->high_low_container.size;
+    int32_t from = 0;
+    do {
+        int32_t count = size - from < REPLICATE_CHUNK_SIZE ? size - from : REPLICATE_CHUNK_SIZE;
+        roaring_bitmap_t chunk = chunkView(bitmap, from, count);
+        size_t size_in_bytes = roaring_bitmap_portable_size_in_bytes(&chunk);
+        char *serialized = malloc(size_in_bytes);
+        roaring_bitmap_portable_serialize(&chunk, serialized);
+        if (from == 0) {
+            RedisModule_Replicate(ctx, "ROARING.RESTORE", "sbc", key, serialized, size_in_bytes, "REPLACE");
+        } else {
+            RedisModule_Replicate(ctx, "ROARING.RESTOREAPPEND", "sb", key, serialized, size_in_bytes);
+        }
+        free(serialized);
+        from += count;
+    } while (from < size);
+}
+
+/* Below this many values, adding them one container at a time beats sorting them first */
+#define SORT_MIN_VALUES 64
+
+/* Adds or removes values at a key, returns how many were added or removed */
+static uint64_t applyValues(RedisModuleKey *key, roaring_bitmap_t *bitmap, bool adding, size_t count, const uint32_t *values) {
+    if (adding) {
+        // Increasing values past the last one, like new ids, are appended without searching
+        if (roaring_bitmap_append_many(bitmap, count, values)) {
+            addCardinality(key, (int64_t)count);
+            return count;
+        }
+        uint64_t added = count < SORT_MIN_VALUES
+                ? roaring_bitmap_add_many_checked(bitmap, count, values)
+                : roaring_bitmap_add_many_unsorted(bitmap, count, values);
+        addCardinality(key, (int64_t)added);
+        return added;
+    }
+    uint64_t removed = roaring_bitmap_remove_many_checked(bitmap, count, values);
+    addCardinality(key, -(int64_t)removed);
+    return removed;
+}
+
 /**
  * Since add and remove are so similar, unify them in this one path.
  *
@@ -33,6 +268,7 @@ int _cmdAddOrRemove(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, boo
         long long value;
         if (RedisModule_StringToLongLong(argv[i + 2], &value) != REDISMODULE_OK) {
             RedisModule_ReplyWithError(ctx, "Invalid argument, expects <key> <int>...");
+            free(values);
             return REDISMODULE_ERR;
         } else {
             values[i] = (uint32_t)value;
@@ -46,12 +282,13 @@ int _cmdAddOrRemove(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, boo
         if (!adding) {
             // empty key and we're removing, just return with no result
             RedisModule_ReplyWithLongLong(ctx, 1);
+            free(values);
             return REDISMODULE_OK;
         }
 
         // If the bitmap doesn't exist, create it and store it's reference
         bitmap = roaring_bitmap_create();
-        RedisModule_ModuleTypeSetValue(key, RoaringType, bitmap);
+        setBitmap(key, bitmap, 0);
     } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
         // If it's the wrong type, quit out!
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
@@ -59,17 +296,10 @@ int _cmdAddOrRemove(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, boo
         return REDISMODULE_ERR;
     } else {
         // Otherwise we have a valid bitmap key - grab it
-        bitmap = RedisModule_ModuleTypeGetValue(key);
+        bitmap = getWritableBitmap(key);
     }
 
-    if (adding) {
-        roaring_bitmap_add_many(bitmap, count, values);
-    } else {
-        // For whatever reason there is an add_many but not a remove_many
-        for (int i = 0; i < count; i++) {
-            roaring_bitmap_remove(bitmap, values[i]);
-        }
-    }
+    applyValues(key, bitmap, adding, count, values);
 
     // If we've removed and the bitmap is empty, get rid of the key
     if (!adding && roaring_bitmap_is_empty(bitmap)) {
@@ -102,191 +332,2215 @@ int cmdRemove(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
 }
 
 /**
- * ROARING.CARD <inc1> [<inc2> ...] [! <exc1> [<exc2> ...]]
- *
- * Returns cardinality of the roaring bitmaps, excluding each after the bang (!)
+ * Multi-key counterpart of _cmdAddOrRemove: argv holds groups of
+ * <key> <count> <value>... All groups are checked before any key is written.
  */
-int cmdCard(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    char* format_err = "Expects format roaring.card included1 [included2 included3 ...] [! excluded1 [excluded2] ...]";
+int _cmdMultiAddOrRemove(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, bool adding) {
+    char* format_err = adding
+        ? "ERR syntax error, expects roaring.madd key count value... [key count value...]"
+        : "ERR syntax error, expects roaring.mremove key count value... [key count value...]";
 
-    if (argc == 1) {
+    // Keys are the first argument of each group, found by walking the counts
+    if (RedisModule_IsKeysPositionRequest(ctx)) {
+        long long count;
+        for (int i = 1; i + 1 < argc && RedisModule_StringToLongLong(argv[i + 1], &count) == REDISMODULE_OK
+                && count > 0 && count <= argc - i - 2; i += 2 + (int)count) {
+            RedisModule_KeyAtPos(ctx, i);
+        }
+        return REDISMODULE_OK;
+    }
+
+    if (argc < 4) {
         return RedisModule_WrongArity(ctx);
     }
     RedisModule_AutoMemory(ctx);
 
-    RedisModuleString* bang = RedisModule_CreateString(ctx, "!", 1);
-    bool bang_found = false;
-
-    roaring_bitmap_t* bitmap = roaring_bitmap_create();
-
-    for (int i = 1; i < argc; i++) {
-        if (RedisModule_StringCompare(argv[i], bang) == 0) {
-            if (bang_found) {
-                RedisModule_ReplyWithError(ctx, format_err);
-                roaring_bitmap_free(bitmap);
+    // Every argument but the keys and counts is a value
+    uint32_t *values = malloc((size_t)argc * sizeof(uint32_t));
+    size_t total = 0;
+    for (int i = 1; i < argc; ) {
+        long long count;
+        if (i + 1 >= argc || RedisModule_StringToLongLong(argv[i + 1], &count) != REDISMODULE_OK
+                || count <= 0 || count > argc - i - 2) {
+            RedisModule_ReplyWithError(ctx, format_err);
+            free(values);
+            return REDISMODULE_ERR;
+        }
+        for (int k = i + 2; k < i + 2 + count; k++) {
+            long long value;
+            if (RedisModule_StringToLongLong(argv[k], &value) != REDISMODULE_OK) {
+                RedisModule_ReplyWithError(ctx, "Invalid argument, expects <key> <count> <int>...");
+                free(values);
                 return REDISMODULE_ERR;
-            } else {
-                bang_found = true;
-                continue;
             }
+            values[total++] = (uint32_t)value;
         }
 
-        // Fetch the bitmap under question
-        roaring_bitmap_t* arg_bitmap;
         RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ);
-        if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
-            // If there is nothing to include or exclude, just continue on
-            continue;
-        } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
+        if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != RoaringType) {
             RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
-            roaring_bitmap_free(bitmap);
+            free(values);
             return REDISMODULE_ERR;
         }
+        i += 2 + (int)count;
+    }
 
-        // otherwise, we have a set probably!
-        arg_bitmap = RedisModule_ModuleTypeGetValue(key);
-        if (!bang_found) {
-            roaring_bitmap_or_inplace(bitmap, arg_bitmap);
-        } else {
-            roaring_bitmap_andnot_inplace(bitmap, arg_bitmap);
+    uint64_t changed = 0;
+    const uint32_t *next = values;
+    for (int i = 1; i < argc; ) {
+        long long count;
+        RedisModule_StringToLongLong(argv[i + 1], &count);
+        RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ | REDISMODULE_WRITE);
+        roaring_bitmap_t *bitmap = NULL;
+        if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) {
+            bitmap = getWritableBitmap(key);
+        } else if (adding) {
+            bitmap = roaring_bitmap_create();
+            setBitmap(key, bitmap, 0);
+        }
+        if (bitmap != NULL) {
+            changed += applyValues(key, bitmap, adding, (size_t)count, next);
+            if (!adding && roaring_bitmap_is_empty(bitmap)) {
+                RedisModule_DeleteKey(key);
+            }
         }
+        next += count;
+        i += 2 + (int)count;
     }
+    free(values);
 
-    RedisModule_ReplyWithLongLong(ctx, roaring_bitmap_get_cardinality(bitmap));
-    roaring_bitmap_free(bitmap);
+    RedisModule_ReplyWithLongLong(ctx, (long long)changed);
+    RedisModule_ReplicateVerbatim(ctx);
 
     return REDISMODULE_OK;
 }
 
 /**
- * ROARING.MEMBERS <key>
+ * ROARING.MADD <key> <count> <value>... [<key> <count> <value>...]
+ *
+ * Adds count values to each key, in a single command for many keys
  *
- * Returns all members of the bitmap
+ * Returns how many values were added overall
  */
-int cmdMembers(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    if (argc != 2) {
+int cmdMAdd(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return _cmdMultiAddOrRemove(ctx, argv, argc, true);
+}
+
+/**
+ * ROARING.MREMOVE <key> <count> <value>... [<key> <count> <value>...]
+ *
+ * Removes count values from each key, in a single command for many keys
+ *
+ * Returns how many values were removed overall
+ */
+int cmdMRemove(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return _cmdMultiAddOrRemove(ctx, argv, argc, false);
+}
+
+// Number of values decoded at once from a DELTA blob, or converted at once from
+// a plain one on big-endian hosts
+#define BLOB_BATCH_SIZE 4096
+
+/**
+ * ROARING.ADDBLOB and ROARING.REMOVEBLOB share this path.
+ *
+ * Plain blobs are used as they are, without copying the values, on
+ * little-endian hosts. DELTA blobs are checked whole before anything is
+ * written, then decoded a batch at a time.
+ */
+int _cmdBlob(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, bool adding) {
+    if (argc != 3 && argc != 4) {
         return RedisModule_WrongArity(ctx);
     }
     RedisModule_AutoMemory(ctx);
 
-    // Fetch the bitmap under question
-    roaring_bitmap_t* bitmap;
-    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    bool delta = false;
+    if (argc == 4) {
+        if (strcasecmp(RedisModule_StringPtrLen(argv[3], NULL), "delta") != 0) {
+            RedisModule_ReplyWithError(ctx, "ERR syntax error, expects <key> <blob> [DELTA]");
+            return REDISMODULE_ERR;
+        }
+        delta = true;
+    }
+
+    size_t len;
+    const char *blob = RedisModule_StringPtrLen(argv[2], &len);
+    RoaringDeltaReader reader;
+    RoaringBlob_InitDeltas(&reader, blob, len);
+    if (delta ? RoaringBlob_ReadDeltas(&reader, NULL, SIZE_MAX) < 0 : len % sizeof(uint32_t) != 0) {
+        RedisModule_ReplyWithError(ctx, "ERR invalid blob");
+        return REDISMODULE_ERR;
+    }
+
+    roaring_bitmap_t* bitmap = NULL;
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
     if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
-        // If it's empty, return an empty array
-        return RedisModule_ReplyWithArray(ctx, 0);
+        if (!adding || len == 0) {
+            return RedisModule_ReplyWithLongLong(ctx, 0);
+        }
+        bitmap = roaring_bitmap_create();
+        setBitmap(key, bitmap, 0);
     } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
         return REDISMODULE_ERR;
+    } else {
+        bitmap = getWritableBitmap(key);
     }
 
-    bitmap = RedisModule_ModuleTypeGetValue(key);
-
-    RedisModule_ReplyWithArray(ctx, roaring_bitmap_get_cardinality(bitmap));
+    uint64_t changed = 0;
+    if (delta) {
+        uint32_t batch[BLOB_BATCH_SIZE];
+        RoaringBlob_InitDeltas(&reader, blob, len);
+        long long n;
+        while ((n = RoaringBlob_ReadDeltas(&reader, batch, BLOB_BATCH_SIZE)) > 0) {
+            changed += applyValues(key, bitmap, adding, (size_t)n, batch);
+        }
+    } else if (RoaringBlob_PlainIsHostOrder()) {
+        // The kernels read each value with memcpy, so the blob needs no alignment
+        changed = applyValues(key, bitmap, adding, len / sizeof(uint32_t), (const uint32_t*)blob);
+    } else {
+        uint32_t batch[BLOB_BATCH_SIZE];
+        size_t total = len / sizeof(uint32_t);
+        for (size_t i = 0; i < total; i += BLOB_BATCH_SIZE) {
+            size_t n = total - i < BLOB_BATCH_SIZE ? total - i : BLOB_BATCH_SIZE;
+            RoaringBlob_ReadPlain(blob + i * sizeof(uint32_t), n, batch);
+            changed += applyValues(key, bitmap, adding, n, batch);
+        }
+    }
 
-    roaring_uint32_iterator_t* it = roaring_create_iterator(bitmap);
-    while (it->has_value) {
-        RedisModule_ReplyWithLongLong(ctx, it->current_value);
-        roaring_advance_uint32_iterator(it);
+    if (roaring_bitmap_is_empty(bitmap)) {
+        RedisModule_DeleteKey(key);
     }
-    roaring_free_uint32_iterator(it);
+
+    RedisModule_ReplyWithLongLong(ctx, (long long)changed);
+    RedisModule_ReplicateVerbatim(ctx);
 
     return REDISMODULE_OK;
 }
 
 /**
- * ROARING.ISMEMBER <key> <value>
+ * ROARING.ADDBLOB <key> <blob> [DELTA]
  *
- * Checks if the bitmap has the value
+ * Adds the values of a binary blob to the bitmap. The blob holds the values as
+ * little-endian 4 byte integers. With DELTA, it holds them sorted, each as
+ * the difference with the one before (the first as is) in an unsigned LEB128
+ * varint.
+ *
+ * Returns the number of values that were not in the bitmap yet
  */
-int cmdIsMember(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
-    if (argc != 3) {
+int cmdAddBlob(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return _cmdBlob(ctx, argv, argc, true);
+}
+
+/**
+ * ROARING.REMOVEBLOB <key> <blob> [DELTA]
+ *
+ * Removes the values of a binary blob, encoded as for ROARING.ADDBLOB, from
+ * the bitmap. An empty bitmap deletes the key.
+ *
+ * Returns the number of values that were removed
+ */
+int cmdRemoveBlob(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return _cmdBlob(ctx, argv, argc, false);
+}
+
+/**
+ * Parses the <start> <end> arguments of the range commands, both included, into
+ * the half-open range [start, end). Replies with an error if they are invalid.
+ */
+static bool parseRange(RedisModuleCtx *ctx, RedisModuleString **argv, uint64_t *start, uint64_t *end) {
+    long long first, last;
+    if (RedisModule_StringToLongLong(argv[2], &first) != REDISMODULE_OK ||
+        RedisModule_StringToLongLong(argv[3], &last) != REDISMODULE_OK ||
+        first < 0 || last > UINT32_MAX || first > last) {
+        RedisModule_ReplyWithError(ctx, "Invalid argument, expects <key> <start> <end>");
+        return false;
+    }
+    *start = (uint64_t)first;
+    *end = (uint64_t)last + 1;
+    return true;
+}
+
+typedef enum { RANGE_ADD, RANGE_REMOVE, RANGE_FLIP } RangeOp;
+
+/**
+ * The range writes share this path. They work container by container: the
+ * containers inside the range are filled, dropped or negated whole, so the cost
+ * does not depend on how many values the range holds.
+ */
+int _cmdRangeWrite(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, RangeOp op) {
+    if (argc != 4) {
         return RedisModule_WrongArity(ctx);
     }
     RedisModule_AutoMemory(ctx);
 
-    // Fetch the bitmap under question
-    roaring_bitmap_t* bitmap;
-    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    uint64_t start, end;
+    if (!parseRange(ctx, argv, &start, &end)) {
+        return REDISMODULE_ERR;
+    }
+
+    roaring_bitmap_t* bitmap = NULL;
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
     if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
-        // If it's empty, return false
-        return RedisModule_ReplyWithLongLong(ctx, 0);
+        if (op == RANGE_REMOVE) {
+            return RedisModule_ReplyWithLongLong(ctx, 0);
+        }
+        bitmap = roaring_bitmap_create();
+        setBitmap(key, bitmap, 0);
     } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
         RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
         return REDISMODULE_ERR;
+    } else {
+        bitmap = getWritableBitmap(key);
     }
 
-    bitmap = RedisModule_ModuleTypeGetValue(key);
+    uint64_t before = roaring_bitmap_range_cardinality(bitmap, start, end);
+    long long changed;
+    if (op == RANGE_ADD) {
+        roaring_bitmap_add_range(bitmap, start, end);
+        changed = (long long)(end - start - before);
+        addCardinality(key, changed);
+    } else if (op == RANGE_REMOVE) {
+        roaring_bitmap_remove_range(bitmap, start, end);
+        changed = (long long)before;
+        addCardinality(key, -changed);
+    } else {
+        roaring_bitmap_flip_inplace(bitmap, start, end);
+        changed = (long long)(end - start - before);
+        addCardinality(key, changed - (long long)before);
+    }
 
-    long long value = -1;
-    RedisModule_StringToLongLong(argv[2], &value);
-    bool contains = roaring_bitmap_contains(bitmap, (uint32_t)value);
-    RedisModule_ReplyWithLongLong(ctx, contains);
+    if (roaring_bitmap_is_empty(bitmap)) {
+        RedisModule_DeleteKey(key);
+    }
+
+    RedisModule_ReplyWithLongLong(ctx, changed);
+    RedisModule_ReplicateVerbatim(ctx);
 
     return REDISMODULE_OK;
 }
 
-void *RoaringRdbLoad(RedisModuleIO *rdb, int encver) {
-    size_t* size = NULL;
-    char *serialized = RedisModule_LoadStringBuffer(rdb, size);
-    roaring_bitmap_t *bitmap = roaring_bitmap_deserialize(serialized);
-    free(serialized);
-    return bitmap;
+/**
+ * ROARING.ADDRANGE <key> <start> <end>
+ *
+ * Adds every value from start to end, both included, to the bitmap
+ *
+ * Returns the number of values that were not in the bitmap yet
+ */
+int cmdAddRange(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return _cmdRangeWrite(ctx, argv, argc, RANGE_ADD);
 }
 
-void RoaringRdbSave(RedisModuleIO *rdb, void *value) {
-    roaring_bitmap_t *bitmap = value;
-    size_t size = roaring_bitmap_size_in_bytes(bitmap);
-    char *serialized = malloc(size);
-
-    roaring_bitmap_serialize(bitmap, serialized);
+/**
+ * ROARING.REMOVERANGE <key> <start> <end>
+ *
+ * Removes every value from start to end, both included, from the bitmap. An
+ * empty bitmap deletes the key.
+ *
+ * Returns the number of values that were removed
+ */
+int cmdRemoveRange(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return _cmdRangeWrite(ctx, argv, argc, RANGE_REMOVE);
+}
 
-    RedisModule_SaveStringBuffer(rdb, serialized, size);
+/**
+ * ROARING.FLIPRANGE <key> <start> <end>
+ *
+ * Adds the values from start to end, both included, that are not in the
+ * bitmap, and removes those that are. An empty bitmap deletes the key.
+ *
+ * Returns the number of values of the range in the bitmap after the flip
+ */
+int cmdFlipRange(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return _cmdRangeWrite(ctx, argv, argc, RANGE_FLIP);
+}
 
-    free(serialized);
+/* Number of values in [start, end) of the bitmap stored at a key */
+static uint64_t countRange(RedisModuleKey *key, uint64_t start, uint64_t end) {
+    roaring_bitmap_t *bitmap = getBitmap(key);
+    const roaring_rank_index_t *index = getRankIndex(key);
+    if (index == NULL) {
+        return roaring_bitmap_range_cardinality(bitmap, start, end);
+    }
+    uint64_t count = roaring_bitmap_rank_indexed(bitmap, index, (uint32_t)(end - 1));
+    if (start > 0) {
+        count -= roaring_bitmap_rank_indexed(bitmap, index, (uint32_t)(start - 1));
+    }
+    return count;
 }
 
-void RoaringAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
-    // TODO - emit commands that will recreate the bitmap from the value to actual redis commands
-    // exmaple: roaring.add keyname 104 174 1295 601828 55105 108417 ...
-    // in batches of maybe 1000?
+/**
+ * The range reads share this path. They take the difference of two ranks from
+ * the rank index of the key, in time logarithmic in its number of containers.
+ *
+ * If arg `contains` is true, replies whether the whole range is set. Otherwise
+ * counts the values of the range.
+ */
+int _cmdRangeRead(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, bool contains) {
+    if (argc != 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    uint64_t start, end;
+    if (!parseRange(ctx, argv, &start, &end)) {
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        return RedisModule_ReplyWithLongLong(ctx, 0);
+    } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    uint64_t count = countRange(key, start, end);
+    if (contains) {
+        return RedisModule_ReplyWithLongLong(ctx, count == end - start);
+    }
+    return RedisModule_ReplyWithLongLong(ctx, (long long)count);
 }
 
-size_t RoaringMemUsage(const void *value) {
-    roaring_statistics_t stats;
-    roaring_bitmap_statistics(value, &stats);
-    return stats.n_bytes_array_containers + stats.n_bytes_bitset_containers + stats.n_bytes_run_containers;
+/**
+ * ROARING.COUNTRANGE <key> <start> <end>
+ *
+ * Returns the number of values from start to end, both included, in the bitmap
+ */
+int cmdCountRange(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return _cmdRangeRead(ctx, argv, argc, false);
 }
 
-void RoaringFree(void *value) {
-   roaring_bitmap_free(value);
+/**
+ * ROARING.CONTAINSRANGE <key> <start> <end>
+ *
+ * Checks if the bitmap has every value from start to end, both included
+ */
+int cmdContainsRange(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    return _cmdRangeRead(ctx, argv, argc, true);
 }
 
-int RedisModule_OnLoad(RedisModuleCtx *ctx) {
+/**
+ * ROARING.RANK <key> <value>
+ *
+ * Returns the number of values of the bitmap smaller than or equal to value,
+ * using the rank index of the key
+ */
+int cmdRank(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
 
-    // Register the module itself
-    if (RedisModule_Init(ctx, "roaring", 1, REDISMODULE_APIVER_1) == REDISMODULE_ERR) {
+    long long value;
+    if (RedisModule_StringToLongLong(argv[2], &value) != REDISMODULE_OK || value < 0 || value > UINT32_MAX) {
+        RedisModule_ReplyWithError(ctx, "Invalid argument, expects <key> <value>");
         return REDISMODULE_ERR;
     }
 
-    RedisModuleTypeMethods tm = {
-            .version = REDISMODULE_TYPE_METHOD_VERSION,
-            .rdb_load = RoaringRdbLoad,
-            .rdb_save = RoaringRdbSave,
-            .aof_rewrite = RoaringAofRewrite,
-            .mem_usage = RoaringMemUsage,
-            .free = RoaringFree
-    };
-
-    RoaringType = RedisModule_CreateDataType(ctx, "c_roaring", 0, &tm);
-    if (RoaringType == NULL) return REDISMODULE_ERR;
-
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        return RedisModule_ReplyWithLongLong(ctx, 0);
+    } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    return RedisModule_ReplyWithLongLong(ctx, (long long)countRange(key, 0, (uint64_t)value + 1));
+}
+
+/**
+ * ROARING.SELECT <key> <rank>
+ *
+ * Returns the value of the given rank in the bitmap, 0 being the rank of the
+ * smallest value, or nil if the bitmap has no more than rank values. Pages of
+ * members can be read from any rank on, in time logarithmic in the number of
+ * containers of the bitmap.
+ */
+int cmdSelect(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    long long rank;
+    if (RedisModule_StringToLongLong(argv[2], &rank) != REDISMODULE_OK || rank < 0) {
+        RedisModule_ReplyWithError(ctx, "Invalid argument, expects <key> <rank>");
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        return RedisModule_ReplyWithNull(ctx);
+    } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    uint32_t element;
+    if (!selectValue(key, (uint64_t)rank, &element)) {
+        return RedisModule_ReplyWithNull(ctx);
+    }
+    return RedisModule_ReplyWithLongLong(ctx, element);
+}
+
+typedef enum { BITOP_AND, BITOP_OR, BITOP_XOR, BITOP_ANDNOT } BitOp;
+
+/**
+ * Computes op across the sources, NULL standing for a missing key. ANDNOT
+ * removes every later source from the first one.
+ */
+static roaring_bitmap_t *bitOp(BitOp op, const roaring_bitmap_t **sources, size_t count) {
+    size_t found = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (sources[i] != NULL) {
+            found++;
+        }
+    }
+
+    if (op == BITOP_OR || op == BITOP_XOR) {
+        // The *_many functions want a dense array, so squeeze out the missing keys
+        const roaring_bitmap_t **dense = malloc((found > 0 ? found : 1) * sizeof(roaring_bitmap_t*));
+        size_t n = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (sources[i] != NULL) {
+                dense[n++] = sources[i];
+            }
+        }
+        roaring_bitmap_t *result = op == BITOP_OR ? roaring_bitmap_or_many(n, dense) : roaring_bitmap_xor_many(n, dense);
+        free(dense);
+        return result;
+    }
+    if (sources[0] == NULL || (op == BITOP_AND && found != count)) {
+        // Intersecting with, or subtracting from, a missing key is always empty
+        return roaring_bitmap_create();
+    }
+    roaring_bitmap_t *result = roaring_bitmap_copy(sources[0]);
+    for (size_t i = 1; i < count && !roaring_bitmap_is_empty(result); i++) {
+        if (op == BITOP_AND) {
+            roaring_bitmap_and_inplace(result, sources[i]);
+        } else if (sources[i] != NULL) {
+            roaring_bitmap_andnot_inplace(result, sources[i]);
+        }
+    }
+    return result;
+}
+
+/**
+ * Stores the result of ROARING.BITOP or ROARING.EVALSTORE at dest, taking it,
+ * and replies with its cardinality. An empty result deletes dest. Results
+ * computed on the pool are replicated by value, as their sources may have
+ * changed while they ran; inline ones as the command itself.
+ */
+static int storeResult(RedisModuleCtx *ctx, RedisModuleString *keyname, roaring_bitmap_t *result, bool by_value) {
+    RedisModuleKey *dest = (RedisModuleKey*)RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ | REDISMODULE_WRITE);
+    if (RedisModule_KeyType(dest) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(dest) != RoaringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        roaring_bitmap_free(result);
+        RedisModule_CloseKey(dest);
+        return REDISMODULE_ERR;
+    }
+
+    uint64_t cardinality = roaring_bitmap_get_cardinality(result);
+    if (by_value) {
+        replicateBitmap(ctx, keyname, result);
+    } else {
+        RedisModule_ReplicateVerbatim(ctx);
+    }
+    if (cardinality == 0) {
+        roaring_bitmap_free(result);
+        RedisModule_DeleteKey(dest);
+    } else {
+        setBitmap(dest, result, cardinality);
+    }
+    RedisModule_CloseKey(dest);
+
+    return RedisModule_ReplyWithLongLong(ctx, cardinality);
+}
+
+/* Whether key is missing or holds a bitmap, checked before a store is offloaded */
+static bool canStore(RedisModuleCtx *ctx, RedisModuleString *keyname) {
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+    return RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY || RedisModule_ModuleTypeGetType(key) == RoaringType;
+}
+
+/**
+ * A command running on the worker pool.
+ *
+ * The worker only ever sees snapshots taken on the main thread, never the live
+ * bitmaps, so the keys stay writable while it runs. The reply, the store of
+ * BITOP and EVALSTORE, and the cleanup happen back on the main thread, through
+ * the blocked client callbacks.
+ */
+typedef struct {
+    RedisModuleBlockedClient *bc;
+    roaring_bitmap_t **snapshots;
+    size_t count;
+    size_t n_include;   // for CARD, the snapshots after the includes are excluded
+    RoaringExpr *expr;  // for EVAL, bound to the snapshots
+    BitOp op;           // for BITOP
+    bool members;       // reply with the members of result instead of cardinality
+    char *dest;         // for stores, the key result goes to
+    size_t dest_len;
+    uint64_t cardinality;
+    roaring_bitmap_t *result;
+} RoaringJob;
+
+/**
+ * Takes a copy-on-write snapshot of a bitmap: containers are shared with the
+ * live bitmap rather than copied, and the live bitmap copies a container the
+ * next time it writes to it. Writes to the snapshot do the same.
+ *
+ * Reference counts are only touched on the main thread, here and when the
+ * snapshot is freed. The snapshot itself is not copy-on-write, so whatever the
+ * worker derives from it is a plain copy. Frozen views can't share their
+ * containers, nor be made copy-on-write, so their snapshot is a plain copy.
+ */
+static roaring_bitmap_t *snapshotBitmap(roaring_bitmap_t *bitmap) {
+    if (bitmap->high_low_container.flags & ROARING_FLAG_FROZEN) {
+        return roaring_bitmap_copy(bitmap);
+    }
+    bool copy_on_write = bitmap->copy_on_write;
+    bitmap->copy_on_write = true;
+    roaring_bitmap_t *snapshot = roaring_bitmap_copy(bitmap);
+    bitmap->copy_on_write = copy_on_write;
+    snapshot->copy_on_write = false;
+    return snapshot;
+}
+
+/**
+ * Whether a command over these bitmaps is worth handing to the pool. The number
+ * of containers is what the set operations are linear in. Frozen bitmaps stay
+ * inline: their snapshot would copy every container out of the file. Inside
+ * MULTI or a Lua script the client can't be blocked, so those run inline too,
+ * as does everything on servers too old to tell us where we are called from.
+ */
+static bool shouldOffload(RedisModuleCtx *ctx, const roaring_bitmap_t **bitmaps, size_t count) {
+    if (Pool == NULL || RedisModule_GetContextFlags == NULL) {
+        return false;
+    }
+    if (RedisModule_GetContextFlags(ctx) & (REDISMODULE_CTX_FLAGS_MULTI | REDISMODULE_CTX_FLAGS_LUA)) {
+        return false;
+    }
+    long long containers = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (bitmaps[i] != NULL) {
+            if (bitmaps[i]->high_low_container.flags & ROARING_FLAG_FROZEN) {
+                return false;
+            }
+            containers += bitmaps[i]->high_low_container.size;
+        }
+    }
+    return containers >= OffloadThreshold;
+}
+
+/* A job over snapshots of the bitmaps, storing its result at dest if it is not NULL */
+static RoaringJob *newJob(const roaring_bitmap_t **bitmaps, size_t count, RedisModuleString *dest) {
+    RoaringJob *job = calloc(1, sizeof(RoaringJob));
+    if (dest != NULL) {
+        // Strings die with the command context, so keep the bytes of the name
+        const char *name = RedisModule_StringPtrLen(dest, &job->dest_len);
+        job->dest = malloc(job->dest_len);
+        memcpy(job->dest, name, job->dest_len);
+    }
+    job->snapshots = calloc(count, sizeof(roaring_bitmap_t*));
+    job->count = count;
+    for (size_t i = 0; i < count; i++) {
+        if (bitmaps[i] != NULL) {
+            job->snapshots[i] = snapshotBitmap((roaring_bitmap_t*)bitmaps[i]);
+        }
+    }
+    return job;
+}
+
+int replyJob(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    RoaringJob *job = RedisModule_GetBlockedClientPrivateData(ctx);
+
+    if (job->dest != NULL) {
+        RedisModuleString *dest = RedisModule_CreateString(ctx, job->dest, job->dest_len);
+        int status = storeResult(ctx, dest, job->result, true);
+        job->result = NULL;
+        RedisModule_FreeString(ctx, dest);
+        return status;
+    }
+    if (!job->members) {
+        return RedisModule_ReplyWithLongLong(ctx, job->cardinality);
+    }
+    replyWithBitmap(ctx, job->result, roaring_bitmap_get_cardinality(job->result));
+
+    return REDISMODULE_OK;
+}
+
+void freeJob(void *privdata) {
+    RoaringJob *job = privdata;
+    for (size_t i = 0; i < job->count; i++) {
+        if (job->snapshots[i] != NULL) {
+            roaring_bitmap_free(job->snapshots[i]);
+        }
+    }
+    if (job->result != NULL) {
+        roaring_bitmap_free(job->result);
+    }
+    RoaringExpr_Free(job->expr);
+    free(job->dest);
+    free(job->snapshots);
+    free(job);
+}
+
+/* Blocks the client and queues `work`, which must end with RedisModule_UnblockClient */
+static void startJob(RedisModuleCtx *ctx, RoaringJob *job, void (*work)(void *)) {
+    job->bc = RedisModule_BlockClient(ctx, replyJob, NULL, freeJob, 0);
+    RoaringPool_Submit(Pool, work, job);
+}
+
+void cardJob(void *privdata) {
+    RoaringJob *job = privdata;
+    job->cardinality = roaring_bitmap_or_many_andnot_cardinality(
+            job->n_include, (const roaring_bitmap_t**)job->snapshots,
+            job->count - job->n_include, (const roaring_bitmap_t**)job->snapshots + job->n_include);
+    RedisModule_UnblockClient(job->bc, job);
+}
+
+/**
+ * ROARING.CARD <inc1> [<inc2> ...] [! <exc1> [<exc2> ...]]
+ *
+ * Returns cardinality of the roaring bitmaps, excluding each after the bang (!)
+ *
+ * The count is computed container by container without building the union,
+ * so no bitmap gets allocated or copied along the way. Large counts run on the
+ * worker pool when there is one. A single key answers from the count its writes
+ * keep, read from the header if the key is still serialized.
+ */
+int cmdCard(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    char* format_err = "Expects format roaring.card included1 [included2 included3 ...] [! excluded1 [excluded2] ...]";
+
+    if (argc == 1) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    if (argc == 2) {
+        RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+        if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) == RoaringType) {
+            return RedisModule_ReplyWithLongLong(ctx, (long long)getCardinality(key));
+        }
+    }
+
+    RedisModuleString* bang = RedisModule_CreateString(ctx, "!", 1);
+    bool bang_found = false;
+
+    // Both lists are filled from the one array: includes grow from the front, excludes from the back
+    const roaring_bitmap_t **bitmaps = calloc((size_t)argc, sizeof(roaring_bitmap_t*));
+    size_t n_include = 0, n_exclude = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (RedisModule_StringCompare(argv[i], bang) == 0) {
+            if (bang_found) {
+                RedisModule_ReplyWithError(ctx, format_err);
+                free(bitmaps);
+                return REDISMODULE_ERR;
+            } else {
+                bang_found = true;
+                continue;
+            }
+        }
+
+        // Fetch the bitmap under question
+        RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ);
+        if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+            // If there is nothing to include or exclude, just continue on
+            continue;
+        } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
+            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+            free(bitmaps);
+            return REDISMODULE_ERR;
+        }
+
+        // otherwise, we have a set probably!
+        if (!bang_found) {
+            bitmaps[n_include++] = getBitmap(key);
+        } else {
+            bitmaps[argc - 1 - n_exclude++] = getBitmap(key);
+        }
+    }
+
+    // Pack the excludes right after the includes
+    memmove(bitmaps + n_include, bitmaps + argc - n_exclude, n_exclude * sizeof(roaring_bitmap_t*));
+
+    if (shouldOffload(ctx, bitmaps, n_include + n_exclude)) {
+        RoaringJob *job = newJob(bitmaps, n_include + n_exclude, NULL);
+        job->n_include = n_include;
+        free(bitmaps);
+        startJob(ctx, job, cardJob);
+        return REDISMODULE_OK;
+    }
+
+    uint64_t cardinality = roaring_bitmap_or_many_andnot_cardinality(
+            n_include, bitmaps, n_exclude, bitmaps + n_include);
+    RedisModule_ReplyWithLongLong(ctx, cardinality);
+    free(bitmaps);
+
+    return REDISMODULE_OK;
+}
+
+void bitOpJob(void *privdata) {
+    RoaringJob *job = privdata;
+    job->result = bitOp(job->op, (const roaring_bitmap_t**)job->snapshots, job->count);
+    RedisModule_UnblockClient(job->bc, job);
+}
+
+/**
+ * ROARING.BITOP <AND|OR|XOR|ANDNOT> <dest> <src1> [<src2> ...]
+ *
+ * Computes the operation across the source bitmaps and stores the result in dest.
+ * ANDNOT removes every later source from the first one. Missing sources are treated
+ * as empty bitmaps, and an empty result deletes dest. Large operations run on
+ * the worker pool when there is one.
+ *
+ * Returns the cardinality of the stored bitmap
+ */
+int cmdBitOp(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    const char *name = RedisModule_StringPtrLen(argv[1], NULL);
+    BitOp op;
+    if (strcasecmp(name, "and") == 0) {
+        op = BITOP_AND;
+    } else if (strcasecmp(name, "or") == 0) {
+        op = BITOP_OR;
+    } else if (strcasecmp(name, "xor") == 0) {
+        op = BITOP_XOR;
+    } else if (strcasecmp(name, "andnot") == 0) {
+        op = BITOP_ANDNOT;
+    } else {
+        RedisModule_ReplyWithError(ctx, "ERR syntax error, expects roaring.bitop <AND|OR|XOR|ANDNOT> dest src1 [src2 ...]");
+        return REDISMODULE_ERR;
+    }
+
+    size_t count = (size_t)argc - 3;
+    const roaring_bitmap_t **sources = calloc(count, sizeof(roaring_bitmap_t*));
+
+    // Collect the sources first so a wrong type fails before anything gets written.
+    // Missing keys stay NULL in place, since position matters for ANDNOT.
+    for (size_t i = 0; i < count; i++) {
+        RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[i + 3], REDISMODULE_READ);
+        if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+            continue;
+        } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
+            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+            free(sources);
+            return REDISMODULE_ERR;
+        }
+        sources[i] = getBitmap(key);
+    }
+
+    if (canStore(ctx, argv[2]) && shouldOffload(ctx, sources, count)) {
+        RoaringJob *job = newJob(sources, count, argv[2]);
+        job->op = op;
+        free(sources);
+        startJob(ctx, job, bitOpJob);
+        return REDISMODULE_OK;
+    }
+
+    roaring_bitmap_t* result = bitOp(op, sources, count);
+    free(sources);
+
+    // Sources are only read above, so dest can safely be one of them
+    return storeResult(ctx, argv[2], result, false);
+}
+
+void evalJob(void *privdata) {
+    RoaringJob *job = privdata;
+    if (job->members) {
+        job->result = RoaringExpr_Evaluate(job->expr);
+    } else {
+        job->cardinality = RoaringExpr_Cardinality(job->expr);
+    }
+    RedisModule_UnblockClient(job->bc, job);
+}
+
+/**
+ * Reports the keys of <expr> <numkeys> <key>..., found at argv[first], to the
+ * getkeys API. Stops at the first malformed argument, the command itself
+ * reports it.
+ */
+static void evalKeyPositions(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int first) {
+    long long numkeys;
+    if (first + 1 >= argc || RedisModule_StringToLongLong(argv[first + 1], &numkeys) != REDISMODULE_OK
+            || numkeys < 0 || numkeys > argc - first - 2) {
+        return;
+    }
+    for (int i = first + 2; i < first + 2 + numkeys; i++) {
+        RedisModule_KeyAtPos(ctx, i);
+    }
+}
+
+/**
+ * Parses <expr> <numkeys> <key>... at argv[first], and checks that every key
+ * named in the expression is one of the declared keys, so that cluster routing
+ * and ACLs see all of them. Sets *next to the first argument after the keys.
+ * Replies with an error and returns NULL if the arguments are invalid.
+ */
+static RoaringExpr *parseEval(RedisModuleCtx *ctx, RedisModuleString **argv, int argc, int first, int *next, const char *format_err) {
+    long long numkeys;
+    if (first + 1 >= argc || RedisModule_StringToLongLong(argv[first + 1], &numkeys) != REDISMODULE_OK
+            || numkeys < 0 || numkeys > argc - first - 2) {
+        RedisModule_ReplyWithError(ctx, format_err);
+        return NULL;
+    }
+    *next = first + 2 + (int)numkeys;
+
+    size_t len;
+    const char *text = RedisModule_StringPtrLen(argv[first], &len);
+    const char *err;
+    RoaringExpr *expr = RoaringExpr_Parse(text, len, &err);
+    if (expr == NULL) {
+        RedisModule_ReplyWithError(ctx, err);
+        return NULL;
+    }
+
+    for (size_t i = 0; i < RoaringExpr_KeyCount(expr); i++) {
+        size_t keylen;
+        const char *name = RoaringExpr_KeyName(expr, i, &keylen);
+        bool declared = false;
+        for (int k = first + 2; k < *next && !declared; k++) {
+            size_t declaredlen;
+            const char *declaredname = RedisModule_StringPtrLen(argv[k], &declaredlen);
+            declared = declaredlen == keylen && memcmp(declaredname, name, keylen) == 0;
+        }
+        if (!declared) {
+            RedisModule_ReplyWithError(ctx, "ERR the expression uses a key that is not declared");
+            RoaringExpr_Free(expr);
+            return NULL;
+        }
+    }
+    return expr;
+}
+
+/**
+ * ROARING.EVAL and ROARING.EVALSTORE share this path, store being the
+ * destination of EVALSTORE and NULL for EVAL.
+ *
+ * Evaluates a set expression over bitmap keys in a single call, e.g.
+ * `(a & b) | (c - d)`. `&` is intersection and `-` difference, both binding
+ * tighter than `^` (symmetric difference), which binds tighter than `|` (union).
+ * Keys containing spaces or operators can be written in double quotes, and
+ * missing keys are treated as empty bitmaps.
+ *
+ * The expression is planned before it runs: intersections are done from the
+ * smallest input up and stop as soon as they are empty, differences are
+ * applied after the intersections they are nested in, and unions are computed
+ * lazily. CARD never materializes the final result. Large expressions run on
+ * the worker pool when there is one, stores included.
+ */
+static int _cmdEval(RedisModuleCtx *ctx, RoaringExpr *expr, bool card, RedisModuleString *store) {
+    // Resolve every key up front so a wrong type fails before any work is done
+    size_t count = RoaringExpr_KeyCount(expr);
+    const roaring_bitmap_t **bitmaps = calloc(count, sizeof(roaring_bitmap_t*));
+    for (size_t i = 0; i < count; i++) {
+        size_t keylen;
+        const char *name = RoaringExpr_KeyName(expr, i, &keylen);
+        RedisModuleString *keyname = RedisModule_CreateString(ctx, name, keylen);
+        RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, keyname, REDISMODULE_READ);
+        if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+            continue;
+        } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
+            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+            RoaringExpr_Free(expr);
+            free(bitmaps);
+            return REDISMODULE_ERR;
+        }
+        bitmaps[i] = getBitmap(key);
+    }
+
+    RoaringJob *job = NULL;
+    if ((store == NULL || canStore(ctx, store)) && shouldOffload(ctx, bitmaps, count)) {
+        job = newJob(bitmaps, count, store);
+    }
+    for (size_t i = 0; i < count; i++) {
+        RoaringExpr_SetKeyBitmap(expr, i, job != NULL ? job->snapshots[i] : bitmaps[i]);
+    }
+    free(bitmaps);
+
+    if (job != NULL) {
+        job->expr = expr;
+        job->members = !card;
+        startJob(ctx, job, evalJob);
+        return REDISMODULE_OK;
+    }
+
+    if (card) {
+        RedisModule_ReplyWithLongLong(ctx, RoaringExpr_Cardinality(expr));
+        RoaringExpr_Free(expr);
+        return REDISMODULE_OK;
+    }
+
+    roaring_bitmap_t* result = RoaringExpr_Evaluate(expr);
+    RoaringExpr_Free(expr);
+
+    if (store == NULL) {
+        replyWithBitmap(ctx, result, roaring_bitmap_get_cardinality(result));
+        roaring_bitmap_free(result);
+        return REDISMODULE_OK;
+    }
+
+    // The result never aliases a source, so dest may appear in the expression
+    return storeResult(ctx, store, result, false);
+}
+
+/**
+ * ROARING.EVAL <expr> <numkeys> <key>... [CARD | MEMBERS]
+ *
+ * Evaluates the expression, whose keys must all be among the numkeys keys
+ * given after it. Read-only, so it also runs on read-only replicas.
+ *
+ * Returns the members of the result (MEMBERS, the default) or its cardinality
+ * (CARD)
+ */
+int cmdEval(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    char* format_err = "ERR syntax error, expects roaring.eval <expr> <numkeys> <key>... [CARD | MEMBERS]";
+
+    if (RedisModule_IsKeysPositionRequest(ctx)) {
+        evalKeyPositions(ctx, argv, argc, 1);
+        return REDISMODULE_OK;
+    }
+    if (argc < 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    int next;
+    RoaringExpr *expr = parseEval(ctx, argv, argc, 1, &next, format_err);
+    if (expr == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    bool card = false;
+    if (next < argc) {
+        const char *mode = RedisModule_StringPtrLen(argv[next], NULL);
+        card = strcasecmp(mode, "card") == 0;
+        if (next + 1 != argc || (!card && strcasecmp(mode, "members") != 0)) {
+            RedisModule_ReplyWithError(ctx, format_err);
+            RoaringExpr_Free(expr);
+            return REDISMODULE_ERR;
+        }
+    }
+    return _cmdEval(ctx, expr, card, NULL);
+}
+
+/**
+ * ROARING.EVALSTORE <dest> <expr> <numkeys> <key>...
+ *
+ * Evaluates the expression like ROARING.EVAL and stores the result in dest,
+ * deleting it if the result is empty. dest may be one of the keys.
+ *
+ * Returns the cardinality of the result
+ */
+int cmdEvalStore(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    char* format_err = "ERR syntax error, expects roaring.evalstore <dest> <expr> <numkeys> <key>...";
+
+    if (RedisModule_IsKeysPositionRequest(ctx)) {
+        if (argc > 1) {
+            RedisModule_KeyAtPos(ctx, 1);
+        }
+        evalKeyPositions(ctx, argv, argc, 2);
+        return REDISMODULE_OK;
+    }
+    if (argc < 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    int next;
+    RoaringExpr *expr = parseEval(ctx, argv, argc, 2, &next, format_err);
+    if (expr == NULL) {
+        return REDISMODULE_ERR;
+    }
+    if (next != argc) {
+        RedisModule_ReplyWithError(ctx, format_err);
+        RoaringExpr_Free(expr);
+        return REDISMODULE_ERR;
+    }
+    return _cmdEval(ctx, expr, false, argv[1]);
+}
+
+/**
+ * ROARING.MEMBERS <key> [ASC|DESC] [LIMIT <offset> <count>]
+ *
+ * Returns the members of the bitmap, in increasing order or in decreasing
+ * order with DESC. LIMIT skips offset members and returns at most count of
+ * the next ones, all of them if count is negative. The rank index of the key
+ * finds the first member to return, so the cost only depends on the number
+ * of members returned.
+ */
+int cmdMembers(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    char* format_err = "ERR syntax error, expects roaring.members key [ASC|DESC] [LIMIT offset count]";
+
+    if (argc < 2 || argc > 6) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    bool desc = false, limited = false;
+    long long offset = 0, count = -1;
+    for (int i = 2; i < argc; i++) {
+        const char *option = RedisModule_StringPtrLen(argv[i], NULL);
+        if (strcasecmp(option, "asc") == 0 || strcasecmp(option, "desc") == 0) {
+            desc = strcasecmp(option, "desc") == 0;
+        } else if (strcasecmp(option, "limit") == 0 && !limited && i + 2 < argc) {
+            if (RedisModule_StringToLongLong(argv[i + 1], &offset) != REDISMODULE_OK || offset < 0
+                    || RedisModule_StringToLongLong(argv[i + 2], &count) != REDISMODULE_OK) {
+                RedisModule_ReplyWithError(ctx, format_err);
+                return REDISMODULE_ERR;
+            }
+            limited = true;
+            i += 2;
+        } else {
+            RedisModule_ReplyWithError(ctx, format_err);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    // Fetch the bitmap under question
+    roaring_bitmap_t* bitmap;
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        // If it's empty, return an empty array
+        return RedisModule_ReplyWithArray(ctx, 0);
+    } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    bitmap = getBitmap(key);
+    uint64_t cardinality = getCardinality(key);
+    if (!desc && !limited) {
+        replyWithBitmap(ctx, bitmap, cardinality);
+        return REDISMODULE_OK;
+    }
+
+    if ((uint64_t)offset >= cardinality || count == 0) {
+        return RedisModule_ReplyWithArray(ctx, 0);
+    }
+    uint64_t n = cardinality - (uint64_t)offset;
+    if (count > 0 && (uint64_t)count < n) {
+        n = (uint64_t)count;
+    }
+
+    roaring_uint32_iterator_t *it;
+    if (offset == 0) {
+        it = desc ? roaring_create_iterator_last(bitmap) : roaring_create_iterator(bitmap);
+    } else {
+        // Skips to the first member to return, which is in the bitmap
+        uint32_t first;
+        selectValue(key, desc ? cardinality - 1 - (uint64_t)offset : (uint64_t)offset, &first);
+        it = roaring_create_iterator(bitmap);
+        roaring_move_uint32_iterator_equalorlarger(it, first);
+    }
+
+    RedisModule_ReplyWithArray(ctx, n);
+    if (desc) {
+        for (uint64_t i = 0; i < n; i++) {
+            RedisModule_ReplyWithLongLong(ctx, it->current_value);
+            roaring_previous_uint32_iterator(it);
+        }
+    } else {
+        replyWithValues(ctx, it, n);
+    }
+    roaring_free_uint32_iterator(it);
+
+    return REDISMODULE_OK;
+}
+
+/**
+ * ROARING.SCAN <key> <cursor> [COUNT <n>] [MIN <min>] [MAX <max>]
+ *
+ * Returns up to n members of the bitmap (10 by default) from the cursor on,
+ * within min and max, both included, and the cursor to call it with next.
+ * Iteration starts with the cursor 0, and is over when the cursor returned is
+ * 0. The cursor is the value to resume from, so each call skips to it in the
+ * bitmap and does work bounded by n, however large the bitmap.
+ *
+ * Returns an array of the next cursor and the array of members
+ */
+int cmdScan(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    char* format_err = "ERR syntax error, expects roaring.scan key cursor [COUNT n] [MIN min] [MAX max]";
+
+    if (argc < 3 || argc % 2 == 0) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    long long cursor, count = 10, min = 0, max = UINT32_MAX;
+    if (RedisModule_StringToLongLong(argv[2], &cursor) != REDISMODULE_OK || cursor < 0 || cursor > UINT32_MAX) {
+        RedisModule_ReplyWithError(ctx, "ERR invalid cursor");
+        return REDISMODULE_ERR;
+    }
+    for (int i = 3; i < argc; i += 2) {
+        const char *option = RedisModule_StringPtrLen(argv[i], NULL);
+        long long *target;
+        if (strcasecmp(option, "count") == 0) {
+            target = &count;
+        } else if (strcasecmp(option, "min") == 0) {
+            target = &min;
+        } else if (strcasecmp(option, "max") == 0) {
+            target = &max;
+        } else {
+            RedisModule_ReplyWithError(ctx, format_err);
+            return REDISMODULE_ERR;
+        }
+        if (RedisModule_StringToLongLong(argv[i + 1], target) != REDISMODULE_OK || *target < 0 || *target > UINT32_MAX) {
+            RedisModule_ReplyWithError(ctx, format_err);
+            return REDISMODULE_ERR;
+        }
+    }
+    if (count == 0) {
+        RedisModule_ReplyWithError(ctx, format_err);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != RoaringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModule_ReplyWithArray(ctx, 2);
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY || cursor > max) {
+        RedisModule_ReplyWithLongLong(ctx, 0);
+        return RedisModule_ReplyWithArray(ctx, 0);
+    }
+
+    roaring_uint32_iterator_t* it = roaring_create_iterator(getBitmap(key));
+    roaring_move_uint32_iterator_equalorlarger(it, (uint32_t)(cursor > min ? cursor : min));
+
+    // The cursor comes first in the reply, so a first pass finds it, reading
+    // one value past count, and the members are replied from a copy of the iterator
+    roaring_uint32_iterator_t* members = roaring_copy_uint32_iterator(it);
+    uint32_t batch[REPLY_BATCH_SIZE];
+    long long found = 0, next = 0;
+    bool done = false;
+    while (!done) {
+        uint32_t wanted = count + 1 - found < REPLY_BATCH_SIZE ? (uint32_t)(count + 1 - found) : REPLY_BATCH_SIZE;
+        uint32_t read = roaring_read_uint32_iterator(it, batch, wanted);
+        for (uint32_t i = 0; i < read && !done; i++) {
+            if (batch[i] > max) {
+                done = true;
+            } else if (found == count) {
+                // Never 0, as it is larger than the members before it
+                next = batch[i];
+                done = true;
+            } else {
+                found++;
+            }
+        }
+        done = done || read < wanted;
+    }
+
+    RedisModule_ReplyWithLongLong(ctx, next);
+    RedisModule_ReplyWithArray(ctx, found);
+    replyWithValues(ctx, members, (uint64_t)found);
+    roaring_free_uint32_iterator(members);
+    roaring_free_uint32_iterator(it);
+
+    return REDISMODULE_OK;
+}
+
+/**
+ * ROARING.ISMEMBER <key> <value>
+ *
+ * Checks if the bitmap has the value
+ *
+ * A key that was lazily loaded stays serialized: only the container that could
+ * hold the value is read.
+ */
+int cmdIsMember(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // Fetch the bitmap under question
+    RoaringValue *stored;
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        // If it's empty, return false
+        return RedisModule_ReplyWithLongLong(ctx, 0);
+    } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    stored = RedisModule_ModuleTypeGetValue(key);
+
+    long long value = -1;
+    RedisModule_StringToLongLong(argv[2], &value);
+    bool contains = stored->bitmap != NULL
+            ? roaring_bitmap_contains(stored->bitmap, (uint32_t)value)
+            : roaring_bitmap_portable_contains(stored->serialized, (uint32_t)value);
+    RedisModule_ReplyWithLongLong(ctx, contains);
+
+    return REDISMODULE_OK;
+}
+
+/* A value to look up, with its position in the arguments */
+typedef struct {
+    uint32_t value;
+    uint32_t position;
+} Probe;
+
+static int compareProbes(const void *a, const void *b) {
+    uint32_t x = ((const Probe*)a)->value, y = ((const Probe*)b)->value;
+    return (x > y) - (x < y);
+}
+
+/**
+ * ROARING.MISMEMBER <key> <value> [<value> ...]
+ *
+ * Checks which of the values the bitmap has. The values are sorted, then
+ * looked up in a single pass over the containers.
+ *
+ * Returns an array with 1 for each value in the bitmap and 0 for the others,
+ * in the order of the arguments
+ */
+int cmdMisMember(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    size_t count = (size_t)argc - 2;
+    Probe *probes = calloc(count, sizeof(Probe));
+    for (size_t i = 0; i < count; i++) {
+        long long value;
+        if (RedisModule_StringToLongLong(argv[i + 2], &value) != REDISMODULE_OK || value < 0 || value > UINT32_MAX) {
+            RedisModule_ReplyWithError(ctx, "Invalid argument, expects <key> <int>...");
+            free(probes);
+            return REDISMODULE_ERR;
+        }
+        probes[i].value = (uint32_t)value;
+        probes[i].position = (uint32_t)i;
+    }
+
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != RoaringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        free(probes);
+        return REDISMODULE_ERR;
+    }
+
+    bool *contains = calloc(count, sizeof(bool));
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY) {
+        RoaringValue *stored = RedisModule_ModuleTypeGetValue(key);
+        if (stored->bitmap == NULL) {
+            // Like ISMEMBER, a lazily loaded key stays serialized
+            for (size_t i = 0; i < count; i++) {
+                contains[i] = roaring_bitmap_portable_contains(stored->serialized, probes[i].value);
+            }
+        } else {
+            qsort(probes, count, sizeof(Probe), compareProbes);
+            uint32_t *values = calloc(count, sizeof(uint32_t));
+            bool *found = calloc(count, sizeof(bool));
+            for (size_t i = 0; i < count; i++) {
+                values[i] = probes[i].value;
+            }
+            roaring_bitmap_contains_many(stored->bitmap, count, values, found);
+            for (size_t i = 0; i < count; i++) {
+                contains[probes[i].position] = found[i];
+            }
+            free(found);
+            free(values);
+        }
+    }
+
+    RedisModule_ReplyWithArray(ctx, count);
+    for (size_t i = 0; i < count; i++) {
+        RedisModule_ReplyWithLongLong(ctx, contains[i]);
+    }
+
+    free(contains);
+    free(probes);
+    return REDISMODULE_OK;
+}
+
+/**
+ * ROARING.COPY <src> <dst> [REPLACE]
+ *
+ * Copies src to dst, replacing dst only with REPLACE. The copy shares its
+ * containers with src, so it takes time in the number of containers rather
+ * than values, and a container is only duplicated when either key writes to it.
+ * Keys attached from a file are the exception: they are copied whole.
+ *
+ * Returns 1 if src was copied, 0 if src does not exist or dst already does
+ */
+int cmdCopy(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3 && argc != 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    bool replace = false;
+    if (argc == 4) {
+        if (strcasecmp(RedisModule_StringPtrLen(argv[3], NULL), "replace") != 0) {
+            RedisModule_ReplyWithError(ctx, "ERR syntax error, expects roaring.copy src dst [REPLACE]");
+            return REDISMODULE_ERR;
+        }
+        replace = true;
+    }
+    if (RedisModule_StringCompare(argv[1], argv[2]) == 0) {
+        RedisModule_ReplyWithError(ctx, "ERR source and destination objects are the same");
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *src = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (RedisModule_KeyType(src) == REDISMODULE_KEYTYPE_EMPTY) {
+        return RedisModule_ReplyWithLongLong(ctx, 0);
+    } else if (RedisModule_ModuleTypeGetType(src) != RoaringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleKey *dst = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[2], REDISMODULE_READ | REDISMODULE_WRITE);
+    if (RedisModule_KeyType(dst) != REDISMODULE_KEYTYPE_EMPTY) {
+        if (!replace) {
+            return RedisModule_ReplyWithLongLong(ctx, 0);
+        }
+        // Like COPY, REPLACE overwrites a key of any type
+        RedisModule_DeleteKey(dst);
+    }
+
+    RoaringValue *value = RedisModule_ModuleTypeGetValue(src);
+    setBitmap(dst, snapshotBitmap(getBitmap(src)), value->cardinality);
+    RedisModule_ReplyWithLongLong(ctx, 1);
+    RedisModule_ReplicateVerbatim(ctx);
+
+    return REDISMODULE_OK;
+}
+
+/**
+ * ROARING.SNAPSHOT <src> <dst> [<src> <dst> ...]
+ *
+ * Copies every src to the dst after it, all at the same point in time, sharing
+ * containers like ROARING.COPY. Existing destinations are overwritten, and a
+ * missing src deletes its dst.
+ *
+ * Returns the number of bitmaps copied
+ */
+int cmdSnapshot(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc < 3 || argc % 2 == 0) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    // Check every key before anything is written
+    for (int i = 1; i < argc; i++) {
+        RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[i], REDISMODULE_READ);
+        if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != RoaringType) {
+            RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    // Take every copy first, since a dst can be the src of a later pair
+    size_t count = (size_t)(argc - 1) / 2;
+    roaring_bitmap_t **copies = calloc(count, sizeof(roaring_bitmap_t*));
+    uint64_t *cardinalities = calloc(count, sizeof(uint64_t));
+    for (size_t i = 0; i < count; i++) {
+        RedisModuleKey *src = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1 + 2 * i], REDISMODULE_READ);
+        if (RedisModule_KeyType(src) != REDISMODULE_KEYTYPE_EMPTY) {
+            copies[i] = snapshotBitmap(getBitmap(src));
+            cardinalities[i] = ((RoaringValue*)RedisModule_ModuleTypeGetValue(src))->cardinality;
+        }
+    }
+
+    long long copied = 0;
+    for (size_t i = 0; i < count; i++) {
+        RedisModuleKey *dst = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[2 + 2 * i], REDISMODULE_READ | REDISMODULE_WRITE);
+        if (copies[i] == NULL) {
+            RedisModule_DeleteKey(dst);
+        } else {
+            setBitmap(dst, copies[i], cardinalities[i]);
+            copied++;
+        }
+    }
+    free(copies);
+    free(cardinalities);
+
+    RedisModule_ReplyWithLongLong(ctx, copied);
+    RedisModule_ReplicateVerbatim(ctx);
+
+    return REDISMODULE_OK;
+}
+
+/**
+ * ROARING.DUMP <key> [FROMCONTAINER <i>] [COUNT <n>]
+ *
+ * Returns the bitmap in the portable format of roaring_bitmap_portable_serialize,
+ * or only n of its containers from the i-th on, as a bitmap of its own. Chunks
+ * of a key read in order can be put back together with ROARING.RESTOREAPPEND.
+ * A key still serialized is returned as it is.
+ *
+ * Returns nil if the key does not exist or has no container i
+ */
+int cmdDump(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    char* format_err = "ERR syntax error, expects roaring.dump key [FROMCONTAINER i] [COUNT n]";
+
+    if (argc < 2 || argc % 2 != 0 || argc > 6) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    long long from = 0, count = -1;
+    for (int i = 2; i < argc; i += 2) {
+        const char *option = RedisModule_StringPtrLen(argv[i], NULL);
+        long long *target;
+        if (strcasecmp(option, "fromcontainer") == 0) {
+            target = &from;
+        } else if (strcasecmp(option, "count") == 0) {
+            target = &count;
+        } else {
+            RedisModule_ReplyWithError(ctx, format_err);
+            return REDISMODULE_ERR;
+        }
+        if (RedisModule_StringToLongLong(argv[i + 1], target) != REDISMODULE_OK || *target < 0) {
+            RedisModule_ReplyWithError(ctx, format_err);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ);
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        return RedisModule_ReplyWithNull(ctx);
+    } else if (RedisModule_ModuleTypeGetType(key) != RoaringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    RoaringValue *stored = RedisModule_ModuleTypeGetValue(key);
+    if (stored->bitmap == NULL && from == 0 && count < 0) {
+        return RedisModule_ReplyWithStringBuffer(ctx, stored->serialized, stored->size);
+    }
+
+    const roaring_bitmap_t *bitmap = getBitmap(key);
+    int32_t size = bitmap->high_low_container.size;
+    if (from >= size) {
+        return RedisModule_ReplyWithNull(ctx);
+    }
+    if (count < 0 || count > size - from) {
+        count = size - from;
+    }
+
+    roaring_bitmap_t chunk = chunkView(bitmap, (int32_t)from, (int32_t)count);
+    size_t size_in_bytes = roaring_bitmap_portable_size_in_bytes(&chunk);
+    char *serialized = malloc(size_in_bytes);
+    roaring_bitmap_portable_serialize(&chunk, serialized);
+    RedisModule_ReplyWithStringBuffer(ctx, serialized, size_in_bytes);
+    free(serialized);
+
+    return REDISMODULE_OK;
+}
+
+/* Reads a bitmap returned by ROARING.DUMP, replying with an error if it is not one */
+static roaring_bitmap_t *readDump(RedisModuleCtx *ctx, RedisModuleString *dump) {
+    size_t len;
+    const char *serialized = RedisModule_StringPtrLen(dump, &len);
+    if (len == 0 || roaring_bitmap_portable_deserialize_size(serialized, len) != len) {
+        RedisModule_ReplyWithError(ctx, "ERR not a serialized roaring bitmap");
+        return NULL;
+    }
+    return roaring_bitmap_portable_deserialize(serialized);
+}
+
+/**
+ * ROARING.RESTORE <key> <serialized> [REPLACE]
+ *
+ * Stores a bitmap returned by ROARING.DUMP at key, building its containers
+ * straight from the bytes. An existing key is only overwritten with REPLACE.
+ *
+ * Returns the cardinality of the bitmap
+ */
+int cmdRestore(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3 && argc != 4) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    bool replace = false;
+    if (argc == 4) {
+        if (strcasecmp(RedisModule_StringPtrLen(argv[3], NULL), "replace") != 0) {
+            RedisModule_ReplyWithError(ctx, "ERR syntax error, expects roaring.restore key serialized [REPLACE]");
+            return REDISMODULE_ERR;
+        }
+        replace = true;
+    }
+
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && !replace) {
+        RedisModule_ReplyWithError(ctx, "BUSYKEY Target key name already exists.");
+        return REDISMODULE_ERR;
+    }
+
+    roaring_bitmap_t *bitmap = readDump(ctx, argv[2]);
+    if (bitmap == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    // Like RESTORE, REPLACE overwrites a key of any type
+    RedisModule_DeleteKey(key);
+    uint64_t cardinality = roaring_bitmap_get_cardinality(bitmap);
+    if (cardinality == 0) {
+        roaring_bitmap_free(bitmap);
+    } else {
+        setBitmap(key, bitmap, cardinality);
+    }
+
+    RedisModule_ReplyWithLongLong(ctx, (long long)cardinality);
+    RedisModule_ReplicateVerbatim(ctx);
+
+    return REDISMODULE_OK;
+}
+
+/**
+ * ROARING.RESTOREAPPEND <key> <serialized>
+ *
+ * Adds the values of a bitmap returned by ROARING.DUMP to the bitmap at key,
+ * creating it if needed. Chunks added in the order they were dumped only
+ * append containers.
+ *
+ * Returns the cardinality of the bitmap at key
+ */
+int cmdRestoreAppend(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != RoaringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    roaring_bitmap_t *chunk = readDump(ctx, argv[2]);
+    if (chunk == NULL) {
+        return REDISMODULE_ERR;
+    }
+
+    uint64_t added = roaring_bitmap_get_cardinality(chunk);
+    if (RedisModule_KeyType(key) == REDISMODULE_KEYTYPE_EMPTY) {
+        if (added == 0) {
+            roaring_bitmap_free(chunk);
+            return RedisModule_ReplyWithLongLong(ctx, 0);
+        }
+        setBitmap(key, chunk, added);
+    } else {
+        uint64_t before = getCardinality(key);
+        roaring_bitmap_t *bitmap = getWritableBitmap(key);
+        bool after_last = added == 0 || roaring_bitmap_is_empty(bitmap)
+                || roaring_bitmap_minimum(chunk) > roaring_bitmap_maximum(bitmap);
+        roaring_bitmap_or_inplace(bitmap, chunk);
+        roaring_bitmap_free(chunk);
+        // Values past the last one of the key are all new
+        if (!after_last) {
+            added = roaring_bitmap_get_cardinality(bitmap) - before;
+        }
+        addCardinality(key, (int64_t)added);
+    }
+
+    RedisModule_ReplyWithLongLong(ctx, (long long)getCardinality(key));
+    RedisModule_ReplicateVerbatim(ctx);
+
+    return REDISMODULE_OK;
+}
+
+/**
+ * RDB encoding versions:
+ *
+ *   0  a single string holding roaring_bitmap_serialize
+ *   1  the portable format, streamed: a string holding the portable header
+ *      (or any other start of the serialization), the byte size of the containers that follow it as an unsigned, then
+ *      the containers as strings of at most RDB_CHUNK_SIZE bytes each, except
+ *      for large containers which are saved on their own
+ */
+#define RDB_ENCVER 1
+#define RDB_CHUNK_SIZE (64 * 1024)
+// Containers at least this big are saved straight from memory instead of being grouped
+#define RDB_DIRECT_SIZE 4096
+
+typedef struct {
+    RedisModuleIO *rdb;
+    char *chunk;
+    size_t len;
+} RdbWriter;
+
+static void rdbFlushChunk(RdbWriter *w) {
+    if (w->len > 0) {
+        RedisModule_SaveStringBuffer(w->rdb, w->chunk, w->len);
+        w->len = 0;
+    }
+}
+
+static void rdbWrite(RdbWriter *w, const void *data, size_t len) {
+    if (len >= RDB_DIRECT_SIZE) {
+        rdbFlushChunk(w);
+        RedisModule_SaveStringBuffer(w->rdb, data, len);
+        return;
+    }
+    if (w->len + len > RDB_CHUNK_SIZE) {
+        rdbFlushChunk(w);
+    }
+    memcpy(w->chunk + w->len, data, len);
+    w->len += len;
+}
+
+typedef struct {
+    RedisModuleIO *rdb;
+    char *chunk;
+    size_t len;
+    size_t pos;
+    // bytes of the payload in strings not loaded yet
+    uint64_t remaining;
+} RdbReader;
+
+// roaring_read_callback loading the next string of the payload when needed
+static bool rdbRead(void *buf, size_t len, void *param) {
+    RdbReader *r = param;
+    char *out = buf;
+    while (len > 0) {
+        if (r->pos == r->len) {
+            if (r->remaining == 0) return false;
+            free(r->chunk);
+            r->chunk = RedisModule_LoadStringBuffer(r->rdb, &r->len);
+            r->pos = 0;
+            if (r->len == 0 || r->len > r->remaining) return false;
+            r->remaining -= r->len;
+        }
+        size_t n = len < r->len - r->pos ? len : r->len - r->pos;
+        memcpy(out, r->chunk + r->pos, n);
+        r->pos += n;
+        out += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * Reads the whole payload into one buffer of its exact size, which is checked
+ * but not deserialized. Returns NULL if it is not a valid bitmap.
+ */
+static RoaringValue *rdbLoadLazy(RdbReader *r) {
+    RoaringValue *value = NULL;
+    size_t header_size = r->len;
+    size_t size = header_size + r->remaining;
+    char *serialized = malloc(size);
+    memcpy(serialized, r->chunk, header_size);
+    r->pos = header_size;
+
+    if (rdbRead(serialized + header_size, size - header_size, r) &&
+        roaring_bitmap_portable_deserialize_size(serialized, size) == size) {
+        value = newValue(NULL);
+        value->serialized = serialized;
+        value->size = size;
+        value->header_size = header_size;
+    } else {
+        free(serialized);
+    }
+    free(r->chunk);
+    return value;
+}
+
+/**
+ * Builds the bitmap while the strings are read, containers get their exact
+ * size and the whole payload is never in memory at once. Returns NULL if it
+ * is not a valid bitmap or if it does not use exactly all of the payload.
+ */
+static roaring_bitmap_t *rdbLoadStream(RdbReader *r) {
+    roaring_bitmap_t *bitmap = roaring_bitmap_portable_deserialize_stream(rdbRead, r);
+    if (bitmap != NULL && (r->pos != r->len || r->remaining != 0)) {
+        roaring_bitmap_free(bitmap);
+        bitmap = NULL;
+    }
+    free(r->chunk);
+    return bitmap;
+}
+
+void *RoaringRdbLoad(RedisModuleIO *rdb, int encver) {
+    RdbReader r = {.rdb = rdb};
+    roaring_bitmap_t *bitmap = NULL;
+    RoaringValue *value = NULL;
+
+    if (encver == 0) {
+        size_t size;
+        char *serialized = RedisModule_LoadStringBuffer(rdb, &size);
+        uint32_t card;
+        if (size > 0 && serialized[0] == SERIALIZATION_CONTAINER) {
+            r.chunk = serialized;
+            r.len = size;
+            r.pos = 1;
+            bitmap = rdbLoadStream(&r);
+        } else {
+            if (size >= 1 + sizeof(card) && serialized[0] == SERIALIZATION_ARRAY_UINT32) {
+                memcpy(&card, serialized + 1, sizeof(card));
+                if (size == 1 + sizeof(card) + (uint64_t) card * sizeof(uint32_t)) {
+                    bitmap = roaring_bitmap_deserialize(serialized);
+                }
+            }
+            free(serialized);
+        }
+    } else if (encver == RDB_ENCVER) {
+        r.chunk = RedisModule_LoadStringBuffer(rdb, &r.len);
+        r.remaining = RedisModule_LoadUnsigned(rdb);
+        if (LazyLoad) {
+            value = rdbLoadLazy(&r);
+        } else {
+            bitmap = rdbLoadStream(&r);
+        }
+    }
+
+    if (bitmap != NULL) {
+        value = newValue(bitmap);
+    } else if (value == NULL) {
+        RedisModule_LogIOError(rdb, "warning", "Invalid roaring bitmap in RDB (encoding version %d)", encver);
+    }
+    return value;
+}
+
+/**
+ * Saves the bitmap in the portable format, container by container: the fork
+ * doing BGSAVE reads every container where it lives instead of copying the
+ * whole bitmap into a buffer first.
+ */
+void RoaringRdbSave(RedisModuleIO *rdb, void *value) {
+    RoaringValue *stored = value;
+    if (stored->bitmap == NULL) {
+        // Never used since it was loaded or attached: save it back as it was read
+        RedisModule_SaveStringBuffer(rdb, stored->serialized, stored->header_size);
+        RedisModule_SaveUnsigned(rdb, stored->size - stored->header_size);
+        for (size_t offset = stored->header_size; offset < stored->size; offset += RDB_CHUNK_SIZE) {
+            size_t len = stored->size - offset < RDB_CHUNK_SIZE ? stored->size - offset : RDB_CHUNK_SIZE;
+            RedisModule_SaveStringBuffer(rdb, stored->serialized + offset, len);
+        }
+        return;
+    }
+
+    roaring_bitmap_t *bitmap = stored->bitmap;
+    const roaring_array_t *ra = &bitmap->high_low_container;
+
+    size_t header_size = roaring_bitmap_portable_header_size_in_bytes(bitmap);
+    char *header = malloc(header_size);
+    roaring_bitmap_portable_serialize_header(bitmap, header);
+    RedisModule_SaveStringBuffer(rdb, header, header_size);
+    free(header);
+    RedisModule_SaveUnsigned(rdb, roaring_bitmap_portable_size_in_bytes(bitmap) - header_size);
+
+    // The portable format is little endian, like the containers in memory
+    RdbWriter w = {.rdb = rdb, .chunk = malloc(RDB_CHUNK_SIZE), .len = 0};
+    for (int32_t i = 0; i < ra->size; i++) {
+        uint8_t type = ra->typecodes[i];
+        const void *container = container_unwrap_shared(ra->containers[i], &type);
+
+        if (type == RUN_CONTAINER_TYPE_CODE) {
+            const run_container_t *run = container;
+            uint16_t n_runs = (uint16_t)run->n_runs;
+            rdbWrite(&w, &n_runs, sizeof(n_runs));
+            rdbWrite(&w, run->runs, run->n_runs * sizeof(rle16_t));
+        } else if (type == ARRAY_CONTAINER_TYPE_CODE) {
+            const array_container_t *array = container;
+            rdbWrite(&w, array->array, array->cardinality * sizeof(uint16_t));
+        } else {
+            const bitset_container_t *bitset = container;
+            rdbWrite(&w, bitset->array, BITSET_CONTAINER_SIZE_IN_WORDS * sizeof(uint64_t));
+        }
+    }
+    rdbFlushChunk(&w);
+    free(w.chunk);
+}
+
+// Shorter runs of consecutive values are cheaper to rewrite as plain values than as a range
+#define AOF_MIN_RANGE 8
+
+/**
+ * Collects the values of a bitmap being rewritten: runs of consecutive values
+ * turn into ROARING.ADDRANGE, everything else into ROARING.ADDBLOB batches. The
+ * batch is encoded as the blob, so no string is allocated per value.
+ */
+typedef struct {
+    RedisModuleIO *aof;
+    RedisModuleString *key;
+    unsigned char *batch;
+    size_t batch_len;  // in values
+    uint64_t run_start;
+    uint64_t run_end;  // one past the last value of the current run
+} AofWriter;
+
+static void aofFlushBatch(AofWriter *w) {
+    if (w->batch_len == 0) {
+        return;
+    }
+    RedisModule_EmitAOF(w->aof, "ROARING.ADDBLOB", "sb", w->key, (const char*)w->batch, w->batch_len * sizeof(uint32_t));
+    w->batch_len = 0;
+}
+
+static void aofFlushRun(AofWriter *w) {
+    if (w->run_end - w->run_start >= AOF_MIN_RANGE) {
+        RedisModule_EmitAOF(w->aof, "ROARING.ADDRANGE", "sll", w->key, (long long)w->run_start, (long long)w->run_end - 1);
+    } else {
+        for (uint64_t v = w->run_start; v < w->run_end; v++) {
+            // ROARING.ADDBLOB takes little-endian values whatever the host is
+            unsigned char *b = w->batch + w->batch_len++ * sizeof(uint32_t);
+            b[0] = (unsigned char)v;
+            b[1] = (unsigned char)(v >> 8);
+            b[2] = (unsigned char)(v >> 16);
+            b[3] = (unsigned char)(v >> 24);
+            if (w->batch_len == (size_t)AofBatchSize) {
+                aofFlushBatch(w);
+            }
+        }
+    }
+    w->run_start = w->run_end = 0;
+}
+
+static void aofAddRange(AofWriter *w, uint64_t start, uint64_t end) {
+    if (start != w->run_end) {
+        aofFlushRun(w);
+        w->run_start = start;
+    }
+    w->run_end = end;
+}
+
+/**
+ * Rewrites the bitmap container by container, so run containers cost one
+ * command per run instead of one argument per value.
+ */
+void RoaringAofRewrite(RedisModuleIO *aof, RedisModuleString *key, void *value) {
+    // Rewrites run in a child process, so deserializing a lazy key here costs
+    // the server nothing
+    const roaring_array_t *ra = &valueBitmap(value)->high_low_container;
+    AofWriter w = {
+        .aof = aof,
+        .key = key,
+        .batch = malloc((size_t)AofBatchSize * sizeof(uint32_t)),
+    };
+
+    for (int32_t i = 0; i < ra->size; i++) {
+        uint64_t base = (uint64_t)ra->keys[i] << 16;
+        uint8_t type = ra->typecodes[i];
+        const void *container = container_unwrap_shared(ra->containers[i], &type);
+
+        if (type == RUN_CONTAINER_TYPE_CODE) {
+            const run_container_t *run = container;
+            for (int32_t k = 0; k < run->n_runs; k++) {
+                uint64_t start = base + run->runs[k].value;
+                aofAddRange(&w, start, start + run->runs[k].length + 1);
+            }
+        } else if (type == ARRAY_CONTAINER_TYPE_CODE) {
+            const array_container_t *array = container;
+            for (int32_t k = 0; k < array->cardinality; k++) {
+                uint64_t v = base + array->array[k];
+                aofAddRange(&w, v, v + 1);
+            }
+        } else {
+            const bitset_container_t *bitset = container;
+            for (int32_t k = 0; k < BITSET_CONTAINER_SIZE_IN_WORDS; k++) {
+                uint64_t word = bitset->array[k];
+                while (word != 0) {
+                    uint64_t v = base + k * 64 + __builtin_ctzll(word);
+                    aofAddRange(&w, v, v + 1);
+                    word &= word - 1;
+                }
+            }
+        }
+    }
+    aofFlushRun(&w);
+    aofFlushBatch(&w);
+    free(w.batch);
+}
+
+size_t RoaringMemUsage(const void *value) {
+    const RoaringValue *stored = value;
+    size_t size = stored->rank_index != NULL ? roaring_rank_index_size_in_bytes(stored->rank_index) : 0;
+    if (stored->mapping != NULL) {
+        // Attached files live in the page cache, outside of the server's memory
+        return size + sizeof(RoaringValue);
+    }
+    if (stored->bitmap == NULL) {
+        return size + stored->size;
+    }
+    // A container shared by copies is split evenly between them
+    const roaring_array_t *ra = &stored->bitmap->high_low_container;
+    for (int32_t i = 0; i < ra->size; i++) {
+        uint8_t type = ra->typecodes[i];
+        size_t bytes = (size_t)container_size_in_bytes(ra->containers[i], type);
+        if (type == SHARED_CONTAINER_TYPE_CODE) {
+            bytes /= ((const shared_container_t*)ra->containers[i])->counter;
+        }
+        size += bytes;
+    }
+    return size;
+}
+
+void RoaringFree(void *value) {
+    RoaringValue *stored = value;
+    if (stored->bitmap != NULL) {
+        roaring_bitmap_free(stored->bitmap);
+    }
+    if (stored->rank_index != NULL) {
+        roaring_rank_index_free(stored->rank_index);
+    }
+    if (stored->mapping != NULL) {
+        unmapValue(stored);
+    } else {
+        free(stored->serialized);
+    }
+    free(stored);
+}
+
+/**
+ * ROARING.ATTACH <key> <path>
+ *
+ * Stores the bitmap serialized in a file at key without reading it into
+ * memory: the file is mapped and the key reads it where it lies. Both formats
+ * are checked whole once. Files written with roaring_bitmap_frozen_serialize
+ * are then used as they are by every command. Files in the portable format are
+ * served like a lazily loaded key: ROARING.ISMEMBER and ROARING.CARD read the
+ * file, other commands deserialize it first. The first write copies the bitmap into memory and
+ * unmaps the file. The file must not change while it is attached: a truncated
+ * mapping faults when it is read.
+ *
+ * Only regular files under the ATTACH_DIR module argument can be attached.
+ * Replicas and the AOF get the bitmap itself, in chunks of containers like
+ * ROARING.BITOP on the pool, so they need no copy of the file.
+ *
+ * Returns the cardinality of the bitmap, an empty bitmap deletes the key
+ */
+int cmdAttach(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    if (argc != 3) {
+        return RedisModule_WrongArity(ctx);
+    }
+    RedisModule_AutoMemory(ctx);
+
+    RedisModuleKey *key = (RedisModuleKey*)RedisModule_OpenKey(ctx, argv[1], REDISMODULE_READ | REDISMODULE_WRITE);
+    if (RedisModule_KeyType(key) != REDISMODULE_KEYTYPE_EMPTY && RedisModule_ModuleTypeGetType(key) != RoaringType) {
+        RedisModule_ReplyWithError(ctx, REDISMODULE_ERRORMSG_WRONGTYPE);
+        return REDISMODULE_ERR;
+    }
+
+    if (AttachDir[0] == '\0') {
+        RedisModule_ReplyWithError(ctx, "ERR ROARING.ATTACH is disabled, load the module with ATTACH_DIR");
+        return REDISMODULE_ERR;
+    }
+    char path[PATH_MAX];
+    if (realpath(RedisModule_StringPtrLen(argv[2], NULL), path) == NULL) {
+        RedisModule_ReplyWithError(ctx, "ERR could not open the file");
+        return REDISMODULE_ERR;
+    }
+    size_t dirlen = strlen(AttachDir);
+    if (strncmp(path, AttachDir, dirlen) != 0 || (path[dirlen] != '/' && AttachDir[dirlen - 1] != '/')) {
+        RedisModule_ReplyWithError(ctx, "ERR the file is not under ATTACH_DIR");
+        return REDISMODULE_ERR;
+    }
+
+    int fd = open(path, O_RDONLY | O_NOFOLLOW);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1 || !S_ISREG(st.st_mode)) {
+        RedisModule_ReplyWithError(ctx, "ERR could not open the file");
+        if (fd != -1) close(fd);
+        return REDISMODULE_ERR;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        RedisModule_ReplyWithError(ctx, "ERR not a roaring bitmap file");
+        return REDISMODULE_ERR;
+    }
+    size_t size = (size_t)st.st_size;
+    // Private so that the pages of the file are shared, but never written back
+    void *mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        RedisModule_ReplyWithError(ctx, "ERR could not map the file");
+        return REDISMODULE_ERR;
+    }
+
+    RoaringValue *value = newValue(NULL);
+    value->mapping = mapping;
+    value->mapping_size = size;
+    uint64_t cardinality;
+    // Mappings are page aligned, as frozen views need. Every container is
+    // checked, since commands trust what the view says about them. Writes go
+    // through getWritableBitmap, which never hands out the view itself.
+    roaring_bitmap_t *frozen = (roaring_bitmap_t*)roaring_bitmap_frozen_view_checked(mapping, size);
+    if (frozen != NULL) {
+        value->bitmap = frozen;
+        cardinality = roaring_bitmap_get_cardinality(frozen);
+    } else if (roaring_bitmap_portable_deserialize_size(mapping, size) == size) {
+        value->serialized = mapping;
+        value->size = size;
+        // The RDB encoding starts with the header, but any first slice loads the same
+        value->header_size = size < RDB_CHUNK_SIZE ? size : RDB_CHUNK_SIZE;
+        cardinality = roaring_bitmap_portable_cardinality(mapping);
+    } else {
+        munmap(mapping, size);
+        free(value);
+        RedisModule_ReplyWithError(ctx, "ERR not a roaring bitmap file");
+        return REDISMODULE_ERR;
+    }
+
+    // Frozen views are replicated a slice of the file at a time. Portable files
+    // can't be sliced in place, so they are loaded just for as long as it takes.
+    if (frozen != NULL) {
+        replicateBitmap(ctx, argv[1], frozen);
+    } else {
+        roaring_bitmap_t *loaded = roaring_bitmap_portable_deserialize(mapping);
+        replicateBitmap(ctx, argv[1], loaded);
+        roaring_bitmap_free(loaded);
+    }
+
+    if (cardinality == 0) {
+        RoaringFree(value);
+        RedisModule_DeleteKey(key);
+    } else {
+        value->cardinality = cardinality;
+        RedisModule_ModuleTypeSetValue(key, RoaringType, value);
+    }
+
+    RedisModule_ReplyWithLongLong(ctx, (long long)cardinality);
+
+    return REDISMODULE_OK;
+}
+
+/**
+ * Module arguments, given as name/value pairs after the module path:
+ *
+ *   THREADS <n>            size of the worker pool, 0 (the default) runs every command inline
+ *   OFFLOAD_THRESHOLD <n>  containers the inputs of a command must hold to be run on the pool
+ *   AOF_BATCH_SIZE <n>     most values per ROARING.ADDBLOB written by AOF rewrite, 1024 by default
+ *   LAZY <0|1>             keep keys loaded from the RDB serialized until they are first used
+ *   ATTACH_DIR <dir>       directory ROARING.ATTACH may map files from, unset disables it
+ */
+int parseModuleArgs(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+    long long threads = 0;
+
+    for (int i = 0; i < argc; i += 2) {
+        const char *name = RedisModule_StringPtrLen(argv[i], NULL);
+        if (strcasecmp(name, "attach_dir") == 0 && i + 1 < argc) {
+            // Resolved once, so paths given to ROARING.ATTACH compare against the real directory
+            if (realpath(RedisModule_StringPtrLen(argv[i + 1], NULL), AttachDir) == NULL) {
+                RedisModule_Log(ctx, "warning", "Invalid value for module argument %s", name);
+                return REDISMODULE_ERR;
+            }
+            continue;
+        }
+        long long value;
+        if (i + 1 == argc || RedisModule_StringToLongLong(argv[i + 1], &value) == REDISMODULE_ERR || value < 0) {
+            RedisModule_Log(ctx, "warning", "Invalid value for module argument %s", name);
+            return REDISMODULE_ERR;
+        }
+        if (strcasecmp(name, "threads") == 0) {
+            threads = value;
+        } else if (strcasecmp(name, "offload_threshold") == 0) {
+            OffloadThreshold = value;
+        } else if (strcasecmp(name, "aof_batch_size") == 0) {
+            if (value == 0) {
+                RedisModule_Log(ctx, "warning", "Invalid value for module argument %s", name);
+                return REDISMODULE_ERR;
+            }
+            AofBatchSize = value;
+        } else if (strcasecmp(name, "lazy") == 0) {
+            LazyLoad = value != 0;
+        } else {
+            RedisModule_Log(ctx, "warning", "Unknown module argument %s", name);
+            return REDISMODULE_ERR;
+        }
+    }
+
+    if (threads > 0 && RedisModule_GetContextFlags == NULL) {
+        // Without it a blocked client inside MULTI or Lua can't be ruled out
+        RedisModule_Log(ctx, "warning", "THREADS needs a newer server, running every command inline");
+        threads = 0;
+    }
+    if (threads > 0) {
+        Pool = RoaringPool_New((int)threads);
+        if (Pool == NULL) {
+            RedisModule_Log(ctx, "warning", "Could not start the worker pool");
+            return REDISMODULE_ERR;
+        }
+    }
+    return REDISMODULE_OK;
+}
+
+int RedisModule_OnLoad(RedisModuleCtx *ctx, RedisModuleString **argv, int argc) {
+
+    // Register the module itself
+    if (RedisModule_Init(ctx, "roaring", 1, REDISMODULE_APIVER_1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    if (parseModuleArgs(ctx, argv, argc) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+
+    RedisModuleTypeMethods tm = {
+            .version = REDISMODULE_TYPE_METHOD_VERSION,
+            .rdb_load = RoaringRdbLoad,
+            .rdb_save = RoaringRdbSave,
+            .aof_rewrite = RoaringAofRewrite,
+            .mem_usage = RoaringMemUsage,
+            .free = RoaringFree
+    };
+
+    RoaringType = RedisModule_CreateDataType(ctx, "c_roaring", RDB_ENCVER, &tm);
+    if (RoaringType == NULL) return REDISMODULE_ERR;
+
     // register commands
     RMUtil_RegisterWriteCmd(ctx, "roaring.add", cmdAdd);
     RMUtil_RegisterWriteCmd(ctx, "roaring.remove", cmdRemove);
+    RMUtil_RegisterWriteCmd(ctx, "roaring.addblob", cmdAddBlob);
+    RMUtil_RegisterWriteCmd(ctx, "roaring.removeblob", cmdRemoveBlob);
+    // keys are the first argument of each group, past a variable number of values:
+    // the key spec only declares the first one, the others come from the getkeys API
+    if (RedisModule_CreateCommand(ctx, "roaring.madd", cmdMAdd, "write deny-oom getkeys-api", 1, 1, 1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    if (RedisModule_CreateCommand(ctx, "roaring.mremove", cmdMRemove, "write getkeys-api", 1, 1, 1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    RMUtil_RegisterWriteCmd(ctx, "roaring.addrange", cmdAddRange);
+    RMUtil_RegisterWriteCmd(ctx, "roaring.removerange", cmdRemoveRange);
+    RMUtil_RegisterWriteCmd(ctx, "roaring.fliprange", cmdFlipRange);
+    RMUtil_RegisterReadCmd(ctx, "roaring.countrange", cmdCountRange);
+    RMUtil_RegisterReadCmd(ctx, "roaring.containsrange", cmdContainsRange);
+    RMUtil_RegisterReadCmd(ctx, "roaring.rank", cmdRank);
+    RMUtil_RegisterReadCmd(ctx, "roaring.select", cmdSelect);
     RMUtil_RegisterReadCmd(ctx, "roaring.card", cmdCard);
+    // keys start after the operation name: roaring.bitop <op> <dest> <src...>
+    if (RedisModule_CreateCommand(ctx, "roaring.bitop", cmdBitOp, "write deny-oom", 2, -1, 1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    // keys follow the expression and their count, and come from the getkeys API
+    if (RedisModule_CreateCommand(ctx, "roaring.eval", cmdEval, "readonly getkeys-api", 3, 3, 1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    if (RedisModule_CreateCommand(ctx, "roaring.evalstore", cmdEvalStore, "write deny-oom getkeys-api", 1, 1, 1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
     RMUtil_RegisterReadCmd(ctx, "roaring.members", cmdMembers);
+    RMUtil_RegisterReadCmd(ctx, "roaring.scan", cmdScan);
     RMUtil_RegisterReadCmd(ctx, "roaring.ismember", cmdIsMember);
+    RMUtil_RegisterReadCmd(ctx, "roaring.mismember", cmdMisMember);
+    if (RedisModule_CreateCommand(ctx, "roaring.copy", cmdCopy, "write deny-oom", 1, 2, 1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    // keys are every argument, in src/dst pairs
+    if (RedisModule_CreateCommand(ctx, "roaring.snapshot", cmdSnapshot, "write deny-oom", 1, -1, 1) == REDISMODULE_ERR) {
+        return REDISMODULE_ERR;
+    }
+    RMUtil_RegisterWriteCmd(ctx, "roaring.attach", cmdAttach);
+    RMUtil_RegisterReadCmd(ctx, "roaring.dump", cmdDump);
+    RMUtil_RegisterWriteCmd(ctx, "roaring.restore", cmdRestore);
+    RMUtil_RegisterWriteCmd(ctx, "roaring.restoreappend", cmdRestoreAppend);
 
     return REDISMODULE_OK;
 }
@@ -0,0 +1,84 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include "./pool.h"
+
+typedef struct RoaringPoolJob {
+    void (*fn)(void *);
+    void *arg;
+    struct RoaringPoolJob *next;
+} RoaringPoolJob;
+
+struct RoaringPool {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    RoaringPoolJob *head;
+    RoaringPoolJob *tail;
+};
+
+static void *poolWorker(void *arg) {
+    RoaringPool *pool = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->head == NULL) {
+            pthread_cond_wait(&pool->ready, &pool->lock);
+        }
+        RoaringPoolJob *job = pool->head;
+        pool->head = job->next;
+        if (pool->head == NULL) {
+            pool->tail = NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        job->fn(job->arg);
+        free(job);
+    }
+    return NULL;
+}
+
+RoaringPool *RoaringPool_New(int threads) {
+    RoaringPool *pool = calloc(1, sizeof(RoaringPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->ready, NULL);
+
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, poolWorker, pool) == 0) {
+            pthread_detach(thread);
+            started++;
+        }
+    }
+    if (started == 0) {
+        pthread_cond_destroy(&pool->ready);
+        pthread_mutex_destroy(&pool->lock);
+        free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void RoaringPool_Submit(RoaringPool *pool, void (*fn)(void *), void *arg) {
+    RoaringPoolJob *job = malloc(sizeof(RoaringPoolJob));
+    if (job == NULL) {
+        // Running late beats never running: the caller is waiting on it
+        fn(arg);
+        return;
+    }
+    job->fn = fn;
+    job->arg = arg;
+    job->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail == NULL) {
+        pool->head = job;
+    } else {
+        pool->tail->next = job;
+    }
+    pool->tail = job;
+    pthread_cond_signal(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,19 @@
+#ifndef __ROARING_POOL_H__
+#define __ROARING_POOL_H__
+
+/**
+ * A fixed size pool of worker threads pulling jobs from a FIFO queue.
+ *
+ * Jobs must not touch the keyspace: they only get to see data that the
+ * submitting thread prepared for them, and hand their result back through
+ * RedisModule_UnblockClient.
+ */
+typedef struct RoaringPool RoaringPool;
+
+/* Starts `threads` workers. Returns NULL if no thread could be created. */
+RoaringPool *RoaringPool_New(int threads);
+
+/* Queues `fn(arg)` to run on the next idle worker, or runs it right away if the job can't be queued */
+void RoaringPool_Submit(RoaringPool *pool, void (*fn)(void *), void *arg);
+
+#endif
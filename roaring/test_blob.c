@@ -0,0 +1,61 @@
+#include "blob.h"
+#include <stdio.h>
+#include <string.h>
+#include "assert.h"
+
+/* Decodes a whole DELTA blob of len bytes, returns the count or -1 */
+static long long readAll(const char *blob, size_t len, uint32_t *out, size_t max) {
+    RoaringDeltaReader reader;
+    RoaringBlob_InitDeltas(&reader, blob, len);
+    return RoaringBlob_ReadDeltas(&reader, out, max);
+}
+
+int main(int argc, char **argv) {
+    uint32_t out[8];
+
+    // plain blobs are little-endian whatever the host, and need no alignment
+    const char plain[] = "\xff\x01\x00\x00\x00\xff\xff\xff\xff\x78\x56\x34\x12";
+    RoaringBlob_ReadPlain(plain + 1, 3, out);
+    assert(out[0] == 1);
+    assert(out[1] == UINT32_MAX);
+    assert(out[2] == 0x12345678);
+    uint32_t in_place;
+    memcpy(&in_place, plain + 9, sizeof(in_place));
+    assert(RoaringBlob_PlainIsHostOrder() == (in_place == 0x12345678));
+
+    // deltas: 5, +3, +128 in two bytes
+    assert(readAll("\x05\x03\x80\x01", 4, out, 8) == 3);
+    assert(out[0] == 5 && out[1] == 8 && out[2] == 136);
+    // checking only
+    assert(readAll("\x05\x03\x80\x01", 4, NULL, SIZE_MAX) == 3);
+    // empty blob
+    assert(readAll("", 0, out, 8) == 0);
+    // repeated values are a zero delta
+    assert(readAll("\x07\x00", 2, out, 8) == 2);
+    assert(out[0] == 7 && out[1] == 7);
+
+    // the largest value fits in 5 bytes
+    assert(readAll("\xff\xff\xff\xff\x0f", 5, out, 8) == 1);
+    assert(out[0] == UINT32_MAX);
+    // a 6th byte is never valid, even when it adds nothing
+    assert(readAll("\xff\xff\xff\xff\x8f\x00", 6, out, 8) == -1);
+    // a 5th byte with bits past 32
+    assert(readAll("\xff\xff\xff\xff\x1f", 5, out, 8) == -1);
+    // a sum past UINT32_MAX
+    assert(readAll("\xff\xff\xff\xff\x0f\x01", 6, out, 8) == -1);
+    // a varint cut short, alone and after a valid value
+    assert(readAll("\x80", 1, out, 8) == -1);
+    assert(readAll("\x05\x80", 2, out, 8) == -1);
+
+    // batches carry the previous value over
+    RoaringDeltaReader reader;
+    RoaringBlob_InitDeltas(&reader, "\x01\x01\x01", 3);
+    assert(RoaringBlob_ReadDeltas(&reader, out, 2) == 2);
+    assert(out[0] == 1 && out[1] == 2);
+    assert(RoaringBlob_ReadDeltas(&reader, out, 2) == 1);
+    assert(out[0] == 3);
+    assert(RoaringBlob_ReadDeltas(&reader, out, 2) == 0);
+
+    printf("PASS!\n");
+    return 0;
+}
@@ -0,0 +1,120 @@
+#!/usr/bin/env bash
+# Checks the replies of the commands whose input is parsed by the module
+# (binary blobs, multi-key writes, dump and restore) against a running server
+# with the module loaded:
+#
+#   ./test_commands.sh [redis-cli arguments, e.g. -p 6380]
+#
+# Only keys under roaring-test: are touched. REDIS_CLI overrides the client.
+
+CLI=${REDIS_CLI:-redis-cli}
+ARGS=("$@")
+K=roaring-test:
+failures=0
+
+cli() {
+    "$CLI" "${ARGS[@]}" "$@" 2>&1
+}
+
+report() {
+    if [ "$2" != "$1" ]; then
+        echo "FAIL: $3"
+        echo "  expected: $1"
+        echo "  got:      $2"
+        failures=$((failures + 1))
+    fi
+}
+
+# check <expected reply> <command>...
+check() {
+    local expected=$1
+    shift
+    report "$expected" "$(cli "$@")" "$*"
+}
+
+# check_stdin <expected reply> <printf format> <command>... sends the bytes as
+# the last argument, for blobs holding NUL bytes
+check_stdin() {
+    local expected=$1 input=$2
+    shift 2
+    report "$expected" "$(printf "$input" | cli -x "$@")" "$* < $input"
+}
+
+# check_restore <expected reply> <source key> <command>... sends ROARING.DUMP of
+# the source key as the last argument
+check_restore() {
+    local expected=$1 source=$2
+    shift 2
+    # --raw ends the reply with a newline that is not part of it
+    report "$expected" "$(cli --raw roaring.dump "$source" | head -c -1 | cli -x "$@")" "$* < roaring.dump $source"
+}
+
+cleanup() {
+    cli del ${K}a ${K}b ${K}c ${K}blob ${K}copy > /dev/null
+}
+cleanup
+
+# ROARING.ADDBLOB and ROARING.REMOVEBLOB, plain
+check_stdin 3 '\x01\x00\x00\x00\x02\x00\x00\x00\xff\xff\xff\xff' roaring.addblob ${K}blob
+check 1 roaring.ismember ${K}blob 4294967295
+check "ERR invalid blob" roaring.addblob ${K}blob $'\x01\x01\x01'
+check_stdin "ERR invalid blob" '\x01\x00\x00\x00\x02' roaring.addblob ${K}blob
+check 2 roaring.addblob ${K}blob $'\x01\x01\x01\x01\x02\x01\x01\x01'
+check 1 roaring.ismember ${K}blob 16843010
+check_stdin 2 '\x01\x00\x00\x00\x02\x00\x00\x00\x03\x00\x00\x00' roaring.removeblob ${K}blob
+check "ERR syntax error, expects <key> <blob> [DELTA]" roaring.addblob ${K}blob $'\x01\x01\x01\x01' DELTAS
+check 3 roaring.card ${K}blob
+
+# DELTA blobs: 5, +3, +128 in two bytes
+cli del ${K}blob > /dev/null
+check 3 roaring.addblob ${K}blob $'\x05\x03\x80\x01' DELTA
+check $'5\n8\n136' roaring.members ${K}blob
+check 1 roaring.addblob ${K}blob $'\xff\xff\xff\xff\x0f' DELTA
+check 1 roaring.ismember ${K}blob 4294967295
+# a 6th byte, a 5th byte past 32 bits, a sum past UINT32_MAX, a varint cut short
+check "ERR invalid blob" roaring.addblob ${K}blob $'\xff\xff\xff\xff\x8f\x01' DELTA
+check "ERR invalid blob" roaring.addblob ${K}blob $'\xff\xff\xff\xff\x1f' DELTA
+check "ERR invalid blob" roaring.addblob ${K}blob $'\xff\xff\xff\xff\x0f\x01' DELTA
+check "ERR invalid blob" roaring.addblob ${K}blob $'\x05\x80' DELTA
+# invalid blobs change nothing, even after valid values
+check "ERR invalid blob" roaring.removeblob ${K}blob $'\x05\x80' DELTA
+check 4 roaring.card ${K}blob
+check 2 roaring.removeblob ${K}blob $'\x05\x03' DELTA
+check 0 roaring.removeblob ${K}blob $'\x05' DELTA
+
+# ROARING.MADD and ROARING.MREMOVE check every group before writing anything
+check 4 roaring.madd ${K}a 2 1 2 ${K}b 2 2 3
+check 0 roaring.madd ${K}a 1 1
+check "ERR syntax error, expects roaring.madd key count value... [key count value...]" roaring.madd ${K}a 1 7 ${K}b 2 8
+check "ERR syntax error, expects roaring.madd key count value... [key count value...]" roaring.madd ${K}a 1 7 ${K}b 0 8
+check "Invalid argument, expects <key> <count> <int>..." roaring.madd ${K}a 1 7 ${K}b 1 x
+check "ERR syntax error, expects roaring.mremove key count value... [key count value...]" roaring.mremove ${K}a 1 1 ${K}b
+check 0 roaring.ismember ${K}a 7
+check 0 roaring.ismember ${K}b 8
+check 1 roaring.ismember ${K}a 1
+check 3 roaring.mremove ${K}a 2 1 2 ${K}b 1 2 ${K}c 1 5
+check 0 exists ${K}a
+check 1 roaring.card ${K}b
+
+# ROARING.DUMP, ROARING.RESTORE and ROARING.RESTOREAPPEND
+cli roaring.addrange ${K}a 0 99999 > /dev/null
+check_restore 100000 ${K}a roaring.restore ${K}copy
+check_restore "BUSYKEY Target key name already exists." ${K}b roaring.restore ${K}copy
+cli del ${K}copy > /dev/null
+check_restore 1 ${K}b roaring.restore ${K}copy
+check_restore 100000 ${K}a roaring.restoreappend ${K}copy
+check "ERR syntax error, expects roaring.restore key serialized [REPLACE]" roaring.restore ${K}copy garbage REPLAC
+check "ERR not a serialized roaring bitmap" roaring.restore ${K}copy garbage REPLACE
+check "ERR not a serialized roaring bitmap" roaring.restore ${K}c ""
+check "ERR not a serialized roaring bitmap" roaring.restoreappend ${K}copy garbage
+check 100000 roaring.card ${K}copy
+check "" roaring.dump ${K}c
+check "" roaring.dump ${K}a FROMCONTAINER 2
+check "ERR syntax error, expects roaring.dump key [FROMCONTAINER i] [COUNT n]" roaring.dump ${K}a FROMCONTAINER -1
+
+cleanup
+if [ $failures -ne 0 ]; then
+    echo "$failures failures"
+    exit 1
+fi
+echo "PASS!"